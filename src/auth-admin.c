@@ -0,0 +1,547 @@
+/**
+ * @file auth-admin.c
+ * @author Martin Weise <e1429167@student.tuwien.ac.at>
+ * @date 16.10.2026
+ *
+ * @brief Bulk import and export of the users of a running auth-server.
+ * @details Import streams the users of a csv database or of a snapshot to the server, as many
+ *          whole csv lines per round trip as fit into a slot. The server adds them like REGISTER,
+ *          but takes the passwords as given: hashes are kept, plaintext passwords are rehashed on
+ *          the next LOGIN, just like those of a csv database. Users that exist are skipped.
+ *
+ *          Export reads a consistent csv image of all users through a FIFO, written by a process
+ *          the server forks for it, see EXPORT. The image can be loaded with -l or imported again.
+ *
+ *          With -k, every user is imported into its shard, and an export visits the shards one
+ *          after the other. The image of each shard is consistent on its own.
+ *
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <memory.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include "shared.h"
+#include "store.h"
+#include "loader.h"
+#include "snapshot.h"
+
+/* === Constants === */
+
+/** @brief Size of the buffer an export is copied through. */
+#define EXPORT_BUFFER (64 * 1024)
+
+/* === Structs === */
+
+/**
+ * @brief Defines the connection to a shard and the csv lines waiting to be imported into it.
+ */
+struct shard {
+    /** @brief The shared memory file descriptor, -1 until the tool first talks to the shard. */
+    int shmfd;
+    /** @brief Size of the mapping of the shared fragment in bytes. */
+    size_t size;
+    /** @brief The shared fragment of the shard. */
+    struct shared_fragment *shared;
+    /** @brief The waiting csv lines. */
+    char *pending;
+    /** @brief Length of the waiting csv lines. */
+    size_t length;
+    /** @brief Size of the largest chunk of csv lines a slot holds. */
+    size_t room;
+};
+
+/* === Prototypes === */
+
+/**
+ * @brief Prints a nice usage message.
+ */
+static void usage(void);
+/**
+ * @brief Parses the argument vector.
+ * @param argc The argument counter.
+ * @param argv The argument vector.
+ */
+static void parse_args(int argc, char **argv);
+/**
+ * @brief Exists the program with a given message.
+ * @param fmt Formatted string for parsing the latter arguments to.
+ */
+static void error_exit(const char *fmt, ...);
+/**
+ * @brief Frees the used resources.
+ * @details This method is also invoked when the signals SIGINT and SIGTERM occur.
+ */
+static void free_resources(void);
+/**
+ * @brief Sets the terminating flag.
+ * @param sig Signal code.
+ */
+static void signal_handler(int sig);
+/**
+ * @brief Returns a shard, its shared fragment is mapped on first use.
+ * @param index The index of the shard.
+ * @return The shard.
+ */
+static struct shard *select_shard(long index);
+/**
+ * @brief Claims a slot of a shard for a single command.
+ * @param link The shard.
+ * @param modus The command, IMPORT or EXPORT.
+ * @return The command of the claimed slot.
+ */
+static struct message *begin_request(struct shard *link, mode modus);
+/**
+ * @brief Submits the claimed slot and waits for the response.
+ * @param link The shard.
+ * @return The status code of the response.
+ */
+static status commit_request(struct shard *link);
+/**
+ * @brief Releases the claimed slot.
+ * @param link The shard.
+ */
+static void end_request(struct shard *link);
+/**
+ * @brief Sends the waiting csv lines of a shard in one round trip.
+ * @param link The shard.
+ */
+static void flush(struct shard *link);
+/**
+ * @brief Queues a user for import into its shard.
+ * @details Sends the waiting lines of the shard first if the user does not fit behind them. A user
+ *          whose line does not fit into a slot is skipped.
+ * @param username The username.
+ * @param ulen Length of the username.
+ * @param password The password.
+ * @param plen Length of the password.
+ * @param secret The secret.
+ * @param slen Length of the secret.
+ */
+static void import_user(const char *username, size_t ulen, const char *password, size_t plen, const char *secret,
+                        size_t slen);
+/**
+ * @brief Imports the users of a csv database.
+ * @param in The database.
+ */
+static void import_csv(FILE *in);
+/**
+ * @brief Imports the users of a snapshot.
+ * @details Verifies the checksums of the snapshot first.
+ * @param path The file name of the snapshot.
+ */
+static void import_snapshot(const char *path);
+/**
+ * @brief Imports the users of the file, or of stdin.
+ * @details Snapshots are recognized by their magic bytes, like on the server.
+ */
+static void run_import(void);
+/**
+ * @brief Writes a csv image of the users of all shards to the file, or to stdout.
+ */
+static void run_export(void);
+/**
+ * @brief The program entry point.
+ * @param argc The argument counter.
+ * @param argv The argument vector.
+ * @return EXIT_SUCCESS on succesful program execution, EXIT_FAILURE otherwise.
+ */
+int main(int argc, char **argv);
+
+/* === Global Variables === */
+
+/** @brief Holds the program name. */
+static char *progname;
+/** @brief Number of shards the users are spread over. @details Set by -k. */
+static long shards = 1;
+/** @brief The shards. */
+static struct shard links[SHARDS_MAX];
+/** @brief The claimed slot. @details Is released in case of a crash. */
+static struct slot *slot = NULL;
+/** @brief The shard of the claimed slot. */
+static struct shard *claimed = NULL;
+/** @brief Whether users are imported or exported. */
+static mode task = MODE_UNSET;
+/** @brief Name of the file imported from or exported to, "-" for stdin or stdout. */
+static char *filename = "-";
+/** @brief Directory holding the FIFO of an export, a template until it is created. */
+static char fifodir[] = "/tmp/auth-admin-XXXXXX";
+/** @brief The FIFO of an export. */
+static char fifo[sizeof fifodir + 8];
+/** @brief Whether the directory of the FIFO was created. */
+static bool fifo_created = false;
+/** @brief Number of users the servers added. */
+static uint64_t added = 0;
+/** @brief Number of users the servers or the tool skipped. */
+static uint64_t skipped = 0;
+/** @brief Set on SIGINT and SIGTERM. */
+static volatile sig_atomic_t terminating = -1;
+
+/* === Implementations === */
+
+static void usage(void) {
+    (void) fprintf(stderr, "USAGE: %s [-k shards] import [database]\n"
+                           "       %s [-k shards] export [file]\n", progname, progname);
+    exit(EXIT_FAILURE);
+}
+
+static void parse_args(int argc, char **argv) {
+    char *end;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "k:")) != -1) {
+        switch (opt) {
+            case 'k':
+                shards = strtol(optarg, &end, 10);
+                if (*end != '\0' || shards < 1 || shards > SHARDS_MAX) {
+                    usage();
+                }
+                break;
+            default:
+                usage();
+        }
+    }
+    if (optind == argc || argc - optind > 2) {
+        usage();
+    }
+    if (strcmp(argv[optind], "import") == 0) {
+        task = IMPORT;
+    } else if (strcmp(argv[optind], "export") == 0) {
+        task = EXPORT;
+    } else {
+        usage();
+    }
+    if (argc - optind == 2) {
+        filename = argv[optind + 1];
+    }
+}
+
+static void error_exit(const char *fmt, ...) {
+    va_list ap;
+
+    (void) fprintf(stderr, "%s: ", progname);
+    if (fmt != NULL) {
+        va_start(ap, fmt);
+        (void) vfprintf(stderr, fmt, ap);
+        va_end(ap);
+    }
+    if (errno != 0) {
+        (void) fprintf(stderr, ": %s", strerror(errno));
+    }
+    (void) fprintf(stderr, "\n");
+    free_resources();
+
+    DEBUG("Shutting down now.\n");
+    exit(EXIT_FAILURE);
+}
+
+static void free_resources(void) {
+    if (terminating == 1) {
+        return;
+    }
+    terminating = 1;
+    /* Give the claimed slot back to the server */
+    if (slot != NULL) {
+        (void) slot_release(claimed->shared, slot);
+        slot = NULL;
+    }
+    for (int i = 0; i < shards; i++) {
+        if (links[i].shmfd != -1) {
+            (void) close(links[i].shmfd);
+            links[i].shmfd = -1;
+        }
+        if (links[i].shared != NULL) {
+            (void) munmap(links[i].shared, links[i].size);
+            links[i].shared = NULL;
+        }
+        free(links[i].pending);
+        links[i].pending = NULL;
+    }
+    if (fifo_created) {
+        (void) unlink(fifo);
+        (void) rmdir(fifodir);
+        fifo_created = false;
+    }
+}
+
+static void signal_handler(int sig) {
+    terminating = 1;
+}
+
+static struct shard *select_shard(long index) {
+    char name[SHARD_NAME_MAX];
+    struct shard *link = &links[index];
+
+    if (link->shared == NULL) {
+        shard_name(name, sizeof name, SHM_NAME, index, shards);
+        /* Open shared memory object of the shard for reading and writing */
+        if ((link->shmfd = shm_open(name, O_RDWR, PERMISSION)) == -1) {
+            error_exit("Couldn't access shared fragement %s. Is the server running?", name);
+        }
+        if ((link->shared = fragment_attach(link->shmfd, &link->size)) == NULL) {
+            error_exit("Couldn't create mapping.");
+        }
+        /* a single command, its string and the terminating NUL */
+        link->room = link->shared->slot_size - sizeof *slot - sizeof slot->messages[0] - 1;
+    }
+    return link;
+}
+
+static struct message *begin_request(struct shard *link, mode modus) {
+    if (link->shared->server_down != -1 || (slot = slot_acquire(link->shared)) == NULL) {
+        error_exit("Server quit.");
+    }
+    claimed = link;
+    slot_begin(slot, 1);
+    slot->messages[0].modus = modus;
+    return &slot->messages[0];
+}
+
+static status commit_request(struct shard *link) {
+    if (slot_submit(link->shared, slot) == -1) {
+        error_exit("Server quit.");
+    }
+    return slot->messages[0].status;
+}
+
+static void end_request(struct shard *link) {
+    struct slot *tmp = slot;
+
+    slot = NULL;
+    if (slot_release(link->shared, tmp) == -1) {
+        error_exit("Server quit.");
+    }
+}
+
+static void flush(struct shard *link) {
+    struct message *message;
+
+    if (link->length == 0) {
+        return;
+    }
+    message = begin_request(link, IMPORT);
+    /* the lines were sized to fit */
+    (void) slot_put(slot, link->shared->slot_size, &message->secret, link->pending, link->length);
+    if (commit_request(link) != IMPORT_SUCCESS) {
+        errno = 0;
+        error_exit("The server rejected the import.");
+    }
+    added += message->total;
+    skipped += message->position;
+    end_request(link);
+    link->length = 0;
+}
+
+static void import_user(const char *username, size_t ulen, const char *password, size_t plen, const char *secret,
+                        size_t slen) {
+    struct shard *link = select_shard(shard_of(hash_bytes(username, ulen), shards));
+    size_t len = ulen + plen + slen + 3;
+
+    if (len > link->room) {
+        (void) fprintf(stderr, "%s: Skipping %.*s, the user does not fit into a slot of %u bytes.\n", progname,
+                       (int) ulen, username, link->shared->slot_size);
+        skipped++;
+        return;
+    }
+    if (link->length + len > link->room) {
+        flush(link);
+    }
+    /* room for the NUL behind the last line */
+    if (link->pending == NULL && (link->pending = malloc(link->room + 1)) == NULL) {
+        error_exit("Failed to allocate memory for the import.");
+    }
+    (void) sprintf(link->pending + link->length, "%.*s;%.*s;%.*s\n", (int) ulen, username, (int) plen, password,
+                   (int) slen, secret);
+    link->length += len;
+}
+
+static void import_csv(FILE *in) {
+    const char *fields[3];
+    size_t lens[3], size = 0;
+    char *line = NULL;
+    ssize_t len;
+    int lineno = 0;
+
+    while (terminating == -1 && (len = getline(&line, &size, in)) != -1) {
+        lineno++;
+        if (len > 0 && line[len - 1] == '\n') {
+            len--;
+        }
+        switch (split_line(line, len, fields, lens)) {
+            case 1:
+                import_user(fields[0], lens[0], fields[1], lens[1], fields[2], lens[2]);
+                break;
+            case -1:
+                free(line);
+                errno = 0;
+                error_exit("Malformed input data in line %d.", lineno);
+        }
+    }
+    free(line);
+}
+
+static void import_snapshot(const char *path) {
+    struct store store;
+    struct entry *ptr;
+    size_t cursor = 0;
+
+    if (snapshot_verify(path) == -1 || store_init(&store) == -1) {
+        if (errno == EINVAL) {
+            errno = 0;
+            error_exit("Corrupt or incompatible snapshot.");
+        }
+        error_exit("Couldn't read snapshot.");
+    }
+    if (snapshot_load(&store, path) == -1) {
+        store_free(&store);
+        error_exit("Couldn't load snapshot.");
+    }
+    while (terminating == -1 && (ptr = store_next(&store, &cursor)) != NULL) {
+        import_user(ENTRY_USERNAME(ptr), ptr->username_len, ENTRY_PASSWORD(ptr), strlen(ENTRY_PASSWORD(ptr)),
+                    ENTRY_SECRET(ptr), ENTRY_SECRET_LENGTH(ptr));
+    }
+    store_free(&store);
+}
+
+static void run_import(void) {
+    FILE *in = stdin;
+    uint64_t start = now_ns();
+
+    if (strcmp(filename, "-") == 0) {
+        import_csv(stdin);
+    } else {
+        switch (snapshot_probe(filename)) {
+            case 1:
+                import_snapshot(filename);
+                break;
+            case 0:
+                if ((in = fopen(filename, "r")) == NULL) {
+                    error_exit("Couldn't open database.");
+                }
+                import_csv(in);
+                (void) fclose(in);
+                break;
+            default:
+                error_exit("Couldn't open database.");
+        }
+    }
+    for (int i = 0; i < shards && terminating == -1; i++) {
+        flush(&links[i]);
+    }
+    if (terminating != -1) {
+        errno = 0;
+        error_exit("Interrupted after importing %llu users.", (unsigned long long) added);
+    }
+    (void) fprintf(stderr, "Imported %llu users, skipped %llu, in %.3f s.\n", (unsigned long long) added,
+                   (unsigned long long) skipped, (now_ns() - start) / 1e9);
+}
+
+static void run_export(void) {
+    struct message *message;
+    struct shard *link;
+    char *buffer;
+    FILE *out = stdout;
+    ssize_t n;
+    uint64_t users, lines, exported = 0;
+    int fd, flags;
+
+    if (strcmp(filename, "-") != 0 && (out = fopen(filename, "w")) == NULL) {
+        error_exit("Couldn't open the export file.");
+    }
+    if ((buffer = malloc(EXPORT_BUFFER)) == NULL) {
+        error_exit("Failed to allocate the export buffer.");
+    }
+    if (mkdtemp(fifodir) == NULL) {
+        error_exit("Couldn't create a directory for the FIFO.");
+    }
+    (void) snprintf(fifo, sizeof fifo, "%s/export", fifodir);
+    fifo_created = true;
+    if (mkfifo(fifo, 0600) == -1) {
+        error_exit("Couldn't create the FIFO.");
+    }
+    for (long i = 0; i < shards && terminating == -1; i++) {
+        link = select_shard(i);
+        /* the server only writes into a FIFO that has a reader */
+        if ((fd = open(fifo, O_RDONLY | O_NONBLOCK)) == -1) {
+            error_exit("Couldn't open the FIFO.");
+        }
+        message = begin_request(link, EXPORT);
+        (void) slot_put(slot, link->shared->slot_size, &message->secret, fifo, strlen(fifo));
+        if (commit_request(link) != EXPORT_SUCCESS) {
+            (void) close(fd);
+            errno = 0;
+            error_exit("The server rejected the export.");
+        }
+        users = message->total;
+        end_request(link);
+        /* the writer holds the FIFO open until the image is complete */
+        if ((flags = fcntl(fd, F_GETFL)) == -1 || fcntl(fd, F_SETFL, flags & ~O_NONBLOCK) == -1) {
+            error_exit("Couldn't read the FIFO.");
+        }
+        lines = 0;
+        while ((n = read(fd, buffer, EXPORT_BUFFER)) != 0) {
+            if (n == -1) {
+                if (errno == EINTR && terminating == -1) {
+                    continue;
+                }
+                error_exit("Couldn't read the export.");
+            }
+            for (char *c = buffer; (c = memchr(c, '\n', buffer + n - c)) != NULL; c++) {
+                lines++;
+            }
+            if (fwrite(buffer, 1, n, out) != (size_t) n) {
+                error_exit("Couldn't write the export.");
+            }
+        }
+        (void) close(fd);
+        if (lines != users) {
+            errno = 0;
+            error_exit("The export of shard %ld is incomplete, %llu of %llu users.", i,
+                       (unsigned long long) lines, (unsigned long long) users);
+        }
+        exported += users;
+    }
+    free(buffer);
+    if ((out == stdout ? fflush(out) : fclose(out)) == EOF) {
+        error_exit("Couldn't write the export.");
+    }
+    (void) fprintf(stderr, "Exported %llu users.\n", (unsigned long long) exported);
+}
+
+int main(int argc, char **argv) {
+    const int signals[] = {SIGINT, SIGTERM};
+    struct sigaction s;
+
+    progname = argv[0];
+    s.sa_handler = signal_handler;
+    s.sa_flags = 0;
+    if (sigfillset(&s.sa_mask) < 0) {
+        error_exit("sigfillset");
+    }
+    for (int i = 0; i < 2; i++) {
+        if (sigaction(signals[i], &s, NULL) < 0) {
+            error_exit("sigaction");
+        }
+    }
+    for (int i = 0; i < SHARDS_MAX; i++) {
+        links[i].shmfd = -1;
+    }
+    parse_args(argc, argv);
+    if (task == IMPORT) {
+        run_import();
+    } else {
+        run_export();
+    }
+    free_resources();
+    return EXIT_SUCCESS;
+}
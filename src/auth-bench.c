@@ -0,0 +1,656 @@
+/**
+ * @file auth-bench.c
+ * @author Martin Weise <e1429167@student.tuwien.ac.at>
+ * @date 16.10.2026
+ *
+ * @brief End-to-end load generator for the auth-server.
+ * @details Generates a database of N users, starts the auth-server on it and forks M client
+ *          workers that issue a configurable mix of READ, WRITE, LOGIN and REGISTER requests
+ *          for a fixed duration. Reports throughput and latency percentiles per operation.
+ *
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <limits.h>
+#include <errno.h>
+#include <memory.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <libgen.h>
+#include <sys/wait.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "shared.h"
+
+/** @brief Number of operation types. */
+#define OPS 4
+/** @brief Values below this are recorded exactly (in nanoseconds). */
+#define HIST_LINEAR 64
+/** @brief Sub-buckets per power of two above HIST_LINEAR, bounds the relative error to ~3%. */
+#define HIST_SUB 32
+/** @brief Number of histogram buckets, covers the full 64-bit range. */
+#define HIST_BUCKETS (HIST_LINEAR + 58 * HIST_SUB)
+/** @brief Time in seconds to wait for the server to come up. */
+#define STARTUP_TIMEOUT 60
+
+/** @brief The operation types. */
+enum op { OP_READ, OP_WRITE, OP_LOGIN, OP_REGISTER };
+
+/** @brief Measurements of one worker. */
+struct bench_stats {
+    uint64_t count[OPS];
+    uint64_t errors[OPS];
+    uint64_t max[OPS];
+    uint64_t hist[OPS][HIST_BUCKETS];
+};
+
+/** @brief State shared between the benchmark and its workers. */
+struct bench_shared {
+    uint32_t ready;
+    uint32_t go;
+    uint32_t stop;
+    struct bench_stats workers[];
+};
+
+/* === Prototypes === */
+
+/**
+ * @brief Stops the server and workers and removes the temporary files.
+ */
+static void free_resources(void);
+/**
+ * @brief Terminate program on program error.
+ * @param fmt Format string.
+ */
+static void error_exit(const char *fmt, ...);
+/**
+ * @brief Prints a nice usage message.
+ */
+static void usage(void);
+/**
+ * @brief Parses the argument vector.
+ * @param argc The argument counter.
+ * @param argv The argument vector.
+ * @return 0 on success, -1 if the arguments are invalid.
+ */
+static int parse_args(int argc, char **argv);
+/**
+ * @brief Parses a long option argument.
+ * @param arg The argument.
+ * @param min The smallest valid value.
+ * @param value The parsed value.
+ * @return 0 on success, -1 if the argument is invalid.
+ */
+static int parse_long(const char *arg, long min, long *value);
+/**
+ * @brief Sets the stop flag of the benchmark.
+ * @param sig Signal code.
+ */
+static void signal_handler(int sig);
+/**
+ * @brief Maps a latency to its histogram bucket.
+ * @param ns The latency in nanoseconds.
+ * @return The bucket index.
+ */
+static int bucket_of(uint64_t ns);
+/**
+ * @brief Maps a histogram bucket to a representative latency.
+ * @param bucket The bucket index.
+ * @return The midpoint of the bucket in nanoseconds.
+ */
+static uint64_t bucket_value(int bucket);
+/**
+ * @brief Writes the generated database to dbpath.
+ */
+static void generate_database(void);
+/**
+ * @brief Starts the server on the generated database and maps its shared fragment.
+ */
+static void start_server(void);
+/**
+ * @brief Sends one request to the server and waits for the response.
+ * @param cmd The request, is overwritten with the response.
+ * @param username The username of REGISTER and LOGIN.
+ * @param password The password of REGISTER and LOGIN.
+ * @param secret The secret of WRITE.
+ * @return 0 on success, -1 if the server quit.
+ */
+static int request(struct message *cmd, const char *username, const char *password, const char *secret);
+/**
+ * @brief Runs the load of one client worker until the benchmark stops.
+ * @param id The index of the worker, determines its user.
+ */
+static void worker(int id);
+/**
+ * @brief Computes a percentile of a histogram.
+ * @param hist The histogram.
+ * @param count Number of recorded values.
+ * @param p The percentile in [0,1].
+ * @return The latency in nanoseconds.
+ */
+static uint64_t percentile(const uint64_t *hist, uint64_t count, double p);
+/**
+ * @brief Merges the worker measurements and prints the report.
+ * @param elapsed The duration of the measurement in nanoseconds.
+ * @return The number of failed requests.
+ */
+static uint64_t report(uint64_t elapsed);
+/**
+ * @brief The program entry point.
+ * @param argc The argument counter.
+ * @param argv The argument vector.
+ * @return EXIT_SUCCESS if no request failed, EXIT_FAILURE otherwise.
+ */
+int main(int argc, char **argv);
+
+/* === Global Variables === */
+
+/** @brief Holds the program name. */
+static char *progname;
+/** @brief Names of the operation types. */
+static const char *op_names[OPS] = { "read", "write", "login", "register" };
+/** @brief Number of users in the generated database. @details Set by -n. */
+static long nusers = 1000;
+/** @brief Number of client workers. @details Set by -c. */
+static long nclients = 4;
+/** @brief Duration of the measurement in seconds. @details Set by -d. */
+static long duration = 5;
+/** @brief Number of server threads. @details Set by -t. */
+static long nthreads = 1;
+/** @brief Relative weights of the operation types. @details Set by -m read:write:login:register. */
+static long mix[OPS] = { 70, 20, 5, 5 };
+/** @brief Sync policy of the server journal, NULL runs the server without journal. @details Set by -f. */
+static char *sync_policy = NULL;
+/** @brief PBKDF2 iterations of the server, NULL keeps its default. @details Set by -i. */
+static char *iterations = NULL;
+/** @brief Sum of the weights in mix. */
+static long mix_total = 100;
+/** @brief Path of the auth-server binary, next to auth-bench. */
+static char server_path[PATH_MAX];
+/** @brief Temporary directory holding the database, also the working directory of the server. */
+static char tmpdir[] = "/tmp/auth-bench.XXXXXX";
+/** @brief Path of the generated database. */
+static char dbpath[sizeof tmpdir + 32];
+/** @brief Process id of the server. */
+static pid_t server = -1;
+/** @brief Process ids of the workers. */
+static pid_t *workers = NULL;
+/** @brief The shared fragment of the server. */
+static struct shared_fragment *shared = NULL;
+/** @brief Size of the mapping of the shared fragment in bytes. */
+static size_t shared_size;
+/** @brief Measurements, shared with the workers. */
+static struct bench_shared *bench = NULL;
+/** @brief Size of the bench mapping. */
+static size_t bench_size;
+/** @brief Set on SIGINT and SIGTERM. */
+static volatile sig_atomic_t terminating = 0;
+
+/* === Implementations === */
+
+static void usage(void) {
+    (void) fprintf(stderr, "USAGE: %s [-n users] [-c clients] [-d seconds] [-t server_threads]\n"
+                           "       [-m read:write:login:register] [-f always|never|sync_ms]\n"
+                           "       [-i server_iterations]\n", progname);
+    exit(EXIT_FAILURE);
+}
+
+static int parse_long(const char *arg, long min, long *value) {
+    char *end;
+
+    errno = 0;
+    *value = strtol(arg, &end, 10);
+    if (errno != 0 || end == arg || *end != '\0' || *value < min) {
+        errno = 0;
+        return -1;
+    }
+    return 0;
+}
+
+static int parse_args(int argc, char **argv) {
+    char opt;
+    char *field;
+
+    while ((opt = getopt(argc, argv, "n:c:d:t:m:f:i:")) != -1) {
+        switch (opt) {
+            case 'n':
+                if (parse_long(optarg, 1, &nusers) == -1) {
+                    return -1;
+                }
+                break;
+            case 'c':
+                if (parse_long(optarg, 1, &nclients) == -1) {
+                    return -1;
+                }
+                break;
+            case 'd':
+                if (parse_long(optarg, 1, &duration) == -1) {
+                    return -1;
+                }
+                break;
+            case 't':
+                if (parse_long(optarg, 1, &nthreads) == -1) {
+                    return -1;
+                }
+                break;
+            case 'm':
+                mix_total = 0;
+                field = strtok(optarg, ":");
+                for (int i = 0; i < OPS; i++) {
+                    if (field == NULL || parse_long(field, 0, &mix[i]) == -1) {
+                        return -1;
+                    }
+                    mix_total += mix[i];
+                    field = strtok(NULL, ":");
+                }
+                if (field != NULL || mix_total == 0) {
+                    return -1;
+                }
+                break;
+            case 'f':
+                sync_policy = optarg;
+                break;
+            case 'i':
+                iterations = optarg;
+                break;
+            default:
+                return -1;
+        }
+    }
+    /* every worker logs in as its own user */
+    if (optind != argc || nclients > nusers) {
+        return -1;
+    }
+    return 0;
+}
+
+static void signal_handler(int sig) {
+    terminating = 1;
+}
+
+static int bucket_of(uint64_t ns) {
+    int shift;
+
+    if (ns < HIST_LINEAR) {
+        return ns;
+    }
+    /* keep the five bits below the most significant one */
+    shift = 63 - __builtin_clzll(ns) - 5;
+    return HIST_LINEAR + (shift - 1) * HIST_SUB + (int) ((ns >> shift) - HIST_SUB);
+}
+
+static uint64_t bucket_value(int bucket) {
+    int shift;
+    uint64_t sub;
+
+    if (bucket < HIST_LINEAR) {
+        return bucket;
+    }
+    shift = (bucket - HIST_LINEAR) / HIST_SUB + 1;
+    sub = (bucket - HIST_LINEAR) % HIST_SUB + HIST_SUB;
+    return (sub << shift) + ((uint64_t) 1 << (shift - 1));
+}
+
+static void generate_database(void) {
+    FILE *db;
+
+    if (mkdtemp(tmpdir) == NULL) {
+        error_exit("Couldn't create temporary directory.");
+    }
+    (void) snprintf(dbpath, sizeof dbpath, "%s/bench.csv", tmpdir);
+    if ((db = fopen(dbpath, "w")) == NULL) {
+        error_exit("Couldn't create database.");
+    }
+    for (long i = 0; i < nusers; i++) {
+        (void) fprintf(db, "user%ld;pw%ld;secret%ld\n", i, i, i);
+    }
+    if (fclose(db) == EOF) {
+        error_exit("Couldn't write database.");
+    }
+}
+
+static void start_server(void) {
+    char threads[32], *args[16];
+    int shmfd, status, devnull, n = 0;
+    uint64_t deadline;
+
+    /* a running server would answer in place of ours */
+    if ((shmfd = shm_open(SHM_NAME, O_RDWR, PERMISSION)) != -1) {
+        (void) close(shmfd);
+        error_exit("Another server is running.");
+    }
+    (void) snprintf(threads, sizeof threads, "%ld", nthreads);
+    if ((server = fork()) == -1) {
+        error_exit("fork");
+    }
+    if (server == 0) {
+        /* the server saves its database to the working directory on exit */
+        if (chdir(tmpdir) == -1 || (devnull = open("/dev/null", O_WRONLY)) == -1 ||
+            dup2(devnull, STDOUT_FILENO) == -1 || dup2(devnull, STDERR_FILENO) == -1) {
+            _exit(EXIT_FAILURE);
+        }
+        args[n++] = "auth-server";
+        args[n++] = "-l";
+        args[n++] = dbpath;
+        args[n++] = "-t";
+        args[n++] = threads;
+        if (sync_policy != NULL) {
+            args[n++] = "-j";
+            args[n++] = "auth-server.journal";
+            args[n++] = "-f";
+            args[n++] = sync_policy;
+        }
+        if (iterations != NULL) {
+            args[n++] = "-i";
+            args[n++] = iterations;
+        }
+        args[n] = NULL;
+        (void) execv(server_path, args);
+        _exit(EXIT_FAILURE);
+    }
+    deadline = now_ns() + (uint64_t) STARTUP_TIMEOUT * 1000000000;
+    while (shared == NULL || shared->server_down != -1) {
+        if (waitpid(server, &status, WNOHANG) == server) {
+            server = -1;
+            error_exit("Server exited during startup.");
+        }
+        if (terminating || now_ns() > deadline) {
+            error_exit("Server did not start.");
+        }
+        if (shared == NULL && (shmfd = shm_open(SHM_NAME, O_RDWR, PERMISSION)) != -1) {
+            /* the server maps the fragment only after resizing it */
+            shared = fragment_attach(shmfd, &shared_size);
+            (void) close(shmfd);
+        }
+        (void) usleep(10000);
+    }
+    errno = 0;
+}
+
+static int request(struct message *cmd, const char *username, const char *password, const char *secret) {
+    struct slot *slot;
+    int ret;
+
+    if ((slot = slot_acquire(shared)) == NULL) {
+        return -1;
+    }
+    slot_begin(slot, 1);
+    slot->messages[0] = *cmd;
+    if (cmd->command == COMMAND_NONE) {
+        (void) slot_put(slot, shared->slot_size, &slot->messages[0].username, username, strlen(username));
+        (void) slot_put(slot, shared->slot_size, &slot->messages[0].password, password, strlen(password));
+    } else if (cmd->command == WRITE) {
+        (void) slot_put(slot, shared->slot_size, &slot->messages[0].secret, secret, strlen(secret));
+    }
+    ret = slot_submit(shared, slot);
+    *cmd = slot->messages[0];
+    (void) slot_release(shared, slot);
+    return ret;
+}
+
+static void worker(int id) {
+    struct bench_stats *stats = &bench->workers[id];
+    struct message login, cmd;
+    char username[MAX_DATA], password[MAX_DATA], name[MAX_DATA], secret[MAX_DATA];
+    unsigned int seed = id + 1;
+    uint64_t start, ns, registered = 0;
+    status expected;
+    long pick;
+    int op;
+
+    (void) memset(&login, 0, sizeof login);
+    login.modus = LOGIN;
+    login.command = COMMAND_NONE;
+    (void) snprintf(username, MAX_DATA, "user%d", id);
+    (void) snprintf(password, MAX_DATA, "pw%d", id);
+    cmd = login;
+    if (request(&cmd, username, password, NULL) == -1 || cmd.status != LOGIN_SUCCESS) {
+        _exit(EXIT_FAILURE);
+    }
+    (void) memcpy(login.session_id, cmd.session_id, SIZE_SESS_ID);
+    (void) __atomic_add_fetch(&bench->ready, 1, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&bench->go, __ATOMIC_ACQUIRE) == 0) {
+        (void) usleep(1000);
+    }
+
+    while (__atomic_load_n(&bench->stop, __ATOMIC_RELAXED) == 0) {
+        pick = rand_r(&seed) % mix_total;
+        for (op = 0; pick >= mix[op]; op++) {
+            pick -= mix[op];
+        }
+        cmd = login;
+        switch (op) {
+            case OP_READ:
+                cmd.command = READ;
+                expected = LOGIN_SUCCESS;
+                break;
+            case OP_WRITE:
+                cmd.command = WRITE;
+                (void) snprintf(secret, MAX_DATA, "bench%d", rand_r(&seed));
+                expected = WRITE_SECRET_SUCCESS;
+                break;
+            case OP_LOGIN:
+                expected = LOGIN_SUCCESS;
+                break;
+            default:
+                cmd.modus = REGISTER;
+                (void) snprintf(name, MAX_DATA, "bench%d-%llu", id, (unsigned long long) registered++);
+                expected = REGISTER_SUCCESS;
+                break;
+        }
+        start = now_ns();
+        if (request(&cmd, op == OP_REGISTER ? name : username, password, secret) == -1) {
+            stats->errors[op]++;
+            break;
+        }
+        ns = now_ns() - start;
+        stats->count[op]++;
+        stats->hist[op][bucket_of(ns)]++;
+        if (ns > stats->max[op]) {
+            stats->max[op] = ns;
+        }
+        if (cmd.status != expected) {
+            stats->errors[op]++;
+        } else if (op == OP_LOGIN) {
+            /* the new login replaced the old session */
+            (void) memcpy(login.session_id, cmd.session_id, SIZE_SESS_ID);
+        }
+    }
+    _exit(EXIT_SUCCESS);
+}
+
+static uint64_t percentile(const uint64_t *hist, uint64_t count, double p) {
+    uint64_t rank = (uint64_t) (p * count), seen = 0;
+
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += hist[i];
+        if (seen > rank) {
+            return bucket_value(i);
+        }
+    }
+    return 0;
+}
+
+static uint64_t report(uint64_t elapsed) {
+    static uint64_t hist[OPS + 1][HIST_BUCKETS];
+    uint64_t count[OPS + 1] = { 0 }, errors[OPS + 1] = { 0 }, max[OPS + 1] = { 0 };
+    struct bench_stats *stats;
+    double secs = elapsed / 1e9;
+
+    for (long w = 0; w < nclients; w++) {
+        stats = &bench->workers[w];
+        for (int op = 0; op < OPS; op++) {
+            count[op] += stats->count[op];
+            errors[op] += stats->errors[op];
+            max[op] = stats->max[op] > max[op] ? stats->max[op] : max[op];
+            for (int i = 0; i < HIST_BUCKETS; i++) {
+                hist[op][i] += stats->hist[op][i];
+                hist[OPS][i] += stats->hist[op][i];
+            }
+        }
+    }
+    for (int op = 0; op < OPS; op++) {
+        count[OPS] += count[op];
+        errors[OPS] += errors[op];
+        max[OPS] = max[op] > max[OPS] ? max[op] : max[OPS];
+    }
+
+    (void) printf("%s: %ld users, %ld clients, %ld server threads, %.2f s, "
+                  "mix read:write:login:register %ld:%ld:%ld:%ld\n", progname, nusers, nclients,
+                  nthreads, secs, mix[OP_READ], mix[OP_WRITE], mix[OP_LOGIN], mix[OP_REGISTER]);
+    (void) printf("%-9s %10s %10s %9s %9s %9s %9s %7s\n", "op", "count", "ops/s",
+                  "p50(us)", "p99(us)", "p999(us)", "max(us)", "errors");
+    for (int op = 0; op <= OPS; op++) {
+        if (op < OPS && count[op] == 0) {
+            continue;
+        }
+        (void) printf("%-9s %10llu %10.0f %9.1f %9.1f %9.1f %9.1f %7llu\n",
+                      op < OPS ? op_names[op] : "total", (unsigned long long) count[op],
+                      count[op] / secs, percentile(hist[op], count[op], 0.5) / 1e3,
+                      percentile(hist[op], count[op], 0.99) / 1e3,
+                      percentile(hist[op], count[op], 0.999) / 1e3, max[op] / 1e3,
+                      (unsigned long long) errors[op]);
+    }
+    return errors[OPS];
+}
+
+static void free_resources(void) {
+    int status;
+
+    if (workers != NULL) {
+        for (long w = 0; w < nclients; w++) {
+            if (workers[w] > 0) {
+                (void) kill(workers[w], SIGKILL);
+                (void) waitpid(workers[w], &status, 0);
+            }
+        }
+        free(workers);
+        workers = NULL;
+    }
+    if (server > 0) {
+        (void) kill(server, SIGTERM);
+        (void) waitpid(server, &status, 0);
+        server = -1;
+    }
+    if (shared != NULL) {
+        (void) munmap(shared, shared_size);
+        shared = NULL;
+    }
+    if (bench != NULL) {
+        (void) munmap(bench, bench_size);
+        bench = NULL;
+    }
+    if (dbpath[0] != '\0') {
+        (void) unlink(dbpath);
+        (void) snprintf(dbpath, sizeof dbpath, "%s/auth-server.db.csv", tmpdir);
+        (void) unlink(dbpath);
+        (void) snprintf(dbpath, sizeof dbpath, "%s/auth-server.db.snap", tmpdir);
+        (void) unlink(dbpath);
+        (void) snprintf(dbpath, sizeof dbpath, "%s/auth-server.journal", tmpdir);
+        (void) unlink(dbpath);
+        (void) rmdir(tmpdir);
+        dbpath[0] = '\0';
+    }
+}
+
+static void error_exit(const char *fmt, ...) {
+    va_list ap;
+
+    (void) fprintf(stderr, "%s: ", progname);
+    if (fmt != NULL) {
+        va_start(ap, fmt);
+        (void) vfprintf(stderr, fmt, ap);
+        va_end(ap);
+    }
+    if (errno != 0) {
+        (void) fprintf(stderr, ": %s", strerror(errno));
+    }
+    (void) fprintf(stderr, "\n");
+    free_resources();
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv) {
+    const int signals[] = {SIGINT, SIGTERM};
+    struct sigaction s;
+    struct timespec tick = { 0, 10000000 };
+    char self[PATH_MAX];
+    uint64_t start, elapsed, failed;
+    int status;
+
+    progname = argv[0];
+    if (parse_args(argc, argv) == -1) {
+        usage();
+    }
+    s.sa_handler = signal_handler;
+    s.sa_flags = 0;
+    if (sigfillset(&s.sa_mask) < 0) {
+        error_exit("sigfillset");
+    }
+    for (int i = 0; i < 2; i++) {
+        if (sigaction(signals[i], &s, NULL) < 0) {
+            error_exit("sigaction");
+        }
+    }
+    /* the server binary lives next to auth-bench */
+    if (realpath(argv[0], self) == NULL) {
+        error_exit("realpath");
+    }
+    (void) snprintf(server_path, sizeof server_path, "%s/auth-server", dirname(self));
+
+    bench_size = sizeof *bench + nclients * sizeof bench->workers[0];
+    if ((bench = mmap(NULL, bench_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+                      -1, 0)) == MAP_FAILED) {
+        bench = NULL;
+        error_exit("Couldn't map the measurements.");
+    }
+    if ((workers = calloc(nclients, sizeof *workers)) == NULL) {
+        error_exit("calloc");
+    }
+    generate_database();
+    start_server();
+
+    for (long w = 0; w < nclients; w++) {
+        if ((workers[w] = fork()) == -1) {
+            error_exit("fork");
+        }
+        if (workers[w] == 0) {
+            worker(w);
+        }
+    }
+    /* exclude the logins of the workers from the measurement */
+    while (__atomic_load_n(&bench->ready, __ATOMIC_SEQ_CST) < nclients) {
+        for (long w = 0; w < nclients; w++) {
+            if (waitpid(workers[w], &status, WNOHANG) == workers[w]) {
+                workers[w] = -1;
+                error_exit("Worker %ld failed to log in.", w);
+            }
+        }
+        if (terminating) {
+            error_exit("Interrupted.");
+        }
+        (void) nanosleep(&tick, NULL);
+    }
+    start = now_ns();
+    __atomic_store_n(&bench->go, 1, __ATOMIC_RELEASE);
+    while (!terminating && now_ns() - start < (uint64_t) duration * 1000000000) {
+        (void) nanosleep(&tick, NULL);
+    }
+    __atomic_store_n(&bench->stop, 1, __ATOMIC_RELEASE);
+    elapsed = now_ns() - start;
+    for (long w = 0; w < nclients; w++) {
+        (void) waitpid(workers[w], &status, 0);
+        workers[w] = -1;
+    }
+
+    failed = report(elapsed);
+    free_resources();
+    return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -20,40 +20,31 @@
 #include <stdarg.h>
 #include <assert.h>
 #include <fcntl.h>
-#include <semaphore.h>
 #include <stdbool.h>
 #include <sys/time.h>
 #include "shared.h"
+#include "authclient.h"
 
 /* === Global Variables === */
 
 /** @brief Used to terminate the client only once. */
 volatile sig_atomic_t terminating = -1;
-/** @brief Semaphor to allow client the initial request. @details Is a binary semaphor. */
-extern sem_t *sem1;
-/** @brief Semaphor to allow client further commands when logged in. @details Is a binary semaphor. */
-extern sem_t *sem2;
-/** @brief Semaphor to sync waiting for response from server. @details Is a binary semaphor. */
-extern sem_t *sem3;
 /** @brief Holds the program name. */
 static char *progname;
 /** @brief Holds the username for logged-in requests. */
 static char *username;
 /** @brief Holds the password for logged-in requests. */
 static char *password;
-/** @brief Holds the session id for logged-in requests. */
-static char session_id[MAX_DATA];
-/** @brief Holds the secret, once set */
-static char secret[MAX_DATA];
-/** @brief The shared memory file descriptor */
-static int shmfd;
-/** @brief Flag for releasing the used semaphores in case of a client crash
- * @details -1 = no semaphor used, 1 = semaphor 2 used. */
-static int server_waits = -1;
-/** @brief The shared command that is sent between server and client */
-static struct shared_command *shared;
+/** @brief The connection to the server, or to the shards. */
+static struct authclient client;
+/** @brief Number of shards the users are spread over. @details Set by -k. */
+static long shards = 1;
 /** @brief The mode in which the client operates in. @details Is determined by the argument vector. */
 static int m = -1;
+/** @brief Holds the name of the batch file. @details Is set by -b, "-" denotes stdin. */
+static char *batchfile = NULL;
+/** @brief Name of the script file executed after login, "-" for stdin. */
+static char *scriptfile = NULL;
 
 /* === Prototypes === */
 
@@ -83,6 +74,47 @@ static void parse_args(int argc, char **argv);
  * @param sig Signal code.
  */
 static void signal_handler(int sig);
+/**
+ * @brief Terminates the client if a call of the client library failed.
+ * @param code The status code returned by the call.
+ * @return The status code.
+ */
+static status check(status code);
+/**
+ * @brief Prints the result line of a batch command.
+ * @param op The command and its outcome.
+ * @return 1 if the command failed, 0 otherwise.
+ */
+static int print_result(const struct authclient_op *op);
+/**
+ * @brief Parses a line of a batch file.
+ * @details Known commands are "register username password", "login username password",
+ *          "write secret", "read" and "logout".
+ * @param line The line, the command keeps pointers into it.
+ * @param op The command to fill in.
+ * @return 0 on success, 1 if the line is empty, -1 if the line is invalid.
+ */
+static int parse_op(char *line, struct authclient_op *op);
+/**
+ * @brief Submits a batch of commands and prints one result line per command.
+ * @param ops The commands.
+ * @param count Number of commands.
+ * @return Number of failed commands.
+ */
+static int submit_batch(struct authclient_op *ops, int count);
+/**
+ * @brief Executes all commands of the batch file, BATCH_MAX commands per round trip.
+ * @details Terminates the client with EXIT_SUCCESS if all commands succeeded.
+ */
+static void run_batch(void);
+/**
+ * @brief Executes the commands of the script file over the current login session.
+ * @details Accepts "write secret", "read" and "logout", one round trip per line, and
+ *          prints one result line per command as soon as it completes. Stops after
+ *          "logout"; at the end of the script the session is logged out implicitly.
+ *          Terminates the client with EXIT_SUCCESS if all commands succeeded.
+ */
+static void run_script(void);
 /**
  * @brief The program entry point.
  * @param argc The argument vector.
@@ -94,7 +126,9 @@ int main(int argc, char **argv);
 /* === Implementations === */
 
 static void usage() {
-    (void) fprintf (stderr, "USAGE: %s { -r | -l } username password\n", progname);
+    (void) fprintf (stderr, "USAGE: %s [-k shards] { -r | -l } username password\n"
+                            "       %s [-k shards] -l username password -s script\n"
+                            "       %s [-k shards] -b batchfile\n", progname, progname, progname);
     exit(EXIT_FAILURE);
 }
 
@@ -102,8 +136,26 @@ static void parse_args(int argc, char **argv) {
     int flag_l = -1;
     int flag_r = -1;
     int flag_d = -1;
-    char opt;
+    char opt, *end;
     progname = argv[0];
+    if (argc >= 3 && strcmp(argv[1], "-k") == 0) {
+        shards = strtol(argv[2], &end, 10);
+        if (*end != '\0' || shards < 1 || shards > SHARDS_MAX) {
+            usage();
+        }
+        /* the remaining arguments are parsed as if -k was not given */
+        argv[2] = argv[0];
+        argv += 2;
+        argc -= 2;
+    }
+    if (argc == 3 && strcmp(argv[1], "-b") == 0) {
+        batchfile = argv[2];
+        return;
+    }
+    if (argc == 6 && strcmp(argv[1], "-l") == 0 && strcmp(argv[4], "-s") == 0) {
+        scriptfile = argv[5];
+        argc = 4;
+    }
     if (argc != 4 || optind != 1) {
         usage();
     }
@@ -128,7 +180,7 @@ static void parse_args(int argc, char **argv) {
                 break;
         }
     }
-    if ((flag_l == 1) ^ (flag_r == 1)) {
+    if (((flag_l == 1) ^ (flag_r == 1)) && strlen(argv[2]) < MAX_DATA && strlen(argv[3]) < MAX_DATA) {
         username = argv[2];
         password = argv[3];
         return;
@@ -160,38 +212,182 @@ static void free_resources(void) {
         return;
     }
     terminating = 1;
-    /* Tell server the client is done */
-    if (server_waits != -1) {
-        shared->command = COMMAND_NONE;
-        shared->modus = MODE_UNSET;
-        if (sem_post(sem2) == -1) {
+    /* Give a claimed slot back and unmap the shared memory */
+    authclient_close(&client);
+}
+
+static void signal_handler(int sig) {
+    terminating = 1;
+}
+
+static status check(status code) {
+    if (code != STATUS_NONE) {
+        return code;
+    }
+    switch (errno) {
+        case EMSGSIZE:
+            errno = 0;
+            error_exit("Command does not fit into a slot.");
+            break;
+        case EPIPE:
+            errno = 0;
             error_exit("Server quit.");
-        }
+            break;
+        default:
+            error_exit("Couldn't access the shared fragment. Is the server running?");
+    }
+    return code;
+}
+
+static int print_result(const struct authclient_op *op) {
+    static const char *names[] = { "login", "write", "read", "logout" };
+
+    (void) printf("%s %s", op->modus == REGISTER ? "register" : names[op->command], status_name(op->status));
+    if (op->status == LOGIN_SUCCESS && op->command == READ) {
+        (void) printf(" %s", op->result != NULL ? op->result : "");
+    }
+    (void) printf("\n");
+    switch (op->status) {
+        case LOGIN_SUCCESS:
+        case REGISTER_SUCCESS:
+        case WRITE_SECRET_SUCCESS:
+        case LOGOUT_SUCCESS:
+            return 0;
+        default:
+            return 1;
+    }
+}
+
+static int parse_op(char *line, struct authclient_op *op) {
+    char *word;
+    size_t len = strlen(line);
+
+    if (len > 0 && line[len - 1] == '\n') {
+        line[--len] = '\0';
+    }
+    (void) memset(op, 0, sizeof *op);
+    if ((word = strtok(line, " ")) == NULL) {
+        return 1;
     }
-    /* Close shared memory */
-    if (shmfd != -1) {
-        if (close (shmfd) == -1) {
-            error_exit("Couldn't close shared memory.");
+    if (strcmp(word, "register") == 0 || strcmp(word, "login") == 0) {
+        op->modus = word[0] == 'r' ? REGISTER : LOGIN;
+        op->command = COMMAND_NONE;
+        if ((op->username = strtok(NULL, " ")) == NULL || strlen(op->username) >= MAX_DATA) {
+            return -1;
         }
+        if ((op->password = strtok(NULL, " ")) == NULL || strlen(op->password) >= MAX_DATA
+            || strtok(NULL, " ") != NULL) {
+            return -1;
+        }
+        return 0;
+    }
+    op->modus = LOGIN;
+    if (strcmp(word, "write") == 0) {
+        op->command = WRITE;
+        /* the secret is the rest of the line, spaces included */
+        op->secret = word + strlen(word) < line + len ? word + strlen(word) + 1 : "";
+        return 0;
     }
-    /* Unmap the shared memory */
-    if (munmap(shared, sizeof *shared) == -1) {
-        error_exit("Couldn't unmap shared memory.");
+    if (strtok(NULL, " ") != NULL) {
+        return -1;
     }
-    /* Close semaphor */
-    if (sem_close(sem1) == -1) {
-        error_exit("Couldn't remove semaphor 1.");
+    if (strcmp(word, "read") == 0) {
+        op->command = READ;
+    } else if (strcmp(word, "logout") == 0) {
+        op->command = LOGOUT;
+    } else {
+        return -1;
     }
-    if (sem_close(sem2) == -1) {
-        error_exit("Couldn't remove semaphor 2.");
+    return 0;
+}
+
+static int submit_batch(struct authclient_op *ops, int count) {
+    int failed = 0;
+
+    if (authclient_submit(&client, ops, count) == -1) {
+        (void) check(STATUS_NONE);
     }
-    if (sem_close(sem3) == -1) {
-        error_exit("Couldn't remove semaphor 3.");
+    for (int i = 0; i < count; i++) {
+        failed += print_result(&ops[i]);
+        free(ops[i].result);
     }
+    return failed;
 }
 
-static void signal_handler(int sig) {
-    terminating = 1;
+static void run_batch(void) {
+    struct authclient_op ops[BATCH_MAX];
+    /* every command of a round trip keeps its line, secrets have no length limit */
+    char *lines[BATCH_MAX] = { NULL };
+    size_t sizes[BATCH_MAX] = { 0 };
+    FILE *in = stdin;
+    int count, lineno = 0, failed = 0;
+    bool eof = false;
+
+    if (strcmp(batchfile, "-") != 0 && (in = fopen(batchfile, "r")) == NULL) {
+        error_exit("Couldn't open batch file.");
+    }
+    while (!eof && terminating == -1) {
+        /* collect up to BATCH_MAX commands for one round trip */
+        for (count = 0; count < BATCH_MAX; ) {
+            if (getline(&lines[count], &sizes[count], in) == -1) {
+                eof = true;
+                break;
+            }
+            lineno++;
+            switch (parse_op(lines[count], &ops[count])) {
+                case 0:
+                    count++;
+                    break;
+                case 1:
+                    break;
+                default:
+                    error_exit("Invalid command in line %d of the batch file.", lineno);
+            }
+        }
+        if (count > 0) {
+            failed += submit_batch(ops, count);
+        }
+    }
+    for (int i = 0; i < BATCH_MAX; i++) {
+        free(lines[i]);
+    }
+    (void) fflush(stdout);
+    exit(failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+static void run_script(void) {
+    struct authclient_op op;
+    char *line = NULL;
+    size_t size = 0;
+    FILE *in = stdin;
+    int lineno = 0, failed = 0;
+    bool logged_out = false;
+
+    if (strcmp(scriptfile, "-") != 0 && (in = fopen(scriptfile, "r")) == NULL) {
+        error_exit("Couldn't open script file.");
+    }
+    while (!logged_out && terminating == -1 && getline(&line, &size, in) != -1) {
+        lineno++;
+        switch (parse_op(line, &op)) {
+            case 0:
+                break;
+            case 1:
+                continue;
+            default:
+                error_exit("Invalid command in line %d of the script.", lineno);
+        }
+        if (op.modus != LOGIN || op.command == COMMAND_NONE) {
+            error_exit("Invalid command in line %d of the script.", lineno);
+        }
+        failed += submit_batch(&op, 1);
+        (void) fflush(stdout);
+        logged_out = op.command == LOGOUT;
+    }
+    free(line);
+    if (!logged_out) {
+        (void) check(authclient_logout(&client));
+    }
+    exit(failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
 }
 
 int main(int argc, char **argv) {
@@ -200,8 +396,6 @@ int main(int argc, char **argv) {
     sigset_t blocked_signals;
     status response;
 
-    session_id[0] = 0;
-    secret[0] = 0;
     progname = argv[0];
     /* Fill set with all signals */
     if(sigfillset(&blocked_signals) < 0) {
@@ -218,54 +412,18 @@ int main(int argc, char **argv) {
     }
 
     parse_args(argc, argv);
-
-    /* Open shared memory object SHM_NAME in for reading and writing,
-     * create it if it does not exist */
-    if ((shmfd = shm_open(SHM_NAME, O_RDWR, PERMISSION)) == -1) {
-        error_exit("Couldn't access shared fragement. Is the server running?");
-    }
-    /* Create a new mapping, let the kernel choose the address at which to create the memory  */
-    if ((shared = mmap(NULL, sizeof *shared, PROT_READ | PROT_WRITE, MAP_SHARED, shmfd, 0)) == MAP_FAILED) {
-        error_exit("Couldn't create mapping.");
-    }
-    /* Create Semaphores */
-    if ((sem1 = sem_open(SEM1_NAME, O_EXCL, PERMISSION, 1)) == SEM_FAILED) {
-        error_exit("Couldn't create semaphore 1.");
-    }
-    if ((sem2 = sem_open(SEM2_NAME, O_EXCL, PERMISSION, 0)) == SEM_FAILED) {
-        error_exit("Couldn't create semaphore 2.");
-    }
-    if ((sem3 = sem_open(SEM3_NAME, O_EXCL, PERMISSION, 0)) == SEM_FAILED) {
-        error_exit("Couldn't create semaphore 3.");
-    }
-
+    /* the shards are attached as the commands need them */
+    (void) authclient_open(&client, shards);
     DEBUG("Client running ...\n");
 
-    /* wait for server to allow client to send request */
-    while (shared->server_down != -1 || sem_wait(sem1) == -1) {
-        error_exit("Server quit.");
+    if (batchfile != NULL) {
+        run_batch();
     }
-    server_waits = 1;
-    (void) strncpy(shared->username, username, MAX_DATA);
-    (void) strncpy(shared->password, password, MAX_DATA);
-    shared->command = COMMAND_NONE;
 
     switch (m) {
         case REGISTER:
-            shared->modus = REGISTER;
-            /* tell server to continue */
-            if (sem_post(sem2) == -1) {
-                error_exit("Server quit.");
-            }
-            if (sem_post(sem1) == -1) {
-                error_exit("Server quit.");
-            }
-            server_waits = -1;
-            /* wait for response */
-            while (shared->server_down != -1 || sem_wait(sem3) == -1) {
-                error_exit("Server quit");
-            }
-            switch (shared->status) {
+            response = check(authclient_register(&client, username, password));
+            switch (response) {
                 case REGISTER_SUCCESS:
                     printf("Successfully registered a new user.\n");
                     exit (EXIT_SUCCESS);
@@ -276,74 +434,41 @@ int main(int argc, char **argv) {
                 default:
                     error_exit("Unexpected status code while REGISTER:\n");
             }
-            /* tell server to wait for a new request */
             break;
         case LOGIN:
-            shared->modus = LOGIN;
-            /* tell server to continue */
-            if (sem_post(sem2) == -1) {
-                error_exit("Server quit.");
-            }
-            if (sem_post(sem1) == -1) {
-                error_exit("Server quit.");
-            }
-            server_waits = -1;
-            /* wait for response */
-            while (shared->server_down != -1 || sem_wait(sem3) == -1) {
-                error_exit("Server quit.");
+            response = check(authclient_login(&client, username, password));
+            if (scriptfile != NULL) {
+                (void) printf("login %s\n", status_name(response));
+                if (response != LOGIN_SUCCESS) {
+                    exit(EXIT_FAILURE);
+                }
+                run_script();
             }
-            response = shared->status;
             switch (response) {
                 case LOGIN_SUCCESS:
-                    strncpy(session_id, shared->session_id, MAX_DATA);
                     while (terminating == -1) {
                         printf("Commands:\n  1) write secret\n  2) read secret\n  3) logout\nPlease select a command (1-3):\n");
                         char buffer[MAX_DATA];
                         if (fgets(buffer, sizeof buffer, stdin) == NULL) {
                             error_exit("fgets");
                         }
-                        if (shared->server_down != -1) {
-                            error_exit("Server quit.");
-                        }
                         cmd command = (int) strtol(buffer, (char **)NULL, 10);
+                        char *line = NULL, *secret;
+                        size_t size = 0;
+                        ssize_t len;
                         /* now switch between the commands */
                         switch (command) {
                             case WRITE:
                                 DEBUG("Command is WRITE.\n");
-                                char buf[MAX_DATA];
                                 printf("Write secret here, commit with [RETURN]:\n");
-                                if (fgets(buf, sizeof buf, stdin) == NULL) {
+                                if ((len = getline(&line, &size, stdin)) == -1) {
                                     error_exit("fgets secret");
                                 }
-                                int len = strlen(buf);
-                                if (buf[len - 1] == '\n') {
-                                    buf[len - 1] = '\0';
-                                }
-                                /* wait for server to allow client to send request */
-                                while (shared->server_down != -1 || sem_wait(sem1) == -1) {
-                                    error_exit("Server quit.");
-                                }
-                                server_waits = 1;
-                                shared->modus = LOGIN;
-                                shared->command = WRITE;
-                                (void) strncpy(shared->secret, buf, MAX_DATA);
-                                (void) strncpy(shared->username, username, MAX_DATA);
-                                (void) strncpy(shared->password, password, MAX_DATA);
-                                (void) strncpy(shared->session_id, session_id, MAX_DATA);
-                                /* tell server to continue */
-                                if (sem_post(sem2) == -1) {
-                                    error_exit("Server quit.");
-                                }
-                                if (sem_post(sem1) == -1) {
-                                    error_exit("Server quit.");
+                                if (len > 0 && line[len - 1] == '\n') {
+                                    line[len - 1] = '\0';
                                 }
-                                server_waits = -1;
-                                /* wait for response */
-                                while (shared->server_down != -1 || sem_wait(sem3) == -1) {
-                                    error_exit("Server quit.");
-                                }
-                                response = shared->status;
-                                /* tell server to wait for a new request */
+                                response = check(authclient_write(&client, line, strlen(line)));
+                                free(line);
                                 switch (response) {
                                     case WRITE_SECRET_SUCCESS:
                                         printf("Successfully wrote the secret.\n");
@@ -360,37 +485,18 @@ int main(int argc, char **argv) {
                                 }
                                 break;
                             case READ:
-                                /* wait for server to allow client to send request */
-                                while (shared->server_down != -1 || sem_wait(sem1) == -1) {
-                                    error_exit("Server quit.");
-                                }
-                                server_waits = 1;
-                                shared->modus = LOGIN;
-                                shared->command = READ;
-                                (void) strncpy(shared->username, username, MAX_DATA);
-                                (void) strncpy(shared->password, password, MAX_DATA);
-                                (void) strncpy(shared->session_id, session_id, MAX_DATA);
-                                (void) strncpy(secret, shared->secret, MAX_DATA);
-                                /* tell server to continue */
-                                if (sem_post(sem2) == -1) {
-                                    error_exit("Server quit.");
-                                }
-                                if (sem_post(sem1) == -1) {
-                                    error_exit("Server quit.");
-                                }
-                                server_waits = -1;
-                                /* wait for response */
-                                while (shared->server_down != -1 || sem_wait(sem3) == -1) {
-                                    error_exit("Server quit.");
-                                }
-                                response = shared->status;
+                                response = check(authclient_read(&client, &secret));
                                 switch (response) {
                                     case LOGIN_SUCCESS:
                                         if (strlen(secret) == 0) {
                                             (void) printf("No secret was set on server!\n");
-                                            break;
+                                        } else {
+                                            (void) printf("Success! Your secret is: %s\n", secret);
                                         }
-                                        (void) printf("Success! Your secret is: %s\n", secret);
+                                        free(secret);
+                                        break;
+                                    case READ_SECRET_FAILED:
+                                        (void) fprintf(stderr, "The secret kept changing while it was read.\n");
                                         break;
                                     case LOGIN_FAILED:
                                         error_exit("Login failed.");
@@ -404,29 +510,7 @@ int main(int argc, char **argv) {
                                 }
                                 break;
                             case LOGOUT:
-                                /* wait for server to allow client to send request */
-                                while (shared->server_down != -1 || sem_wait(sem1) == -1) {
-                                    error_exit("Server quit.");
-                                }
-                                server_waits = 1;
-                                shared->modus = LOGIN;
-                                shared->command = LOGOUT;
-                                (void) strncpy(shared->username, username, MAX_DATA);
-                                (void) strncpy(shared->password, password, MAX_DATA);
-                                (void) strncpy(shared->session_id, session_id, MAX_DATA);
-                                /* tell server to continue */
-                                if (sem_post(sem2) == -1) {
-                                    error_exit("Server quit.");
-                                }
-                                if (sem_post(sem1) == -1) {
-                                    error_exit("Server quit.");
-                                }
-                                server_waits = -1;
-                                /* wait for response */
-                                while (shared->server_down != -1 || sem_wait(sem3) == -1) {
-                                    error_exit("Server quit.");
-                                }
-                                response = shared->status;
+                                response = check(authclient_logout(&client));
                                 switch (response) {
                                     case LOGOUT_SUCCESS:
                                         terminating = 1;
@@ -450,9 +534,7 @@ int main(int argc, char **argv) {
                                 break;
                         }
                     }
-                    if (shared->server_down != -1) {
-                        error_exit("Server down.");
-                    }
+                    free_resources();
                     exit (EXIT_SUCCESS);
                     break;
                 case LOGIN_FAILED:
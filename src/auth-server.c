@@ -16,27 +16,49 @@
 #include <sys/wait.h>
 #include <sys/types.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <assert.h>
 #include <fcntl.h>
 #include <time.h>
-#include <semaphore.h>
 #include <sys/time.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
 #include "shared.h"
+#include "store.h"
+#include "session.h"
+#include "loader.h"
+#include "snapshot.h"
+#include "journal.h"
+#include "password.h"
+#include "upload.h"
+#include "reclaim.h"
+
+/* === Constants === */
+
+/** @brief Size of the buffer the csv lines of an export are formatted into. */
+#define EXPORT_BUFFER (64 * 1024)
 
 /* === Prototypes === */
-/**
- * @brief Method to handle certain signals.
- * @details Is invoked on SIGINT and SIGTERM.
- * @param sig Signal code.
- */
-static void signal_handler(int sig);
 /**
  * @brief Exists the program with a given message.
+ * @details Frees the store and the shared fragment, so only the main thread may call it once no worker
+ *          runs anymore. Worker threads report through fail().
  * @param fmt Formatted string for parsing the latter arguments to.
  */
 static void error_exit (const char *fmt, ...);
+/**
+ * @brief Reports a fatal error of a worker thread and asks the event loop to shut the server down.
+ * @details The main thread exits with the first message once it joined the workers. The command
+ *          that failed reports an error to its client.
+ * @param fmt Formatted string for parsing the latter arguments to.
+ */
+static void fail(const char *fmt, ...);
 /**
  * @brief Frees the used resources.
  * @details This method is also invoked when the signals SIGINT and SIGTERM occur.
@@ -53,33 +75,205 @@ static void usage(void);
  */
 static int parse_args(int argc, char **argv);
 /**
- * @brief Reads data from the specified csv file and add it to the linked lsit.
- * @details The database must contain not more than 3 columns.
+ * @brief Reads data from the specified snapshot or csv file and add it to the store.
+ * @details Snapshots are recognized by their magic bytes and mapped as they are. A csv database
+ *          must contain not more than 3 columns. Reports the load rate.
  */
 static void parse_database(void);
 /**
- * @brief Saves the linked list database to the file ./auth-server.db.csv
+ * @brief Replays the journal on top of the database and opens it for appending.
+ * @details The database is not rewritten on exit any more, the journal holds all changes. A journal
+ *          rotated onto a checkpoint is refused on top of any other database, see journal.h.
+ */
+static void open_journal(void);
+/**
+ * @brief Saves the database to the files ./auth-server.db.csv and ./auth-server.db.snap
+ * @details A shard saves to names of its own, e.g. ./auth-server-2.db.csv, see shard_name().
  */
 static void save(void);
 /**
- * @brief Add an entry to the linked list database.
- * @param update The new entry.
- * @return 1 on success, -1 on error.
+ * @brief Add an entry to the database.
+ * @details Stores a hash of the password. Inserting and journaling happen under one lock, so
+ *          concurrent registrations of the same username are journaled in the order they were decided.
+ * @param username The username.
+ * @param password The password.
+ * @return The journal position of the new entry, 0 without journal, -1 on error.
  */
-static int prepend(struct shared_command *update);
+static int64_t prepend(const char *username, const char *password);
 /**
- * @brief Traverse the linked list database for a given entry.
- * @param update The entry that should be found.
- * @details Only compares username and password. Other attributes are ignored.
+ * @brief Look up a given entry in the hash index.
+ * @details The password is only hashed once the username matched, and without holding a lock. A
+ *          plaintext password or a hash of another cost is replaced by a hash of the current cost.
+ * @param username The username.
+ * @param password The password.
  * @return The user entry on success, NULL otherwise.
  */
-static struct entry *search(struct shared_command *update);
+static struct entry *search(const char *username, const char *password);
+/**
+ * @brief Starts a new session for a user and writes the session id into the message.
+ * @details A new login replaces the previous session of the user.
+ * @param entry The user.
+ * @param message The LOGIN message.
+ * @return 0 on success, -1 on error.
+ */
+static int start_session(struct entry *entry, struct message *message);
+/**
+ * @brief Adds the users of the csv lines of an IMPORT command.
+ * @details Plaintext passwords are hashed like those of a REGISTER, while no lock is held. Passwords
+ *          that are hashed already, like those of an export, are taken as given. Lines of users that
+ *          exist, belong to another shard or exceed the limits of a REGISTER are skipped. The lines are
+ *          terminated in place.
+ * @param slot The slot.
+ * @param message The IMPORT command.
+ * @return The journal position of the last added user, 0 if none was journaled, -1 on error.
+ */
+static int64_t import_users(struct slot *slot, struct message *message);
+/**
+ * @brief Writes a csv image of all users into the FIFO named by an EXPORT command.
+ * @details Like checkpoint_begin(), a grandchild forked while all changes are blocked writes the image from
+ *          its copy-on-write pages, so the image is consistent and requests are only paused for the
+ *          fork. The FIFO is opened before, so a client that does not read it fails right away.
+ * @param slot The slot.
+ * @param message The EXPORT command.
+ * @return 0 on success, -1 on error.
+ */
+static int export_users(struct slot *slot, struct message *message);
+/**
+ * @brief Formats the csv line of a user into a buffer and writes the buffer with write(2) when full.
+ * @details Called by the grandchild of export_users(), which must not use stdio or malloc(), as another
+ *          thread may have held their locks at the fork. Secrets larger than the buffer are written
+ *          directly.
+ * @param fd The FIFO.
+ * @param entry The user, NULL to write what is buffered.
+ * @return 0 on success, -1 on error.
+ */
+static int export_line(int fd, const struct entry *entry);
+/**
+ * @brief Writes a whole buffer with write(2).
+ * @param fd The file descriptor.
+ * @param data The buffer.
+ * @param len The number of bytes.
+ * @return 0 on success, -1 on error.
+ */
+static int write_all(int fd, const char *data, size_t len);
+/**
+ * @brief Executes a command of a request slot and writes the response into it.
+ * @details Strings returned on READ are appended to the payload of the slot.
+ * @param slot The slot.
+ * @param message The command.
+ * @return The journal position of the change made by the command, 0 if it made none.
+ */
+static uint64_t handle(struct slot *slot, struct message *message);
+/**
+ * @brief Executes the commands of a request slot in order.
+ * @details Logged-in commands without a session id use the session of the last successful LOGIN
+ *          before them in the batch. Stops after a READ that returned only part of its secret, and
+ *          sets the count of the slot to the executed commands, so the client resends the rest.
+ * @param slot The slot.
+ * @param block The statistics counters of the calling thread.
+ * @return The journal position of the last change made by the batch, 0 if it made none.
+ */
+static uint64_t handle_batch(struct slot *slot, struct stats_block *block);
+/**
+ * @brief Hands a handled request back to its client.
+ * @param slot The slot.
+ * @param begin The time the request was taken, in nanoseconds.
+ * @param block The statistics counters of the calling thread.
+ */
+static void respond(struct slot *slot, uint64_t begin, struct stats_block *block);
+/**
+ * @brief Executes all submitted requests in the shared fragment.
+ * @details If every change has to be synced, requests that changed the store are answered at the
+ *          end of the pass, after one sync covering all of them.
+ * @param start The slot to start scanning at, spreads concurrent workers over the slots.
+ * @param block The statistics counters of the calling thread.
+ * @return The number of handled requests.
+ */
+static int drain(int start, struct stats_block *block);
+/**
+ * @brief Handles requests until the server goes down.
+ * @details Reports a quiescent state to the reclaimer after every pass over the slots and goes
+ *          offline while waiting for requests.
+ * @param id The index of the worker.
+ */
+static void serve(int id);
+/**
+ * @brief Creates the statistics page STATS_NAME, or the one of the shard.
+ */
+static void stats_init(void);
+/**
+ * @brief Adds to a counter of the statistics page.
+ * @details Each counter block has a single writer, so a relaxed load and store suffice and
+ *          readers never see a torn value.
+ * @param counter The counter.
+ * @param n The amount to add.
+ */
+static inline void stats_add(uint64_t *counter, uint64_t n);
+/**
+ * @brief Adds to a gauge of the statistics page shared by all server threads.
+ * @param gauge The gauge.
+ * @param n The amount to add, may be negative.
+ */
+static inline void stats_gauge(uint64_t *gauge, int64_t n);
+/**
+ * @brief Entry point of the thread verifying the checksums of a loaded snapshot.
+ * @details Asks the event loop to shut the server down if the snapshot is corrupt.
+ * @param arg Unused.
+ * @return Always NULL.
+ */
+static void *verify(void *arg);
+/**
+ * @brief Starts writing a checkpoint of the store to SNAPSHOT_NAME, or the snapshot of the shard.
+ * @details A child forked while all changes are blocked writes the image from its copy-on-write
+ *          pages, so requests are only paused for the fork. Does nothing while a checkpoint is
+ *          written already.
+ */
+static void checkpoint_begin(void);
+/**
+ * @brief Reaps the child writing the checkpoint and rotates the journal once it succeeded.
+ * @param wait Whether to wait for a running child, otherwise only a finished one is reaped.
+ */
+static void checkpoint_end(bool wait);
+/**
+ * @brief Returns the number of changes made since the server started.
+ * @return The number of successful REGISTER, WRITE and IMPORT commands.
+ */
+static uint64_t changes(void);
+/**
+ * @brief Creates the event loop and the descriptors of its events.
+ * @details SIGINT, SIGTERM, SIGUSR1 and SIGCHLD are taken through a signalfd, so they have to be
+ *          blocked in all threads. The session tick and the checkpoint interval are timerfds, and
+ *          other threads ask for a shutdown through an eventfd.
+ */
+static void events_init(void);
 /**
- * @brief Generate a random id containing alphanumeric characters.
- * @details Length is always 20.
- * @return The generated id.
+ * @brief Arms a timerfd to expire periodically.
+ * @param fd The timerfd.
+ * @param ms The period in milliseconds.
  */
-static char *rdm_id(void);
+static void arm_timer(int fd, long ms);
+/**
+ * @brief Handles signals, timers and shutdown requests until the server goes down.
+ * @details Runs in the main thread while the workers handle the requests. Expires idle sessions,
+ *          finished uploads and retired records once per tick, writes a checkpoint on SIGUSR1 and
+ *          every checkpoint_s seconds unless nothing changed, and reaps it on SIGCHLD.
+ */
+static void run_events(void);
+/**
+ * @brief Frees the slots held by clients that died before releasing them.
+ * @details Called on every tick, so a killed client blocks the others for a tick at most.
+ */
+static void recover_slots(void);
+/**
+ * @brief Marks the server as down and wakes up the workers and the waiting clients.
+ */
+static void shutdown_workers(void);
+/**
+ * @brief Entry point of the additional worker threads.
+ * @param arg The index of the worker.
+ * @return Always NULL.
+ */
+static void *worker(void *arg);
 /**
  * @brief The program entry point.
  * @param argc The argument vector.
@@ -91,44 +285,135 @@ int main(int argc, char **argv);
 /* === Global Variables === */
 
 /** @brief The shared memory file descriptor */
-static int shmfd;
+static int shmfd = -1;
 /** @brief Used to terminate the client only once. */
 static volatile sig_atomic_t terminating;
-/** @brief Semaphor to allow client the initial request. @details Is a binary semaphor. */
-extern sem_t *sem1;
-/** @brief Semaphor to allow client further commands when logged in. @details Is a binary semaphor. */
-extern sem_t *sem2;
-/** @brief Semaphor to sync waiting for response from server. @details Is a binary semaphor. */
-extern sem_t *sem3;
-/** @brief Stores the user in a linked list */
-static struct entry *first;
+/** @brief Stores the users, indexed by username */
+static struct store store;
+/** @brief Maps the session ids of logged-in users to their entries */
+static struct sessions sessions;
+/** @brief Collects the chunks of secrets larger than a slot */
+static struct uploads uploads;
+/** @brief Frees the indexes and secrets the store replaced once no server thread holds them */
+static struct reclaim reclaim;
 /** @brief Holds the program name. */
 static char *progname;
 /** @brief Holds the database name. @details If specified in the argument vector, the value should
  *         equal a filename in csv format */
 static char *dbname = NULL;
-/** @brief The shared fragment between server and client */
-static struct shared_command *shared = NULL;
+/** @brief The shared fragment between server and clients */
+static struct shared_fragment *shared = NULL;
 /** @brief Used to save the database only once. */
 static int saved = -1;
+/** @brief Size of a request slot in bytes. @details Set by -z. */
+static long slot_size = SLOT_SIZE;
+/** @brief Time in microseconds the server and clients spin before blocking. @details Set by -s. */
+static long spin_us = -1;
+/** @brief Number of threads handling requests. @details Set by -t, by default one per CPU but at least
+ *         two, since a LOGIN or REGISTER holds its thread for the whole key derivation. */
+static long nthreads = -1;
+/** @brief The worker threads handling the requests. */
+static pthread_t *workers = NULL;
+/** @brief The statistics page file descriptor */
+static int statsfd = -1;
+/** @brief The statistics page, read by auth-stat. */
+static struct stats *stats = NULL;
+/** @brief Size of the statistics page in bytes. */
+static size_t stats_size;
+/** @brief Id of the snapshot loaded as database, 0 if none, see snapshot_id(). */
+static uint64_t loaded_id = 0;
+/** @brief Id of the parent checkpoint of the loaded snapshot, 0 if none. */
+static uint64_t loaded_parent = 0;
+/** @brief Whether the database is a snapshot, which is verified while serving. */
+static bool from_snapshot = false;
+/** @brief The thread verifying the snapshot. */
+static pthread_t verifier;
+/** @brief Set by the verifier if the snapshot is corrupt. */
+static int corrupt = 0;
+/** @brief Set by the first worker thread that failed, see fail(). */
+static int failed = 0;
+/** @brief The message of the first failed worker thread. */
+static char failure[256];
+/** @brief Holds the journal name. @details Set by -j. */
+static char *journalname = NULL;
+/** @brief The sync policy of the journal. @details Set by -f. */
+static long sync_ms = JOURNAL_SYNC_MS;
+/** @brief The journal of all changes, open if journalname is set. */
+static struct journal journal;
+/** @brief Whether the journal is open. */
+static bool journaling = false;
+/** @brief Orders the registrations in the journal. */
+static pthread_mutex_t register_lock = PTHREAD_MUTEX_INITIALIZER;
+/** @brief Number of PBKDF2 iterations of new password hashes. @details Set by -i. */
+static unsigned long iterations = PASSWORD_ITERATIONS;
+/** @brief Memory limit of the sessions in KiB. @details Set by -m. */
+static long session_kib = SESSIONS_MEMORY;
+/** @brief Seconds after which an unused session expires. @details Set by -e. */
+static long session_idle = SESSIONS_IDLE;
+/** @brief Seconds between two checkpoints, 0 only writes them on SIGUSR1. @details Set by -c. */
+static long checkpoint_s = 0;
+/** @brief The child writing the current checkpoint, -1 if none is written. */
+static pid_t checkpoint_child = -1;
+/** @brief The journal position the current checkpoint covers. */
+static uint64_t checkpoint_position;
+/** @brief The time the current checkpoint started at, in nanoseconds. */
+static uint64_t checkpoint_started;
+/** @brief Number of users in the current checkpoint. */
+static size_t checkpoint_users;
+/** @brief Number of changes covered by the last checkpoint, see changes(). */
+static uint64_t checkpoint_changes;
+/** @brief The event loop. */
+static int epollfd = -1;
+/** @brief Delivers SIGINT, SIGTERM, SIGUSR1 and SIGCHLD to the event loop. */
+static int sigfd = -1;
+/** @brief Expires once per session tick. */
+static int tickfd = -1;
+/** @brief Expires every checkpoint_s seconds, -1 without -c. */
+static int checkpointfd = -1;
+/** @brief Lets other threads ask the event loop for a shutdown. */
+static int wakefd = -1;
+/** @brief The index of the shard of the server. @details Set by -k. */
+static long shard = 0;
+/** @brief Number of shards, the server only registers users of its own. @details Set by -k. */
+static long shards = 1;
+/** @brief Name of the shared fragment of the shard. */
+static char shmname[SHARD_NAME_MAX] = SHM_NAME;
+/** @brief Name of the statistics page of the shard. */
+static char statsname[SHARD_NAME_MAX] = STATS_NAME;
+/** @brief Name of the csv database of the shard. */
+static char csvname[SHARD_NAME_MAX] = DATABASE_NAME;
+/** @brief Name of the snapshot of the shard. */
+static char snapname[SHARD_NAME_MAX] = SNAPSHOT_NAME;
 
 /* === Implementations === */
 
 static void usage(void) {
-    (void) fprintf (stderr, "USAGE: %s [-l database]\n", progname);
+    (void) fprintf (stderr, "USAGE: %s [-l database] [-j journal [-f always|never|sync_ms]] [-c checkpoint_s]\n"
+                    "       [-i iterations] [-e session_idle_s] [-m session_kib] [-z slot_size] [-s spin_us] [-t threads]\n"
+                    "       [-k shard/shards]\n",
+                    progname);
     exit (EXIT_FAILURE);
 }
 
 static int parse_args(int argc, char **argv) {
     int flag_l = -1;
-    char opt;
+    int flag_s = -1;
+    int flag_z = -1;
+    int flag_t = -1;
+    int flag_j = -1;
+    int flag_f = -1;
+    int flag_c = -1;
+    int flag_i = -1;
+    int flag_e = -1;
+    int flag_m = -1;
+    int flag_k = -1;
+    long cost;
+    char *end;
+    int opt;
     if (argc == 1) {
         return 1;
     }
-    if (argc > 3 || argc == 2) {
-        return -1;
-    }
-    while ((opt = getopt (argc, argv, "l:")) != -1) {
+    while ((opt = getopt (argc, argv, "l:s:t:j:f:c:i:e:m:z:k:")) != -1) {
         switch (opt) {
             case 'l':
                 if (flag_l != -1) {
@@ -141,76 +426,219 @@ static int parse_args(int argc, char **argv) {
                 DEBUG("Database is %s.\n", dbname);
                 flag_l = 1;
                 break;
-            default:
+            case 's':
+                if (flag_s != -1) {
+                    usage();
+                }
+                spin_us = strtol(optarg, &end, 10);
+                if (*end != '\0' || spin_us < 0 || spin_us > 1000000) {
+                    return -1;
+                }
+                flag_s = 1;
                 break;
+            case 'z':
+                if (flag_z != -1) {
+                    usage();
+                }
+                slot_size = strtol(optarg, &end, 10);
+                if (*end != '\0' || slot_size < SLOT_SIZE_MIN || slot_size > SLOT_SIZE_MAX) {
+                    return -1;
+                }
+                /* keep the slots on cache lines of their own */
+                slot_size = (slot_size + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+                flag_z = 1;
+                break;
+            case 't':
+                if (flag_t != -1) {
+                    usage();
+                }
+                nthreads = strtol(optarg, &end, 10);
+                if (*end != '\0' || nthreads < 1 || nthreads > 256) {
+                    return -1;
+                }
+                flag_t = 1;
+                break;
+            case 'j':
+                if (flag_j != -1) {
+                    usage();
+                }
+                journalname = optarg;
+                DEBUG("Journal is %s.\n", journalname);
+                flag_j = 1;
+                break;
+            case 'f':
+                if (flag_f != -1) {
+                    usage();
+                }
+                if (strcmp(optarg, "always") == 0) {
+                    sync_ms = JOURNAL_SYNC_ALWAYS;
+                } else if (strcmp(optarg, "never") == 0) {
+                    sync_ms = JOURNAL_SYNC_NEVER;
+                } else {
+                    sync_ms = strtol(optarg, &end, 10);
+                    if (*end != '\0' || sync_ms < 1 || sync_ms > 3600000) {
+                        return -1;
+                    }
+                }
+                flag_f = 1;
+                break;
+            case 'c':
+                if (flag_c != -1) {
+                    usage();
+                }
+                checkpoint_s = strtol(optarg, &end, 10);
+                if (*end != '\0' || checkpoint_s < 1 || checkpoint_s > 86400) {
+                    return -1;
+                }
+                flag_c = 1;
+                break;
+            case 'i':
+                if (flag_i != -1) {
+                    usage();
+                }
+                cost = strtol(optarg, &end, 10);
+                if (*end != '\0' || cost < 1 || cost > 100000000) {
+                    return -1;
+                }
+                iterations = cost;
+                flag_i = 1;
+                break;
+            case 'e':
+                if (flag_e != -1) {
+                    usage();
+                }
+                session_idle = strtol(optarg, &end, 10);
+                if (*end != '\0' || session_idle < 1 || session_idle > 30 * 86400) {
+                    return -1;
+                }
+                flag_e = 1;
+                break;
+            case 'm':
+                if (flag_m != -1) {
+                    usage();
+                }
+                session_kib = strtol(optarg, &end, 10);
+                if (*end != '\0' || session_kib < 1 || session_kib > 64L * 1024 * 1024) {
+                    return -1;
+                }
+                flag_m = 1;
+                break;
+            case 'k':
+                if (flag_k != -1) {
+                    usage();
+                }
+                if (shard_parse(optarg, &shard, &shards) == -1) {
+                    return -1;
+                }
+                flag_k = 1;
+                break;
+            default:
+                return -1;
         }
     }
+    if (optind != argc || (flag_f != -1 && flag_j == -1)) {
+        return -1;
+    }
     return 0;
 }
 
 static void parse_database(void) {
-    FILE *database;
-    char line[MAX_DATA];
-    int i;
-
-    if (dbname != NULL) {
+    struct load_result result;
+    uint64_t start;
+    double secs;
 
-        if ((database = fopen(dbname, "r")) == NULL) {
-            error_exit("Couldn't open file.");
+    if (dbname == NULL) {
+        return;
+    }
+    /* a database that failed to load must not be overwritten by an empty one */
+    saved = 1;
+    start = now_ns();
+    switch (snapshot_probe(dbname)) {
+        case 1:
+            if (snapshot_load(&store, dbname) == -1) {
+                if (errno == EINVAL) {
+                    errno = 0;
+                    error_exit("Corrupt or incompatible snapshot.");
+                }
+                error_exit("Couldn't load snapshot.");
+            }
+            if (snapshot_id(dbname, &loaded_id, &loaded_parent) == -1) {
+                error_exit("Couldn't load snapshot.");
+            }
+            DEBUG("Mapped snapshot of %zu users in %.3f ms.\n", store.snap_count, (now_ns() - start) / 1e6);
+            from_snapshot = true;
+            saved = -1;
+            return;
+        case -1:
+            error_exit("Couldn't open database.");
+    }
+    if (load_database(&store, dbname, shard, shards, &result) == -1) {
+        if (errno == EINVAL) {
+            errno = 0;
+            error_exit("Malformed input data.");
         }
+        error_exit("Couldn't load database.");
+    }
+    saved = -1;
+    secs = (now_ns() - start) / 1e9;
+    DEBUG("Loaded %zu users (%zu duplicates, %zu of other shards skipped) from %.1f MB in %.3f s with %d threads, "
+          "%.1f MB/s.\n", result.users, result.duplicates, result.foreign, result.bytes / 1e6, secs, result.threads,
+          secs > 0 ? result.bytes / 1e6 / secs : 0);
+}
 
-        struct entry *data;
+static void open_journal(void) {
+    size_t applied;
+    uint64_t start;
 
-        while (fgets(line, MAX_DATA, database)) {
-            char *tmp, *tok;
-            if ((tmp = strdup(line)) == NULL) {
-                error_exit("strdup failed.");
-            }
-            for (i=0, tok = strtok(tmp, ";"); tok != NULL; tok = strtok(NULL, ";\n"), i++) {
-                switch(i) {
-                    case 0:
-                        if ((data = malloc(sizeof(struct entry))) == NULL) {
-                            error_exit("Failed to allocate memory for db entry.");
-                        }
-                        (void) strncpy(data->username, tok, MAX_DATA);
-                        break;
-                    case 1:
-                        (void) strncpy(data->password, tok, MAX_DATA);
-                        break;
-                    case 2:
-                        (void) strncpy(data->secret, tok, MAX_DATA);
-                        break;
-                    default:
-                        error_exit("Malformed input data.");
-                }
-            }
-            data->next = first;
-            first = data;
-            free(tmp);
+    if (journalname == NULL) {
+        return;
+    }
+    /* neither a failed replay nor a running journal rewrite the database */
+    saved = 1;
+    start = now_ns();
+    if (journal_replay(journalname, &store, loaded_id, loaded_parent, &applied) == -1) {
+        if (errno == EINVAL) {
+            errno = 0;
+            error_exit("%s is no journal.", journalname);
+        }
+        if (errno == ESTALE) {
+            /* the records before the checkpoint were dropped, the database lacks them */
+            errno = 0;
+            error_exit("%s continues another checkpoint, load the last one, %s, with -l.", journalname, snapname);
         }
+        error_exit("Couldn't replay journal.");
+    }
+    DEBUG("Replayed %zu journal records in %.3f ms.\n", applied, (now_ns() - start) / 1e6);
+    if (journal_open(&journal, journalname, sync_ms) == -1) {
+        error_exit("Couldn't open journal.");
     }
+    journaling = true;
 }
 
 static void save(void) {
     FILE *db;
-    struct entry *ptr = first;
+    struct entry *ptr;
+    size_t cursor = 0;
 
     if (saved != -1) {
         return;
     }
-    if ((db = fopen("auth-server.db.csv", "w+")) == NULL) {
+    if ((db = fopen(csvname, "w+")) == NULL) {
         error_exit("Couldn't open the database file.");
     }
-    DEBUG("Saving to auth-server.db.csv.\n");
-    while (ptr != NULL) {
-        (void) fprintf(db, "%s;%s;%s\n", ptr->username, ptr->password, ptr->secret);
-        DEBUG("> u: %s; p: %s; s: %s\n", ptr->username, ptr->password, ptr->secret);
-        ptr = ptr->next;
+    DEBUG("Saving to %s.\n", csvname);
+    while ((ptr = store_next(&store, &cursor)) != NULL) {
+        (void) fprintf(db, "%s;%s;%s\n", ENTRY_USERNAME(ptr), ENTRY_PASSWORD(ptr), ENTRY_SECRET(ptr));
+        DEBUG("> u: %s; p: %s; s: %s\n", ENTRY_USERNAME(ptr), ENTRY_PASSWORD(ptr), ENTRY_SECRET(ptr));
     }
     if (fclose(db) == -1) {
         error_exit("Failed to close save file.");
     }
     saved = 1;
+    DEBUG("Saving to %s.\n", snapname);
+    if (snapshot_save(&store, snapname, 0) == -1) {
+        error_exit("Couldn't write the snapshot.");
+    }
 }
 
 static void error_exit (const char *fmt, ...) {
@@ -233,8 +661,28 @@ static void error_exit (const char *fmt, ...) {
     exit (EXIT_FAILURE);
 }
 
+static void fail(const char *fmt, ...) {
+    const uint64_t one = 1;
+    int error = errno, expected = 0;
+    size_t len;
+    va_list ap;
+
+    /* only the first failure is reported, the others are likely caused by it */
+    if (!__atomic_compare_exchange_n(&failed, &expected, 1, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+        return;
+    }
+    va_start(ap, fmt);
+    (void) vsnprintf(failure, sizeof failure, fmt, ap);
+    va_end(ap);
+    len = strlen(failure);
+    if (error != 0) {
+        (void) snprintf(failure + len, sizeof failure - len, ": %s", strerror(error));
+    }
+    shutdown_workers();
+    (void) write(wakefd, &one, sizeof one);
+}
+
 static void free_resources(void) {
-    struct entry *temp;
     if (terminating == 1) {
         return;
     }
@@ -243,222 +691,928 @@ static void free_resources(void) {
     if (shmfd != -1) {
         (void) close (shmfd);
     }
+    /* Close the event loop */
+    if (epollfd != -1) {
+        (void) close(epollfd);
+        (void) close(sigfd);
+        (void) close(tickfd);
+        (void) close(wakefd);
+        if (checkpointfd != -1) {
+            (void) close(checkpointfd);
+        }
+    }
     /* save database */
     save();
-    /* Free all space from linked list */
-    while (first != NULL) {
-        temp = first;
-        first = first->next;
-        free(temp);
+    if (journaling) {
+        journaling = false;
+        if (journal_close(&journal) == -1) {
+            (void) fprintf(stderr, "%s: Couldn't write the journal: %s\n", progname, strerror(errno));
+        }
     }
-    DEBUG("Removing shared memory and semaphors.\n");
-    /* Unmap the shared memory */
-    if (munmap(shared, sizeof *shared) == -1) {
-        error_exit("Couldn't unmap shared memory.");
+    /* Free the sessions and all entries in bulk */
+    sessions_free(&sessions);
+    uploads_free(&uploads);
+    store_free(&store);
+    reclaim_free(&reclaim);
+    DEBUG("Removing shared memory.\n");
+    if (shared != NULL) {
+        /* Wake up clients waiting for a slot or a response */
+        shared->server_down = 1;
+        (void) __atomic_add_fetch(&shared->released, 1, __ATOMIC_SEQ_CST);
+        futex_wake(&shared->released, &shared->released_sleepers);
+        for (int i = 0; i < NUM_SLOTS; i++) {
+            futex_wake(&slot_at(shared, i)->state, &slot_at(shared, i)->sleepers);
+        }
+        /* Unmap the shared memory */
+        if (munmap(shared, fragment_size(slot_size)) == -1) {
+            error_exit("Couldn't unmap shared memory.");
+        }
     }
     /* Remove shared memory object */
-    if (shm_unlink(SHM_NAME) == -1) {
+    if (shmfd != -1 && shm_unlink(shmname) == -1) {
         error_exit("Couldn't remove shared memory.");
     }
-    /* Close semaphor */
-    if (sem_close(sem1) == -1) {
-        error_exit("Couldn't remove semaphor 1.");
+    if (stats != NULL) {
+        __atomic_store_n(&stats->server_down, 1, __ATOMIC_RELEASE);
+        (void) munmap(stats, stats_size);
+    }
+    if (statsfd != -1) {
+        (void) close(statsfd);
+        (void) shm_unlink(statsname);
     }
-    if (sem_close(sem2) == -1) {
-        error_exit("Couldn't remove semaphor 2.");
+}
+
+static int64_t prepend(const char *username, const char *password) {
+    char hash[PASSWORD_HASH_MAX];
+    uint64_t position = 0;
+
+    /* hashing is expensive, do not pay it for names that are taken */
+    if (store_find(&store, username) != NULL) {
+        return -1;
     }
-    if (sem_close(sem3) == -1) {
-        error_exit("Couldn't remove semaphor 3.");
+    if (password_hash(password, iterations, hash) == -1) {
+        fail("Couldn't hash the password.");
+        return -1;
     }
-    /* Unlink semaphor */
-    if (sem_unlink(SEM1_NAME)) {
-        error_exit("Couldn't unlink sempaphor 1.");
+    if (journaling) {
+        (void) pthread_mutex_lock(&register_lock);
     }
-    if (sem_unlink(SEM2_NAME)) {
-        error_exit("Couldn't unlink sempaphor 2.");
+    /* new users start without a secret */
+    if (store_add(&store, username, hash, "") == NULL) {
+        if (journaling) {
+            (void) pthread_mutex_unlock(&register_lock);
+        }
+        if (errno != EEXIST) {
+            fail("Failed to allocate memory for appending the db.");
+        }
+        return -1;
     }
-    if (sem_unlink(SEM3_NAME)) {
-        error_exit("Couldn't unlink sempaphor 3.");
+    if (journaling) {
+        position = journal_append(&journal, JOURNAL_REGISTER, username, hash);
+        (void) pthread_mutex_unlock(&register_lock);
+        if (position == 0) {
+            fail("Couldn't write the journal.");
+            return -1;
+        }
     }
+    return position;
 }
 
-static void signal_handler(int sig) {
-    DEBUG("Signal caught: %d", sig);
-    if (sig == SIGINT || sig == SIGTERM) {
-        shared->server_down = 1;
+static struct entry *search(const char *username, const char *password) {
+    char stored[PASSWORD_HASH_MAX], hash[PASSWORD_HASH_MAX];
+    struct entry *tmp;
+    bool rehash;
+    int match;
+
+    if ((tmp = store_find(&store, username)) == NULL) {
+        return NULL;
+    }
+    store_lock(&store, tmp, false);
+    (void) snprintf(stored, sizeof stored, "%s", ENTRY_PASSWORD(tmp));
+    store_unlock(&store, tmp);
+    if ((match = password_verify(password, stored, iterations, &rehash)) == -1) {
+        fail("Couldn't verify the password.");
+        return NULL;
+    }
+    if (match == 0) {
+        return NULL;
     }
+    /* hashed without the entry lock, the swap keeps a concurrent rehash */
+    if (rehash && password_hash(password, iterations, hash) == 0
+        && store_set_password(&store, tmp, stored, hash) == -1) {
+        fail("Failed to allocate memory for the password.");
+    }
+    /* registered user found */
+    return tmp;
 }
 
-static int prepend(struct shared_command *update) {
-    if (search(update) != NULL) {
+static int start_session(struct entry *entry, struct message *message) {
+    char id[SIZE_SESS_ID];
+    int evicted;
+
+    store_lock(&store, entry, true);
+    /* the old session may have expired and its id been handed out again, so check the owner */
+    if (entry->session_id[0] != '\0' && sessions_remove(&sessions, entry->session_id, entry) != NULL) {
+        stats_gauge(&stats->sessions, -1);
+    }
+    if ((evicted = sessions_create(&sessions, entry, id)) == -1) {
+        store_unlock(&store, entry);
+        fail("Failed to draw a session id.");
         return -1;
     }
+    stats_gauge(&stats->sessions, 1 - evicted);
+    (void) memcpy(entry->session_id, id, SIZE_SESS_ID);
+    entry->session_id[SIZE_SESS_ID] = '\0';
+    store_unlock(&store, entry);
+    (void) memcpy(message->session_id, id, SIZE_SESS_ID);
+    return 0;
+}
+
+static int64_t import_users(struct slot *slot, struct message *message) {
+    const char *fields[3];
+    size_t lens[3], len;
+    char *chunk, *line, *nl, *end, hash[PASSWORD_HASH_MAX];
+    const char *password;
+    uint64_t position = 0, last = 0;
+    uint32_t added = 0, skipped = 0;
+    bool broken = false, hashed;
     struct entry *tmp;
-    if ((tmp = malloc(sizeof(struct entry))) == NULL) {
-        error_exit("Failed to allocate memory for appending the db.");
+
+    if ((chunk = slot_get(slot, slot_size, &message->secret, &len)) == NULL) {
+        return -1;
     }
-    (void) strncpy(tmp->username, update->username, MAX_DATA);
-    (void) strncpy(tmp->password, update->password, MAX_DATA);
-    (void) strncpy(tmp->secret, update->secret, MAX_DATA);
-    tmp->next = first;
-    first = tmp;
-    return 1;
+    end = chunk + len;
+    for (line = chunk; line < end && !broken; line = nl + 1) {
+        if ((nl = memchr(line, '\n', end - line)) == NULL) {
+            nl = end;
+        }
+        if (split_line(line, nl - line, fields, lens) != 1) {
+            skipped += nl > line;
+            continue;
+        }
+        hashed = lens[1] >= strlen(PASSWORD_SCHEME)
+                 && strncmp(fields[1], PASSWORD_SCHEME, strlen(PASSWORD_SCHEME)) == 0;
+        if (lens[0] >= MAX_DATA || lens[1] >= (hashed ? PASSWORD_HASH_MAX : MAX_DATA)
+            || shard_of(hash_bytes(fields[0], lens[0]), shards) != shard) {
+            skipped++;
+            continue;
+        }
+        /* terminate the fields at their separators, the end of the chunk is terminated already */
+        for (char *c = line; c < nl; c++) {
+            if (*c == ';') {
+                *c = '\0';
+            }
+        }
+        if (nl > line && nl[-1] == '\r') {
+            nl[-1] = '\0';
+        }
+        *nl = '\0';
+        /* hashing is expensive, do not pay it for names that are taken */
+        if (store_find(&store, fields[0]) != NULL) {
+            skipped++;
+            continue;
+        }
+        password = fields[1];
+        if (!hashed) {
+            if (password_hash(fields[1], iterations, hash) == -1) {
+                fail("Couldn't hash the password.");
+                broken = true;
+                break;
+            }
+            password = hash;
+        }
+        /* like prepend(), so concurrent registrations are journaled in the order decided */
+        if (journaling) {
+            (void) pthread_mutex_lock(&register_lock);
+        }
+        if ((tmp = store_add(&store, fields[0], password, fields[2])) == NULL) {
+            if (errno != EEXIST) {
+                fail("Failed to allocate memory for the imported users.");
+                broken = true;
+            }
+            skipped += !broken;
+        } else if (journaling && ((position = journal_append(&journal, JOURNAL_REGISTER, fields[0], password)) == 0
+                                  || (lens[2] > 0 && (position = journal_append(&journal, JOURNAL_WRITE, fields[0],
+                                                                                 fields[2])) == 0))) {
+            fail("Couldn't write the journal.");
+            broken = true;
+        }
+        if (journaling) {
+            (void) pthread_mutex_unlock(&register_lock);
+        }
+        if (tmp != NULL) {
+            last = position;
+            added++;
+        }
+    }
+    stats_gauge(&stats->users, added);
+    message->total = added;
+    message->position = skipped;
+    return broken ? -1 : (int64_t) last;
 }
 
-static struct entry *search(struct shared_command *update) {
-    struct entry *tmp = first;
-    while (1) {
-        if (tmp != NULL) {
-            if (strcmp(update->username, tmp->username) == 0 && strcmp(update->password, tmp->password) == 0) {
-                /* registered user found */
-                return tmp;
+static int export_users(struct slot *slot, struct message *message) {
+    sigset_t set;
+    struct entry *ptr;
+    struct stat named, st;
+    size_t cursor = 0, users;
+    char *path;
+    pid_t child;
+    int fd, status, flags;
+
+    /* never write into a regular file named by a client, nor follow a link planted in place of the FIFO */
+    if ((path = slot_get(slot, slot_size, &message->secret, NULL)) == NULL || lstat(path, &named) == -1
+        || !S_ISFIFO(named.st_mode)) {
+        return -1;
+    }
+    /* without a reader the FIFO cannot be opened without blocking */
+    if ((fd = open(path, O_WRONLY | O_NONBLOCK | O_NOFOLLOW)) == -1) {
+        return -1;
+    }
+    /* the name may have been replaced between the checks */
+    if (fstat(fd, &st) == -1 || !S_ISFIFO(st.st_mode) || st.st_dev != named.st_dev || st.st_ino != named.st_ino
+        || (flags = fcntl(fd, F_GETFL)) == -1 || fcntl(fd, F_SETFL, flags & ~O_NONBLOCK) == -1) {
+        (void) close(fd);
+        return -1;
+    }
+    store_freeze(&store);
+    users = store.count + store.snap_count;
+    if ((child = fork()) == 0) {
+        /* the grandchild is reaped by init, so the server need not wait for the export */
+        if (fork() != 0) {
+            _exit(EXIT_SUCCESS);
+        }
+        /* the signals are left to the event loop of the server, the grandchild takes them as usual */
+        (void) sigemptyset(&set);
+        (void) sigprocmask(SIG_SETMASK, &set, NULL);
+        /* another thread may have held the stdio locks at the fork, so only write(2) is used */
+        while ((ptr = store_next(&store, &cursor)) != NULL) {
+            if (export_line(fd, ptr) == -1) {
+                _exit(EXIT_FAILURE);
             }
-            tmp = tmp->next;
-            continue;
         }
-        free (tmp);
-        return NULL;
+        _exit(export_line(fd, NULL) == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+    store_thaw(&store);
+    (void) close(fd);
+    if (child == -1) {
+        return -1;
     }
+    /* the child only forks the grandchild */
+    while (waitpid(child, &status, 0) == -1 && errno == EINTR) {
+        continue;
+    }
+    message->total = users;
+    DEBUG("Exporting %zu users to %s.\n", users, path);
+    return 0;
 }
 
-static char *rdm_id(void) {
-    char *s = malloc(SIZE_SESS_ID);
-    char *chars = "AaBbCcDdEeFfGgHhIiJjKkLlMmNnOoPpQqRrSsTtUuVvWwXxYyZz0123456789";
-    (void) srand(time(NULL));
-    for(int i = 0; i < SIZE_SESS_ID; i++) {
-        s[i] = chars[rand() % strlen(chars)];
+static int export_line(int fd, const struct entry *entry) {
+    static char buffer[EXPORT_BUFFER];
+    static size_t used = 0;
+    const char *fields[3];
+    size_t len;
+
+    if (entry == NULL) {
+        len = used;
+        used = 0;
+        return write_all(fd, buffer, len);
     }
-    return s;
+    fields[0] = ENTRY_USERNAME(entry);
+    fields[1] = ENTRY_PASSWORD(entry);
+    fields[2] = ENTRY_SECRET(entry);
+    for (int i = 0; i < 3; i++) {
+        len = strlen(fields[i]);
+        if (used + len + 1 > sizeof buffer && export_line(fd, NULL) == -1) {
+            return -1;
+        }
+        if (len + 1 > sizeof buffer) {
+            if (write_all(fd, fields[i], len) == -1) {
+                return -1;
+            }
+            len = 0;
+        }
+        (void) memcpy(buffer + used, fields[i], len);
+        used += len;
+        buffer[used++] = i < 2 ? ';' : '\n';
+    }
+    return 0;
 }
 
-int main(int argc, char **argv) {
-    const int signals[] = {SIGINT, SIGTERM};
-    struct sigaction s;
+static int write_all(int fd, const char *data, size_t len) {
+    ssize_t n;
+
+    while (len > 0) {
+        if ((n = write(fd, data, len)) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static uint64_t handle(struct slot *slot, struct message *message) {
     struct entry *tmp;
-    if ((tmp = malloc(sizeof(struct entry))) == NULL) {
-        error_exit("Failed to allocate memory for temporary list element.");
+    int64_t position = 0;
+    char *username = NULL, *password = NULL, *secret, *whole = NULL, *payload;
+    size_t ulen, plen, slen, room;
+    int64_t copied;
+    uint32_t generation, length;
+    int complete = 1;
+
+    if (message->command == COMMAND_NONE) {
+        username = slot_get(slot, slot_size, &message->username, &ulen);
+        password = slot_get(slot, slot_size, &message->password, &plen);
+        /* never trust the client with the lengths */
+        if (username == NULL || password == NULL || ulen >= MAX_DATA || plen >= MAX_DATA) {
+            username = NULL;
+        }
     }
+    switch (message->modus) {
+        case LOGIN:
+            switch (message->command) {
+                case WRITE:
+                    if ((tmp = sessions_find(&sessions, message->session_id)) == NULL) {
+                        message->status = SESSION_FAILED;
+                    } else if ((secret = slot_get(slot, slot_size, &message->secret, &slen)) == NULL
+                               || ((message->position > 0 || message->total > slen)
+                                   && (complete = uploads_put(&uploads, message->session_id, tmp, message->position,
+                                                              message->total, secret, slen, &whole)) == -1)) {
+                        message->status = WRITE_SECRET_FAILED;
+                    } else if (complete == 0) {
+                        /* a chunk of a larger secret, kept until the last one arrives */
+                        message->status = WRITE_SECRET_SUCCESS;
+                    } else {
+                        /* Save secret in database, a collected secret is taken over without a copy */
+                        store_lock(&store, tmp, true);
+                        message->status = WRITE_SECRET_SUCCESS;
+                        if ((whole != NULL ? store_adopt_secret(&store, tmp, whole, message->total)
+                                           : store_set_secret(&store, tmp, secret)) == -1) {
+                            fail("Failed to allocate memory for the secret.");
+                            message->status = WRITE_SECRET_FAILED;
+                        /* journaled under the entry lock, so the last record holds the last secret */
+                        } else if (journaling && (position = journal_append(&journal, JOURNAL_WRITE,
+                                                                            ENTRY_USERNAME(tmp),
+                                                                            ENTRY_SECRET(tmp))) == 0) {
+                            fail("Couldn't write the journal.");
+                            message->status = WRITE_SECRET_FAILED;
+                        }
+                        store_unlock(&store, tmp);
+                    }
+                    break;
+                case READ:
+                    if ((tmp = sessions_find(&sessions, message->session_id)) == NULL) {
+                        message->status = SESSION_FAILED;
+                    } else {
+                        /* Copy as much of the secret as fits right to the payload, without locking the entry */
+                        /* read once, the client may change the slot meanwhile */
+                        length = __atomic_load_n(&slot->length, __ATOMIC_RELAXED);
+                        if (length < sizeof *slot || length >= slot_size) {
+                            length = slot_size;
+                        }
+                        room = length < slot_size ? slot_size - length - 1 : 0;
+                        payload = (char *) slot + length;
+                        if ((copied = store_read_secret(tmp, message->position, payload, room, &slen,
+                                                        &generation)) == -1
+                            || (message->position > 0 && message->generation != generation)) {
+                            /* the secret changed since the client read its first chunk */
+                            message->status = READ_SECRET_FAILED;
+                        } else {
+                            (void) slot_put(slot, slot_size, &message->secret, payload, copied);
+                            message->total = slen;
+                            message->generation = generation;
+                            message->status = LOGIN_SUCCESS;
+                        }
+                    }
+                    break;
+                case LOGOUT:
+                    if ((tmp = sessions_remove(&sessions, message->session_id, NULL)) == NULL) {
+                        message->status = SESSION_FAILED;
+                    } else {
+                        /* destroy session id, unless a new login replaced it meanwhile */
+                        store_lock(&store, tmp, true);
+                        if (memcmp(tmp->session_id, message->session_id, SIZE_SESS_ID) == 0) {
+                            memset(tmp->session_id, 0, sizeof tmp->session_id);
+                        }
+                        store_unlock(&store, tmp);
+                        stats_gauge(&stats->sessions, -1);
+                        message->status = LOGOUT_SUCCESS;
+                    }
+                    break;
+                default:
+                    if (username == NULL || (tmp = search(username, password)) == NULL
+                        || start_session(tmp, message) == -1) {
+                        message->status = LOGIN_FAILED;
+                    } else {
+                        message->status = LOGIN_SUCCESS;
+                    }
+                    break;
+            }
+            break;
+        case IMPORT:
+            if ((position = import_users(slot, message)) == -1) {
+                position = 0;
+                message->status = IMPORT_FAILED;
+            } else {
+                message->status = IMPORT_SUCCESS;
+            }
+            break;
+        case EXPORT:
+            message->status = export_users(slot, message) == 0 ? EXPORT_SUCCESS : EXPORT_FAILED;
+            break;
+        case REGISTER:
+            /* a user of another shard could never log in here */
+            if (username == NULL || shard_of(hash_string(username), shards) != shard
+                || (position = prepend(username, password)) == -1) {
+                position = 0;
+                message->status = REGISTER_FAILED;
+            } else {
+                stats_gauge(&stats->users, 1);
+                message->status = REGISTER_SUCCESS;
+            }
+            break;
+        default:
+            message->status = STATUS_NONE;
+            break;
+    }
+    return position;
+}
 
-    progname = argv[0];
-    s.sa_handler = signal_handler;
-    s.sa_flags   = 0;
-    if(sigfillset(&s.sa_mask) < 0) {
-        error_exit("sigfillset");
+static inline void stats_add(uint64_t *counter, uint64_t n) {
+    __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + n, __ATOMIC_RELAXED);
+}
+
+static inline void stats_gauge(uint64_t *gauge, int64_t n) {
+    (void) __atomic_add_fetch(gauge, n, __ATOMIC_RELAXED);
+}
+
+static void stats_init(void) {
+    /* a stale page of a crashed server is replaced, a running server holds its shared fragment */
+    (void) shm_unlink(statsname);
+    stats_size = sizeof *stats + nthreads * sizeof stats->threads[0];
+    if ((statsfd = shm_open(statsname, O_RDWR | O_CREAT | O_EXCL, STATS_PERMISSION)) == -1) {
+        error_exit("Couldn't init statistics page.");
+    }
+    if (ftruncate(statsfd, stats_size) == -1) {
+        error_exit("Couldn't extend statistics page.");
+    }
+    if ((stats = mmap(NULL, stats_size, PROT_READ | PROT_WRITE, MAP_SHARED, statsfd, 0)) == MAP_FAILED) {
+        stats = NULL;
+        error_exit("Couldn't map statistics page.");
+    }
+    stats->nthreads = nthreads;
+    stats->started = now_ns();
+    stats->users = store.count + store.snap_count;
+}
+
+static uint64_t handle_batch(struct slot *slot, struct stats_block *block) {
+    static const char none[SIZE_SESS_ID];
+    struct message *command;
+    const char *session = NULL;
+    uint32_t count = slot->count;
+    uint64_t position, last = 0;
+
+    if (count > BATCH_MAX) {
+        count = BATCH_MAX;
+    }
+    /* responses are appended behind the request strings */
+    if (slot->length < sizeof *slot + count * sizeof slot->messages[0] || slot->length > slot_size) {
+        count = 0;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        command = &slot->messages[i];
+        if (command->modus == LOGIN && command->command != COMMAND_NONE && session != NULL
+            && memcmp(command->session_id, none, SIZE_SESS_ID) == 0) {
+            (void) memcpy(command->session_id, session, SIZE_SESS_ID);
+        }
+        if ((position = handle(slot, command)) > last) {
+            last = position;
+        }
+        if (command->modus == REGISTER) {
+            stats_add(&block->commands[0], 1);
+        } else if (command->modus == LOGIN && command->command <= LOGOUT) {
+            stats_add(&block->commands[1 + command->command], 1);
+        }
+        if (command->status < STATS_STATUSES) {
+            stats_add(&block->statuses[command->status], 1);
+        }
+        if (command->modus == LOGIN && command->command == COMMAND_NONE && command->status == LOGIN_SUCCESS) {
+            session = command->session_id;
+        }
+        /* the client fetches the rest of the secret before the later commands may change it */
+        if (MESSAGE_PARTIAL(command)) {
+            slot->count = i + 1;
+            break;
+        }
+    }
+    return last;
+}
+
+static void respond(struct slot *slot, uint64_t begin, struct stats_block *block) {
+    uint64_t ns = now_ns() - begin;
+    int bucket = 63 - __builtin_clzll(ns | 1);
+
+    /* tell client to continue */
+    __atomic_store_n(&slot->state, SLOT_DONE, __ATOMIC_SEQ_CST);
+    futex_wake(&slot->state, &slot->sleepers);
+    stats_add(&block->latency[bucket < STATS_BUCKETS ? bucket : STATS_BUCKETS - 1], 1);
+    stats_add(&block->requests, 1);
+}
+
+static int drain(int start, struct stats_block *block) {
+    struct slot *slot, *pending[NUM_SLOTS];
+    uint64_t begin, position, begins[NUM_SLOTS], last = 0;
+    uint32_t expected;
+    int handled = 0, waiting = 0;
+
+    for (int i = 0; i < NUM_SLOTS; i++) {
+        slot = slot_at(shared, (start + i) % NUM_SLOTS);
+        expected = SLOT_SUBMITTED;
+        if (__atomic_compare_exchange_n(&slot->state, &expected, SLOT_PROCESSING, false,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED) == false) {
+            continue;
+        }
+        begin = now_ns();
+        position = handle_batch(slot, block);
+        handled++;
+        if (position > 0 && sync_ms == JOURNAL_SYNC_ALWAYS) {
+            pending[waiting] = slot;
+            begins[waiting++] = begin;
+            last = position > last ? position : last;
+        } else {
+            respond(slot, begin, block);
+        }
+    }
+    /* unless the changes never became durable, the clients then learn that the server quit */
+    if (waiting > 0 && journal_wait(&journal, last) == -1) {
+        fail("Couldn't write the journal.");
+        waiting = 0;
+    }
+    for (int i = 0; i < waiting; i++) {
+        respond(pending[i], begins[i], block);
+    }
+    /* one wake-up per pass for clients waiting on any of several slots */
+    if (handled > 0) {
+        (void) __atomic_add_fetch(&shared->completed, 1, __ATOMIC_SEQ_CST);
+        futex_wake(&shared->completed, &shared->completed_sleepers);
+    }
+    if (handled != block->queued) {
+        __atomic_store_n(&block->queued, handled, __ATOMIC_RELAXED);
+    }
+    return handled;
+}
+
+static void serve(int id) {
+    struct stats_block *block = &stats->threads[id];
+    int start = id * NUM_SLOTS / nthreads;
+    uint32_t doorbell;
+    int handled;
+
+    reclaim_online(&reclaim, id);
+    while (shared->server_down == -1) {
+        /* read the doorbell before draining, so no submission after the drain is missed */
+        doorbell = __atomic_load_n(&shared->doorbell, __ATOMIC_SEQ_CST);
+        handled = drain(start, block);
+        /* no entry or index is held between two passes */
+        reclaim_quiescent(&reclaim, id);
+        if (handled > 0) {
+            continue;
+        }
+        /* wait for request, a blocked thread must not hold back the reclaimer */
+        reclaim_offline(&reclaim, id);
+        (void) futex_await(&shared->doorbell, doorbell, &shared->doorbell_sleepers, shared->spin_us);
+        reclaim_online(&reclaim, id);
+    }
+    reclaim_offline(&reclaim, id);
+}
+
+static void *verify(void *arg) {
+    const uint64_t one = 1;
+    uint64_t start = now_ns();
+
+    if (snapshot_verify(dbname) == -1) {
+        __atomic_store_n(&corrupt, 1, __ATOMIC_SEQ_CST);
+        (void) write(wakefd, &one, sizeof one);
+    } else {
+        DEBUG("Verified snapshot in %.3f ms.\n", (now_ns() - start) / 1e6);
+    }
+    return NULL;
+}
+
+static uint64_t changes(void) {
+    uint64_t n = 0;
+
+    for (long i = 0; i < nthreads; i++) {
+        n += __atomic_load_n(&stats->threads[i].statuses[REGISTER_SUCCESS], __ATOMIC_RELAXED)
+             + __atomic_load_n(&stats->threads[i].statuses[WRITE_SECRET_SUCCESS], __ATOMIC_RELAXED)
+             + __atomic_load_n(&stats->threads[i].statuses[IMPORT_SUCCESS], __ATOMIC_RELAXED);
+    }
+    return n;
+}
+
+static void checkpoint_begin(void) {
+    sigset_t set;
+    uint64_t paused, parent;
+    pid_t child;
+
+    if (checkpoint_child != -1) {
+        DEBUG("Checkpoint still running.\n");
+        return;
+    }
+    checkpoint_started = now_ns();
+    checkpoint_changes = changes();
+    /* a consistent image: no change is half done and the journal holds exactly the changes before it */
+    if (journaling) {
+        (void) pthread_mutex_lock(&register_lock);
+    }
+    store_freeze(&store);
+    checkpoint_users = store.count + store.snap_count;
+    if (journaling) {
+        checkpoint_position = journal_position(&journal);
     }
-    for(int i = 0; i < 2; i++) {
-        if (sigaction(signals[i], &s, NULL) < 0) {
-            error_exit("sigaction");
+    if ((child = fork()) == 0) {
+        /* the signals are left to the event loop of the server, the child takes them as usual */
+        (void) sigemptyset(&set);
+        (void) sigprocmask(SIG_SETMASK, &set, NULL);
+        parent = journaling ? journal.checkpoint : 0;
+        _exit(snapshot_save(&store, snapname, parent) == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+    store_thaw(&store);
+    if (journaling) {
+        (void) pthread_mutex_unlock(&register_lock);
+    }
+    paused = now_ns() - checkpoint_started;
+    if (child == -1) {
+        DEBUG("Couldn't fork checkpoint: %s\n", strerror(errno));
+        return;
+    }
+    checkpoint_child = child;
+    DEBUG("Checkpoint of %zu users started, requests paused for %.3f ms.\n", checkpoint_users, paused / 1e6);
+}
+
+static void checkpoint_end(bool wait) {
+    uint64_t id, parent;
+    pid_t pid;
+    int status;
+
+    if (checkpoint_child == -1) {
+        return;
+    }
+    while ((pid = waitpid(checkpoint_child, &status, wait ? 0 : WNOHANG)) == -1 && errno == EINTR) {
+        continue;
+    }
+    if (pid == 0) {
+        return;
+    }
+    checkpoint_child = -1;
+    if (pid == -1) {
+        DEBUG("Lost checkpoint: %s\n", strerror(errno));
+        return;
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+        DEBUG("Checkpoint failed.\n");
+        return;
+    }
+    /* the journal names the checkpoint, so it is never replayed on top of a database lacking the dropped records */
+    if (journaling && (snapshot_id(snapname, &id, &parent) == -1
+                       || journal_rotate(&journal, checkpoint_position, id) == -1)) {
+        DEBUG("Couldn't rotate journal: %s\n", strerror(errno));
+    }
+    DEBUG("Checkpoint of %zu users written to %s in %.1f ms.\n", checkpoint_users, snapname,
+          (now_ns() - checkpoint_started) / 1e6);
+}
+
+static void arm_timer(int fd, long ms) {
+    struct itimerspec period;
+
+    period.it_interval.tv_sec = ms / 1000;
+    period.it_interval.tv_nsec = (ms % 1000) * 1000000L;
+    period.it_value = period.it_interval;
+    if (timerfd_settime(fd, 0, &period, NULL) == -1) {
+        error_exit("Couldn't arm timer.");
+    }
+}
+
+static void events_init(void) {
+    struct epoll_event event;
+    sigset_t set;
+    int fds[4], n = 0;
+
+    (void) sigemptyset(&set);
+    (void) sigaddset(&set, SIGINT);
+    (void) sigaddset(&set, SIGTERM);
+    (void) sigaddset(&set, SIGUSR1);
+    (void) sigaddset(&set, SIGCHLD);
+    if ((epollfd = epoll_create1(EPOLL_CLOEXEC)) == -1 || (sigfd = signalfd(-1, &set, SFD_CLOEXEC)) == -1
+        || (tickfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC)) == -1
+        || (wakefd = eventfd(0, EFD_CLOEXEC)) == -1
+        || (checkpoint_s > 0 && (checkpointfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC)) == -1)) {
+        error_exit("Couldn't create the event loop.");
+    }
+    arm_timer(tickfd, SESSIONS_TICK_MS);
+    if (checkpointfd != -1) {
+        arm_timer(checkpointfd, checkpoint_s * 1000);
+    }
+    fds[n++] = sigfd;
+    fds[n++] = tickfd;
+    fds[n++] = wakefd;
+    if (checkpointfd != -1) {
+        fds[n++] = checkpointfd;
+    }
+    for (int i = 0; i < n; i++) {
+        event.events = EPOLLIN;
+        event.data.fd = fds[i];
+        if (epoll_ctl(epollfd, EPOLL_CTL_ADD, fds[i], &event) == -1) {
+            error_exit("Couldn't add an event.");
+        }
+    }
+}
+
+static void run_events(void) {
+    struct epoll_event events[4];
+    struct signalfd_siginfo info;
+    uint64_t count;
+    size_t expired;
+    int n;
+
+    while (shared->server_down == -1) {
+        if ((n = epoll_wait(epollfd, events, 4, -1)) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            /* the workers still run, so the server shuts down like on a failed worker */
+            fail("Couldn't wait for events.");
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.fd == sigfd) {
+                if (read(sigfd, &info, sizeof info) != sizeof info) {
+                    continue;
+                }
+                DEBUG("Signal caught: %u\n", info.ssi_signo);
+                if (info.ssi_signo == SIGINT || info.ssi_signo == SIGTERM) {
+                    shutdown_workers();
+                } else if (info.ssi_signo == SIGUSR1) {
+                    checkpoint_begin();
+                } else {
+                    checkpoint_end(false);
+                }
+                continue;
+            }
+            if (read(events[i].data.fd, &count, sizeof count) != sizeof count) {
+                continue;
+            }
+            if (events[i].data.fd == tickfd) {
+                if ((expired = sessions_expire(&sessions)) > 0) {
+                    stats_gauge(&stats->sessions, -(int64_t) expired);
+                }
+                (void) uploads_expire(&uploads, UPLOADS_IDLE * 1000000000ULL);
+                (void) reclaim_collect(&reclaim);
+                recover_slots();
+            } else if (events[i].data.fd == checkpointfd) {
+                if (changes() != checkpoint_changes) {
+                    checkpoint_begin();
+                }
+            } else {
+                /* the verifier found the snapshot corrupt, or a worker failed */
+                shutdown_workers();
+            }
+        }
+    }
+}
+
+static void recover_slots(void) {
+    for (int i = 0; i < NUM_SLOTS; i++) {
+        if (slot_recover(shared, slot_at(shared, i)) == 1) {
+            DEBUG("Recovered slot %d of a dead client\n", i);
         }
     }
+}
+
+static void shutdown_workers(void) {
+    shared->server_down = 1;
+    (void) __atomic_add_fetch(&shared->doorbell, 1, __ATOMIC_SEQ_CST);
+    futex_wake(&shared->doorbell, &shared->doorbell_sleepers);
+    (void) __atomic_add_fetch(&shared->completed, 1, __ATOMIC_SEQ_CST);
+    futex_wake(&shared->completed, &shared->completed_sleepers);
+}
+
+static void *worker(void *arg) {
+    serve((intptr_t) arg);
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    sigset_t blocked;
+    long started;
+
+    progname = argv[0];
+    /* the signals are taken by the event loop, see events_init(), no thread may handle them */
+    if (sigemptyset(&blocked) < 0 || sigaddset(&blocked, SIGINT) < 0 || sigaddset(&blocked, SIGTERM) < 0
+        || sigaddset(&blocked, SIGUSR1) < 0 || sigaddset(&blocked, SIGCHLD) < 0) {
+        error_exit("sigaddset");
+    }
+    (void) pthread_sigmask(SIG_BLOCK, &blocked, NULL);
 
     if (parse_args(argc, argv) == -1) {
         usage();
     }
+    /* the shards of a host each get names of their own */
+    shard_name(shmname, sizeof shmname, SHM_NAME, shard, shards);
+    shard_name(statsname, sizeof statsname, STATS_NAME, shard, shards);
+    shard_name(csvname, sizeof csvname, DATABASE_NAME, shard, shards);
+    shard_name(snapname, sizeof snapname, SNAPSHOT_NAME, shard, shards);
 
+    if (nthreads == -1) {
+        /* with a single thread, every other client waits for the password hash of a LOGIN */
+        nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = nthreads < 2 ? 2 : nthreads > 256 ? 256 : nthreads;
+    }
+    if (store_init(&store) == -1) {
+        error_exit("Failed to allocate the hash index.");
+    }
+    if (reclaim_init(&reclaim, nthreads) == -1) {
+        error_exit("Failed to allocate the reclaimer.");
+    }
+    store.reclaim = &reclaim;
+    if (sessions_init(&sessions, (size_t) session_kib * 1024, session_idle) == -1) {
+        error_exit("Failed to allocate the session table.");
+    }
+    if (uploads_init(&uploads, UPLOADS_MEMORY) == -1) {
+        error_exit("Failed to allocate the upload table.");
+    }
+    DEBUG("Up to %u sessions, expiring after %ld s.\n", sessions.max, session_idle);
     parse_database();
-    /* Open shared memory object SHM_NAME in for reading and writing,
+    open_journal();
+    /* Open shared memory object SHM_NAME, or the one of the shard, in for reading and writing,
      * create it if it does not exist */
-    if ((shmfd = shm_open(SHM_NAME, O_RDWR | O_CREAT, PERMISSION)) == -1) {
+    if ((shmfd = shm_open(shmname, O_RDWR | O_CREAT | O_EXCL, PERMISSION)) == -1) {
         error_exit("Couldn't init shared fragment.");
     }
     /* Extend set size */
-    if (ftruncate(shmfd, sizeof *shared) == -1) {
+    if (ftruncate(shmfd, fragment_size(slot_size)) == -1) {
         error_exit("Couldn't extend shared size.");
     }
     /* Create a new mapping, let the kernel choose the address at which to create the memory  */
-    if ((shared = mmap(NULL, sizeof *shared, PROT_READ | PROT_WRITE, MAP_SHARED, shmfd, 0)) == MAP_FAILED) {
+    if ((shared = mmap(NULL, fragment_size(slot_size), PROT_READ | PROT_WRITE, MAP_SHARED, shmfd, 0)) == MAP_FAILED) {
+        shared = NULL;
         error_exit("Couldn't create mapping.");
     }
-    if (shared == (struct shared_command*) -1) {
-        error_exit("mmap did not init a shared_command.");
-    }
+    /* the new object is zero-filled, clients attach once the slot size is set */
+    shared->slot_size = slot_size;
     shared->server_down = -1;
-    /* Create Semaphores */
-    if ((sem1 = sem_open(SEM1_NAME, O_CREAT | O_EXCL, PERMISSION, 1)) == SEM_FAILED) {
-        error_exit("Couldn't create semaphore 1.");
+    if (spin_us == -1) {
+        /* spinning only pays off if the peer runs on another CPU */
+        spin_us = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? SPIN_US : 0;
+    }
+    shared->spin_us = spin_us;
+    stats_init();
+    events_init();
+
+    /* the workers handle the requests, the main thread runs the event loop */
+    if ((workers = calloc(nthreads, sizeof *workers)) == NULL) {
+        error_exit("Failed to allocate the worker threads.");
     }
-    if ((sem2 = sem_open(SEM2_NAME, O_CREAT | O_EXCL, PERMISSION, 0)) == SEM_FAILED) {
-        error_exit("Couldn't create semaphore 2.");
+    /* once a worker runs, failures shut the server down after joining it */
+    for (started = 0; started < nthreads; started++) {
+        if ((errno = pthread_create(&workers[started], NULL, worker, (void *) (intptr_t) started)) != 0) {
+            fail("Failed to start worker thread.");
+            break;
+        }
     }
-    if ((sem3 = sem_open(SEM3_NAME, O_CREAT | O_EXCL, PERMISSION, 0)) == SEM_FAILED) {
-        error_exit("Couldn't create semaphore 3.");
+    /* serve right away, a corrupt snapshot shuts the server down */
+    if (from_snapshot && !failed && (errno = pthread_create(&verifier, NULL, verify, NULL)) != 0) {
+        fail("Failed to start verifier thread.");
+        from_snapshot = false;
     }
 
-    DEBUG("Server running ...\n");
+    DEBUG("Server running with %ld threads ...\n", started);
 
-    while (shared->server_down == -1) {
-        /* wait for request */
-        while (sem_wait(sem2) == -1) {
-            if (shared->server_down == -1) {
-                continue;
-            }
-            error_exit("Client quit.");
-        }
-        switch (shared->modus) {
-            case LOGIN:
-                switch (shared->command) {
-                    case WRITE:
-                        if ((tmp = search(shared)) == NULL) {
-                            shared->status = WRITE_SECRET_FAILED;
-                        } else if (strcmp(tmp->session_id, shared->session_id) == 0) {
-                            /* Save secret in database */
-                            (void) strncpy(tmp->secret, shared->secret, MAX_DATA);
-                            shared->status = WRITE_SECRET_SUCCESS;
-                        } else {
-                            shared->status = SESSION_FAILED;
-                        }
-                        break;
-                    case READ:
-                        if ((tmp = search(shared)) == NULL) {
-                            shared->status = LOGIN_FAILED;
-                        } else if (strcmp(tmp->session_id, shared->session_id) == 0) {
-                            /* Write secret to fragment */
-                            (void) strncpy(shared->secret, tmp->secret, MAX_DATA);
-                            shared->status = LOGIN_SUCCESS;
-                        } else {
-                            shared->status = SESSION_FAILED;
-                        }
-                        break;
-                    case LOGOUT:
-                        if ((tmp = search(shared)) == NULL) {
-                            shared->status = LOGOUT_FAILED;
-                        } else if (strcmp(tmp->session_id, shared->session_id) == 0) {
-                            /* destroy session id */
-                            memset(tmp->session_id, 0, sizeof tmp->session_id);
-                            shared->status = LOGOUT_SUCCESS;
-                        } else {
-                            shared->status = SESSION_FAILED;
-                        }
-                        break;
-                    default:
-                        if ((tmp = search(shared)) == NULL) {
-                            shared->status = LOGIN_FAILED;
-                        } else {
-                            char *id = rdm_id();
-                            (void) strncpy(tmp->session_id, id, MAX_DATA);
-                            (void) strncpy(shared->session_id, id, MAX_DATA);
-                            shared->status = LOGIN_SUCCESS;
-                        }
-                        break;
-                }
-                /* tell client to continue */
-                if (sem_post(sem3) == -1) {
-                    error_exit("sem_post failed.");
-                }
-                break;
-            case REGISTER:
-                if (prepend(shared) == -1) {
-                    shared->status = REGISTER_FAILED;
-                } else {
-                    shared->status = REGISTER_SUCCESS;
-                }
-                /* tell client to continue */
-                if (sem_post(sem3) == -1) {
-                    error_exit("sem_post failed.");
-                }
-                break;
-            default:
-                break;
+    run_events();
+    for (long i = 0; i < started; i++) {
+        (void) pthread_join(workers[i], NULL);
+    }
+    free(workers);
+    /* a running checkpoint is finished first, it must not race with the final save */
+    checkpoint_end(true);
+    if (from_snapshot) {
+        (void) pthread_join(verifier, NULL);
+        if (__atomic_load_n(&corrupt, __ATOMIC_SEQ_CST)) {
+            /* do not overwrite the database with corrupt data */
+            saved = 1;
+            errno = 0;
+            error_exit("Snapshot %s is corrupt.", dbname);
         }
     }
+    if (__atomic_load_n(&failed, __ATOMIC_SEQ_CST)) {
+        errno = 0;
+        error_exit("%s", failure);
+    }
+    free_resources();
+    DEBUG("Shutting down now.\n");
+    return EXIT_SUCCESS;
 }
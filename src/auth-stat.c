@@ -0,0 +1,262 @@
+/**
+ * @file auth-stat.c
+ * @author Martin Weise <e1429167@student.tuwien.ac.at>
+ * @date 16.10.2026
+ *
+ * @brief Prints the statistics of a running auth-server.
+ * @details Maps the statistics page STATS_NAME read-only and prints one line of gauges and
+ *          rates per interval, like vmstat. The first line covers the time since server start.
+ *          The server of a shard is picked with -k, like on the server.
+ *
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <memory.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include "shared.h"
+
+/** @brief Number of lines after which the header is repeated. */
+#define HEADER_EVERY 20
+
+/** @brief Sum of the counters of all server threads at one point in time. */
+struct sample {
+    uint64_t time;
+    uint64_t commands[STATS_COMMANDS];
+    uint64_t statuses[STATS_STATUSES];
+    uint64_t requests;
+    uint64_t queued;
+    uint64_t latency[STATS_BUCKETS];
+};
+
+/* === Prototypes === */
+
+/**
+ * @brief Prints a nice usage message.
+ */
+static void usage(void);
+/**
+ * @brief Parses the argument vector.
+ * @param argc The argument counter.
+ * @param argv The argument vector.
+ * @return 0 on success, -1 if the arguments are invalid.
+ */
+static int parse_args(int argc, char **argv);
+/**
+ * @brief Sets the terminating flag.
+ * @param sig Signal code.
+ */
+static void signal_handler(int sig);
+/**
+ * @brief Sums up the counter blocks of all server threads.
+ * @param s The sample to fill in.
+ */
+static void take_sample(struct sample *s);
+/**
+ * @brief Estimates a percentile of the latency histogram between two samples.
+ * @details Interpolates linearly inside the power-of-two bucket holding the percentile.
+ * @param now The current sample.
+ * @param last The previous sample.
+ * @param p The percentile in [0,1].
+ * @return The latency in microseconds, 0 if no request was handled.
+ */
+static double percentile(const struct sample *now, const struct sample *last, double p);
+/**
+ * @brief Prints the gauges and the rates between two samples.
+ * @param now The current sample.
+ * @param last The previous sample.
+ */
+static void print_line(const struct sample *now, const struct sample *last);
+/**
+ * @brief The program entry point.
+ * @param argc The argument counter.
+ * @param argv The argument vector.
+ * @return EXIT_SUCCESS on succesful program execution, EXIT_FAILURE otherwise.
+ */
+int main(int argc, char **argv);
+
+/* === Global Variables === */
+
+/** @brief Holds the program name. */
+static char *progname;
+/** @brief Seconds between two lines. @details Set by -i. */
+static long interval = 1;
+/** @brief Number of lines to print, 0 prints until the server quits. @details Set by -c. */
+static long count = 0;
+/** @brief The index of the shard whose server is watched. @details Set by -k. */
+static long shard = 0;
+/** @brief Number of shards. @details Set by -k. */
+static long shards = 1;
+/** @brief The statistics page of the server. */
+static const struct stats *stats;
+/** @brief Set on SIGINT and SIGTERM. */
+static volatile sig_atomic_t terminating = 0;
+
+/* === Implementations === */
+
+static void usage(void) {
+    (void) fprintf(stderr, "USAGE: %s [-i interval] [-c count] [-k shard/shards]\n", progname);
+    exit(EXIT_FAILURE);
+}
+
+static int parse_args(int argc, char **argv) {
+    char *end;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "i:c:k:")) != -1) {
+        switch (opt) {
+            case 'i':
+                interval = strtol(optarg, &end, 10);
+                if (*end != '\0' || interval < 1) {
+                    return -1;
+                }
+                break;
+            case 'c':
+                count = strtol(optarg, &end, 10);
+                if (*end != '\0' || count < 1) {
+                    return -1;
+                }
+                break;
+            case 'k':
+                if (shard_parse(optarg, &shard, &shards) == -1) {
+                    return -1;
+                }
+                break;
+            default:
+                return -1;
+        }
+    }
+    return optind == argc ? 0 : -1;
+}
+
+static void signal_handler(int sig) {
+    terminating = 1;
+}
+
+static void take_sample(struct sample *s) {
+    const struct stats_block *block;
+
+    (void) memset(s, 0, sizeof *s);
+    s->time = now_ns();
+    for (uint32_t t = 0; t < stats->nthreads; t++) {
+        block = &stats->threads[t];
+        for (int i = 0; i < STATS_COMMANDS; i++) {
+            s->commands[i] += __atomic_load_n(&block->commands[i], __ATOMIC_RELAXED);
+        }
+        for (int i = 0; i < STATS_STATUSES; i++) {
+            s->statuses[i] += __atomic_load_n(&block->statuses[i], __ATOMIC_RELAXED);
+        }
+        for (int i = 0; i < STATS_BUCKETS; i++) {
+            s->latency[i] += __atomic_load_n(&block->latency[i], __ATOMIC_RELAXED);
+        }
+        s->requests += __atomic_load_n(&block->requests, __ATOMIC_RELAXED);
+        s->queued += __atomic_load_n(&block->queued, __ATOMIC_RELAXED);
+    }
+}
+
+static double percentile(const struct sample *now, const struct sample *last, double p) {
+    uint64_t total = now->requests - last->requests, seen = 0, n;
+    double rank = p * total;
+
+    if (total == 0) {
+        return 0;
+    }
+    for (int i = 0; i < STATS_BUCKETS; i++) {
+        n = now->latency[i] - last->latency[i];
+        if (n > 0 && seen + n >= rank) {
+            return ((double) (1ULL << i) + (1ULL << i) * (rank - seen) / n) / 1e3;
+        }
+        seen += n;
+    }
+    return (double) (1ULL << STATS_BUCKETS) / 1e3;
+}
+
+static void print_line(const struct sample *now, const struct sample *last) {
+    static const status failures[] = {
+        SESSION_FAILED, LOGIN_FAILED, LOGOUT_FAILED, REGISTER_FAILED, WRITE_SECRET_FAILED, READ_SECRET_FAILED
+    };
+    double secs = (now->time - last->time) / 1e9;
+    uint64_t requests = 0, failed = 0;
+
+    for (int i = 0; i < STATS_COMMANDS; i++) {
+        requests += now->commands[i] - last->commands[i];
+    }
+    for (size_t i = 0; i < sizeof failures / sizeof failures[0]; i++) {
+        failed += now->statuses[failures[i]] - last->statuses[failures[i]];
+    }
+    (void) printf("%8llu %6llu %5llu %8.0f", (unsigned long long) __atomic_load_n(&stats->users, __ATOMIC_RELAXED),
+                  (unsigned long long) __atomic_load_n(&stats->sessions, __ATOMIC_RELAXED),
+                  (unsigned long long) now->queued, requests / secs);
+    for (int i = 0; i < STATS_COMMANDS; i++) {
+        (void) printf(" %7.0f", (now->commands[i] - last->commands[i]) / secs);
+    }
+    (void) printf(" %7.0f %7.1f %7.1f\n", failed / secs, percentile(now, last, 0.5),
+                  percentile(now, last, 0.99));
+}
+
+int main(int argc, char **argv) {
+    const int signals[] = {SIGINT, SIGTERM};
+    struct sigaction s;
+    struct sample samples[2];
+    struct timespec delay;
+    struct stat st;
+    char name[SHARD_NAME_MAX];
+    int fd, lines = 0;
+
+    progname = argv[0];
+    if (parse_args(argc, argv) == -1) {
+        usage();
+    }
+    s.sa_handler = signal_handler;
+    s.sa_flags = 0;
+    (void) sigemptyset(&s.sa_mask);
+    for (int i = 0; i < 2; i++) {
+        (void) sigaction(signals[i], &s, NULL);
+    }
+    shard_name(name, sizeof name, STATS_NAME, shard, shards);
+    if ((fd = shm_open(name, O_RDONLY, 0)) == -1) {
+        (void) fprintf(stderr, "%s: Couldn't access statistics page. Is the server running?\n", progname);
+        exit(EXIT_FAILURE);
+    }
+    if (fstat(fd, &st) == -1 || (size_t) st.st_size < sizeof *stats ||
+        (stats = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        (void) fprintf(stderr, "%s: Couldn't map statistics page: %s\n", progname, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    (void) close(fd);
+    if (sizeof *stats + stats->nthreads * sizeof stats->threads[0] > (size_t) st.st_size) {
+        (void) fprintf(stderr, "%s: Statistics page is truncated.\n", progname);
+        exit(EXIT_FAILURE);
+    }
+
+    /* the first line covers the time since the server started */
+    (void) memset(&samples[1], 0, sizeof samples[1]);
+    samples[1].time = stats->started;
+    take_sample(&samples[0]);
+    for (int i = 0; !terminating; i ^= 1) {
+        if (lines++ % HEADER_EVERY == 0) {
+            (void) printf("%8s %6s %5s %8s %7s %7s %7s %7s %7s %7s %7s %7s\n", "users", "sess",
+                          "queue", "req/s", "reg/s", "login/s", "write/s", "read/s", "logout/s",
+                          "fail/s", "p50us", "p99us");
+        }
+        print_line(&samples[i], &samples[i ^ 1]);
+        (void) fflush(stdout);
+        if ((count > 0 && lines >= count) || __atomic_load_n(&stats->server_down, __ATOMIC_ACQUIRE)) {
+            break;
+        }
+        delay.tv_sec = interval;
+        delay.tv_nsec = 0;
+        (void) nanosleep(&delay, NULL);
+        take_sample(&samples[i ^ 1]);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,741 @@
+/**
+ * @file authclient.c
+ * @author Martin Weise <e1429167@student.tuwien.ac.at>
+ * @date 16.10.2026
+ *
+ * @brief Client library file.
+ *
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include "shared.h"
+#include "authclient.h"
+
+/* === Constants === */
+
+/** @brief Number of times a chunked read starts over if the secret keeps changing. */
+#define READ_RESTARTS (3)
+/** @brief Time in microseconds a reap blocks on one shard while slots of other shards are in flight. */
+#define REAP_POLL_US (1000)
+
+/* === Prototypes === */
+
+/**
+ * @brief Returns the shard owning a user.
+ * @param client The handle.
+ * @param username The username.
+ * @return The index of the shard.
+ */
+static long route(const struct authclient *client, const char *username);
+/**
+ * @brief Makes a shard the current one, its shared fragment is mapped on first use.
+ * @details Maps the fragment anew if the server of the shard was restarted since.
+ * @param client The handle.
+ * @param index The index of the shard.
+ * @return 0 on success, -1 on error.
+ */
+static int select_shard(struct authclient *client, long index);
+/**
+ * @brief Claims a slot of a shard.
+ * @param client The handle.
+ * @param index The index of the shard.
+ * @return 0 on success, -1 on error.
+ */
+static int acquire(struct authclient *client, long index);
+/**
+ * @brief Claims a slot of the current shard.
+ * @details Blocks while all slots are busy, meanwhile submits the open slots of the handle and
+ *          collects its finished ones, which may be the ones everybody waits for.
+ * @param client The handle.
+ * @return The claimed slot, NULL if the server quit or on a signal.
+ */
+static struct slot *claim(struct authclient *client);
+/**
+ * @brief Returns the open slot of a shard for another posted request, claims one if there is none.
+ * @param client The handle.
+ * @param index The index of the shard.
+ * @return The slot on success, NULL on error.
+ */
+static struct authclient_flight *board(struct authclient *client, long index);
+/**
+ * @brief Submits a slot holding posted requests.
+ * @param client The handle.
+ * @param flight The slot.
+ */
+static void launch(struct authclient *client, struct authclient_flight *flight);
+/**
+ * @brief Submits all open slots holding posted requests.
+ * @param client The handle.
+ */
+static void flush(struct authclient *client);
+/**
+ * @brief Moves the responses of finished slots into the ring of the handle and releases the slots.
+ * @param client The handle.
+ * @return The number of released slots.
+ */
+static int harvest(struct authclient *client);
+/**
+ * @brief Collects the chunk a finished slot returned to its READ and asks for the rest through the slot.
+ * @details Starts over if the secret changed between two chunks. Once the READ is done, its status is
+ *          left in the message and the secret in the result of the flight.
+ * @param client The handle.
+ * @param flight The finished slot.
+ * @return 1 if the slot was submitted again, 0 if the READ is done.
+ */
+static int follow(struct authclient *client, struct authclient_flight *flight);
+/**
+ * @brief Submits the claimed slot and waits for the response.
+ * @details Releases the slot on error.
+ * @param client The handle.
+ * @return 0 on success, -1 on error.
+ */
+static int commit(struct authclient *client);
+/**
+ * @brief Releases the claimed slot.
+ * @param client The handle.
+ */
+static void release(struct authclient *client);
+/**
+ * @brief Writes commands into the claimed slot.
+ * @param client The handle.
+ * @param ops The commands.
+ * @param count Number of commands.
+ * @return The number of commands that fit into the slot, starting with the first.
+ */
+static int encode(struct authclient *client, const struct authclient_op *ops, int count);
+/**
+ * @brief Claims a slot of the shard of the session for a single logged-in command.
+ * @param client The handle.
+ * @param command The command.
+ * @return The command of the claimed slot, NULL on error.
+ */
+static struct message *begin_command(struct authclient *client, cmd command);
+
+/* === Implementations === */
+
+int authclient_open(struct authclient *client, long shards) {
+    if (shards < 1 || shards > SHARDS_MAX) {
+        errno = EINVAL;
+        return -1;
+    }
+    (void) memset(client, 0, sizeof *client);
+    client->shards = shards;
+    for (int i = 0; i < SHARDS_MAX; i++) {
+        client->links[i].shmfd = -1;
+    }
+    return 0;
+}
+
+void authclient_close(struct authclient *client) {
+    struct authclient_flight *flight;
+
+    /* Give the claimed slot back to the server */
+    if (client->slot != NULL) {
+        release(client);
+    }
+    /* posted requests that were not reaped are dropped */
+    for (int i = 0; i < client->flying; i++) {
+        flight = &client->flights[i];
+        free(flight->result);
+        (void) slot_release(client->links[flight->shard].shared, flight->slot);
+        client->links[flight->shard].flights--;
+    }
+    for (int i = 0; i < client->ready; i++) {
+        free(client->completions[(client->head + i) % AUTHCLIENT_QUEUE].result);
+    }
+    client->flying = 0;
+    client->ready = 0;
+    client->pending = 0;
+    for (long i = 0; i < client->shards; i++) {
+        /* Close and unmap the shared memory */
+        if (client->links[i].shmfd != -1) {
+            (void) close(client->links[i].shmfd);
+            client->links[i].shmfd = -1;
+        }
+        if (client->links[i].shared != NULL) {
+            (void) munmap(client->links[i].shared, client->links[i].size);
+            client->links[i].shared = NULL;
+        }
+    }
+    client->shared = NULL;
+}
+
+static long route(const struct authclient *client, const char *username) {
+    return shard_of(hash_string(username), client->shards);
+}
+
+static int select_shard(struct authclient *client, long index) {
+    char name[SHARD_NAME_MAX];
+    struct authclient_link *link = &client->links[index];
+    int error;
+
+    /* a restarted server created a fragment of its own, the old one is kept until its slots are reaped */
+    if (link->shared != NULL && link->shared->server_down != -1 && link->flights == 0) {
+        (void) close(link->shmfd);
+        (void) munmap(link->shared, link->size);
+        link->shmfd = -1;
+        link->shared = NULL;
+    }
+    if (link->shared == NULL) {
+        shard_name(name, sizeof name, SHM_NAME, index, client->shards);
+        /* Open shared memory object of the shard for reading and writing */
+        if ((link->shmfd = shm_open(name, O_RDWR, PERMISSION)) == -1) {
+            return -1;
+        }
+        /* Create a new mapping, let the kernel choose the address at which to create the memory  */
+        if ((link->shared = fragment_attach(link->shmfd, &link->size)) == NULL) {
+            error = errno;
+            (void) close(link->shmfd);
+            link->shmfd = -1;
+            errno = error;
+            return -1;
+        }
+    }
+    client->shared = link->shared;
+    return 0;
+}
+
+static int acquire(struct authclient *client, long index) {
+    if (select_shard(client, index) == -1) {
+        return -1;
+    }
+    /* wait for server to allow client to send request */
+    if (client->shared->server_down != -1 || (client->slot = claim(client)) == NULL) {
+        errno = EPIPE;
+        return -1;
+    }
+    return 0;
+}
+
+static struct slot *claim(struct authclient *client) {
+    struct shared_fragment *shared = client->shared;
+    struct slot *slot;
+    uint32_t released;
+
+    while (shared->server_down == -1) {
+        released = __atomic_load_n(&shared->released, __ATOMIC_SEQ_CST);
+        if ((slot = slot_claim(shared)) != NULL) {
+            return slot;
+        }
+        /* slots held by the handle only finish once submitted, and only free up once collected */
+        flush(client);
+        if (harvest(client) > 0) {
+            continue;
+        }
+        if (futex_await(&shared->released, released, &shared->released_sleepers, shared->spin_us) == -1) {
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+static struct authclient_flight *board(struct authclient *client, long index) {
+    struct authclient_flight *flight;
+    struct slot *slot;
+    size_t size;
+
+    for (int i = 0; i < client->flying; i++) {
+        flight = &client->flights[i];
+        if (flight->shard == index && !flight->submitted) {
+            return flight;
+        }
+    }
+    if (client->flying == AUTHCLIENT_FLIGHTS && harvest(client) == 0) {
+        errno = EAGAIN;
+        return NULL;
+    }
+    if (select_shard(client, index) == -1) {
+        return NULL;
+    }
+    if (client->shared->server_down != -1 || (slot = claim(client)) == NULL) {
+        errno = EPIPE;
+        return NULL;
+    }
+    /* claim() may have submitted all open slots and collected finished ones */
+    flight = &client->flights[client->flying++];
+    flight->shard = index;
+    flight->slot = slot;
+    flight->count = 0;
+    flight->submitted = 0;
+    flight->reading = 0;
+    flight->result = NULL;
+    flight->received = 0;
+    flight->restarts = 0;
+    /* reserve the messages up front, so that a slot always has room for the strings of its requests */
+    size = client->shared->slot_size;
+    flight->capacity = (size - sizeof *slot) / (sizeof slot->messages[0] + 2 * MAX_DATA);
+    if (flight->capacity > BATCH_MAX) {
+        flight->capacity = BATCH_MAX;
+    }
+    slot_begin(slot, flight->capacity);
+    client->links[index].flights++;
+    return flight;
+}
+
+static void launch(struct authclient *client, struct authclient_flight *flight) {
+    flight->slot->count = flight->count;
+    flight->submitted = 1;
+    slot_post(client->links[flight->shard].shared, flight->slot);
+}
+
+static void flush(struct authclient *client) {
+    for (int i = 0; i < client->flying; i++) {
+        if (!client->flights[i].submitted) {
+            launch(client, &client->flights[i]);
+        }
+    }
+}
+
+static int harvest(struct authclient *client) {
+    struct authclient_flight *flight;
+    struct authclient_completion *completion;
+    struct shared_fragment *shared;
+    bool done;
+    int released = 0, i = 0;
+
+    while (i < client->flying) {
+        flight = &client->flights[i];
+        shared = client->links[flight->shard].shared;
+        done = __atomic_load_n(&flight->slot->state, __ATOMIC_ACQUIRE) == SLOT_DONE;
+        if (!flight->submitted || (!done && shared->server_down == -1)) {
+            i++;
+            continue;
+        }
+        if (done && flight->reading && follow(client, flight) == 1) {
+            i++;
+            continue;
+        }
+        /* the ring has room, posting stops at AUTHCLIENT_QUEUE requests not reaped yet */
+        for (uint32_t j = 0; j < flight->count; j++) {
+            completion = &client->completions[(client->head + client->ready++) % AUTHCLIENT_QUEUE];
+            completion->user_data = flight->user_data[j];
+            completion->status = done ? flight->slot->messages[j].status : STATUS_NONE;
+            completion->result = NULL;
+            (void) memset(completion->session_id, 0, SIZE_SESS_ID);
+            if (done && completion->status == LOGIN_SUCCESS && !flight->reading) {
+                (void) memcpy(completion->session_id, flight->slot->messages[j].session_id, SIZE_SESS_ID);
+            }
+        }
+        /* a READ is alone in its slot */
+        if (flight->reading && done) {
+            completion->result = flight->result;
+        } else {
+            free(flight->result);
+        }
+        (void) slot_release(shared, flight->slot);
+        client->links[flight->shard].flights--;
+        client->flying--;
+        (void) memmove(flight, flight + 1, (client->flying - i) * sizeof *flight);
+        released++;
+    }
+    return released;
+}
+
+static int follow(struct authclient *client, struct authclient_flight *flight) {
+    struct shared_fragment *shared = client->links[flight->shard].shared;
+    struct message *message = &flight->slot->messages[0];
+    status response = message->status;
+    char *chunk = NULL;
+    size_t len = 0;
+
+    if (response == READ_SECRET_FAILED && flight->received > 0 && flight->restarts < READ_RESTARTS) {
+        /* the secret changed between two chunks, start over */
+        flight->restarts++;
+        flight->received = 0;
+    } else {
+        if (response == LOGIN_SUCCESS
+            && ((chunk = slot_get(flight->slot, shared->slot_size, &message->secret, &len)) == NULL
+                || (flight->received > 0 && message->total != flight->total)
+                || len > message->total - flight->received || (len == 0 && flight->received < message->total))) {
+            response = READ_SECRET_FAILED;
+        }
+        if (response == LOGIN_SUCCESS && flight->received == 0) {
+            flight->total = message->total;
+            flight->generation = message->generation;
+            free(flight->result);
+            if ((flight->result = malloc(flight->total + 1)) == NULL) {
+                response = STATUS_NONE;
+            }
+        }
+        if (response == LOGIN_SUCCESS) {
+            (void) memcpy(flight->result + flight->received, chunk, len);
+            flight->received += len;
+        }
+        if (response != LOGIN_SUCCESS || flight->received == flight->total) {
+            if (response == LOGIN_SUCCESS) {
+                flight->result[flight->total] = '\0';
+            } else {
+                free(flight->result);
+                flight->result = NULL;
+            }
+            message->status = response;
+            return 0;
+        }
+    }
+    /* the slot is still claimed by the handle, the next chunk goes through it */
+    __atomic_store_n(&flight->slot->state, SLOT_CLAIMED, __ATOMIC_RELAXED);
+    slot_begin(flight->slot, 1);
+    message->modus = LOGIN;
+    message->command = READ;
+    (void) memcpy(message->session_id, flight->session_id, SIZE_SESS_ID);
+    message->position = flight->received;
+    message->generation = flight->received > 0 ? flight->generation : 0;
+    slot_post(shared, flight->slot);
+    return 1;
+}
+
+static int commit(struct authclient *client) {
+    /* tell server to continue and wait for response */
+    if (slot_submit(client->shared, client->slot) == -1) {
+        release(client);
+        errno = EPIPE;
+        return -1;
+    }
+    return 0;
+}
+
+static void release(struct authclient *client) {
+    struct slot *tmp = client->slot;
+
+    client->slot = NULL;
+    (void) slot_release(client->shared, tmp);
+}
+
+static int encode(struct authclient *client, const struct authclient_op *ops, int count) {
+    struct slot *slot = client->slot;
+    struct message *message;
+    size_t size = client->shared->slot_size;
+    bool logged_in = false;
+
+    slot_begin(slot, count);
+    for (int i = 0; i < count; i++) {
+        message = &slot->messages[i];
+        message->modus = ops[i].modus;
+        message->command = ops[i].command;
+        if (ops[i].command == COMMAND_NONE) {
+            logged_in = logged_in || ops[i].modus == LOGIN;
+            if (slot_put(slot, size, &message->username, ops[i].username, strlen(ops[i].username)) == -1
+                || slot_put(slot, size, &message->password, ops[i].password, strlen(ops[i].password)) == -1) {
+                return i;
+            }
+            continue;
+        }
+        /* commands after a LOGIN of the same slot inherit its session on the server */
+        if (!logged_in) {
+            (void) memcpy(message->session_id, client->session_id, SIZE_SESS_ID);
+        }
+        if (ops[i].command == WRITE && ops[i].secret != NULL
+            && slot_put(slot, size, &message->secret, ops[i].secret, strlen(ops[i].secret)) == -1) {
+            return i;
+        }
+        message->total = message->secret.length;
+    }
+    return count;
+}
+
+static struct message *begin_command(struct authclient *client, cmd command) {
+    struct authclient_op op = { LOGIN, command, NULL, NULL, NULL, STATUS_NONE, NULL };
+
+    if (acquire(client, client->session_shard) == -1) {
+        return NULL;
+    }
+    /* a logged-in command without a secret always fits */
+    (void) encode(client, &op, 1);
+    return &client->slot->messages[0];
+}
+
+status authclient_register(struct authclient *client, const char *username, const char *password) {
+    struct authclient_op op = { REGISTER, COMMAND_NONE, username, password, NULL, STATUS_NONE, NULL };
+
+    return authclient_submit(client, &op, 1) == -1 ? STATUS_NONE : op.status;
+}
+
+status authclient_login(struct authclient *client, const char *username, const char *password) {
+    struct authclient_op op = { LOGIN, COMMAND_NONE, username, password, NULL, STATUS_NONE, NULL };
+
+    return authclient_submit(client, &op, 1) == -1 ? STATUS_NONE : op.status;
+}
+
+status authclient_logout(struct authclient *client) {
+    struct authclient_op op = { LOGIN, LOGOUT, NULL, NULL, NULL, STATUS_NONE, NULL };
+
+    return authclient_submit(client, &op, 1) == -1 ? STATUS_NONE : op.status;
+}
+
+status authclient_write(struct authclient *client, const char *secret, size_t len) {
+    struct message *message;
+    size_t room, chunk;
+    status response = WRITE_SECRET_FAILED;
+
+    if (len > SECRET_MAX) {
+        return WRITE_SECRET_FAILED;
+    }
+    if (select_shard(client, client->session_shard) == -1) {
+        return STATUS_NONE;
+    }
+    /* the largest chunk that fits into a slot of its own */
+    room = client->shared->slot_size - sizeof *client->slot - sizeof client->slot->messages[0] - 1;
+    for (size_t position = 0; position == 0 || position < len; position += chunk) {
+        chunk = len - position < room ? len - position : room;
+        if ((message = begin_command(client, WRITE)) == NULL) {
+            return STATUS_NONE;
+        }
+        (void) slot_put(client->slot, client->shared->slot_size, &message->secret, secret + position, chunk);
+        message->position = position;
+        message->total = len;
+        if (commit(client) == -1) {
+            return STATUS_NONE;
+        }
+        response = message->status;
+        release(client);
+        if (response != WRITE_SECRET_SUCCESS) {
+            break;
+        }
+    }
+    return response;
+}
+
+status authclient_read(struct authclient *client, char **secret) {
+    struct message *message;
+    char *chunk = NULL;
+    uint32_t position = 0, generation = 0, total = 0;
+    int restarts = 0;
+    status response;
+    size_t len = 0;
+
+    *secret = NULL;
+    do {
+        if ((message = begin_command(client, READ)) == NULL) {
+            free(*secret);
+            *secret = NULL;
+            return STATUS_NONE;
+        }
+        message->position = position;
+        message->generation = generation;
+        if (commit(client) == -1) {
+            free(*secret);
+            *secret = NULL;
+            return STATUS_NONE;
+        }
+        response = message->status;
+        if (response == READ_SECRET_FAILED && position > 0 && restarts++ < READ_RESTARTS) {
+            /* the secret changed between two chunks, start over */
+            release(client);
+            position = 0;
+            generation = 0;
+            continue;
+        }
+        if (response == LOGIN_SUCCESS
+            && ((chunk = slot_get(client->slot, client->shared->slot_size, &message->secret, &len)) == NULL
+                || (position > 0 && message->total != total) || len > message->total - position
+                || (len == 0 && position < message->total))) {
+            response = READ_SECRET_FAILED;
+        }
+        if (response != LOGIN_SUCCESS) {
+            release(client);
+            free(*secret);
+            *secret = NULL;
+            return response;
+        }
+        if (position == 0) {
+            total = message->total;
+            generation = message->generation;
+            free(*secret);
+            if ((*secret = malloc(total + 1)) == NULL) {
+                release(client);
+                errno = ENOMEM;
+                return STATUS_NONE;
+            }
+        }
+        (void) memcpy(*secret + position, chunk, len);
+        position += len;
+        release(client);
+    } while (position < total);
+    (*secret)[total] = '\0';
+    return LOGIN_SUCCESS;
+}
+
+int authclient_submit(struct authclient *client, struct authclient_op *ops, int count) {
+    struct message *result;
+    const char *secret;
+    size_t len;
+    int n, run;
+    long target, next, logged;
+    bool partial;
+
+    for (int i = 0; i < count; i++) {
+        ops[i].status = STATUS_NONE;
+        ops[i].result = NULL;
+        if (ops[i].command == COMMAND_NONE
+            && (strlen(ops[i].username) >= MAX_DATA || strlen(ops[i].password) >= MAX_DATA)) {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+    while (count > 0) {
+        /* a round trip goes to a single shard */
+        target = ops[0].command == COMMAND_NONE ? route(client, ops[0].username) : client->session_shard;
+        logged = client->session_shard;
+        for (run = 0; run < count; run++) {
+            next = ops[run].command == COMMAND_NONE ? route(client, ops[run].username) : logged;
+            if (next != target) {
+                break;
+            }
+            if (ops[run].modus == LOGIN && ops[run].command == COMMAND_NONE) {
+                logged = next;
+            }
+        }
+        if (acquire(client, target) == -1) {
+            return -1;
+        }
+        if ((n = encode(client, ops, run)) == 0 && ops[0].command == WRITE) {
+            /* a secret exceeding the slot is sent in chunks */
+            release(client);
+            if ((ops[0].status = authclient_write(client, ops[0].secret, strlen(ops[0].secret))) == STATUS_NONE) {
+                return -1;
+            }
+            ops++;
+            count--;
+            continue;
+        }
+        /* send as many commands as fit, the rest follows in the next round trip */
+        if (n < run && (n == 0 || encode(client, ops, n) < n)) {
+            release(client);
+            errno = EMSGSIZE;
+            return -1;
+        }
+        if (commit(client) == -1) {
+            return -1;
+        }
+        /* the server stops after a READ that returned only part of the secret */
+        if (client->slot->count < (uint32_t) n) {
+            n = client->slot->count;
+        }
+        partial = n > 0 && MESSAGE_PARTIAL(&client->slot->messages[n - 1]);
+        for (int i = 0; i < n - partial; i++) {
+            result = &client->slot->messages[i];
+            ops[i].status = result->status;
+            /* the following commands go to the shard of the login, even if it failed */
+            if (result->modus == LOGIN && result->command == COMMAND_NONE) {
+                client->session_shard = target;
+                if (result->status == LOGIN_SUCCESS) {
+                    (void) memcpy(client->session_id, result->session_id, SIZE_SESS_ID);
+                }
+            }
+            if (result->command == READ && result->status == LOGIN_SUCCESS) {
+                if ((secret = slot_get(client->slot, client->shared->slot_size, &result->secret, &len)) == NULL) {
+                    secret = "";
+                    len = 0;
+                }
+                if ((ops[i].result = malloc(len + 1)) == NULL) {
+                    release(client);
+                    errno = ENOMEM;
+                    return -1;
+                }
+                (void) memcpy(ops[i].result, secret, len);
+                ops[i].result[len] = '\0';
+            }
+        }
+        release(client);
+        if (partial && (ops[n - 1].status = authclient_read(client, &ops[n - 1].result)) == STATUS_NONE) {
+            return -1;
+        }
+        ops += n;
+        count -= n;
+    }
+    return 0;
+}
+
+int authclient_post(struct authclient *client, const struct authclient_op *op, uint64_t user_data) {
+    struct authclient_flight *flight;
+    struct message *message;
+    size_t size;
+    bool reading = op->modus == LOGIN && op->command == READ;
+
+    if ((op->modus != REGISTER && op->modus != LOGIN) || (op->command != COMMAND_NONE && !reading)
+        || (reading && op->session_id == NULL) || strlen(op->username) >= MAX_DATA
+        || (!reading && strlen(op->password) >= MAX_DATA)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (client->pending == AUTHCLIENT_QUEUE) {
+        errno = EAGAIN;
+        return -1;
+    }
+    if ((flight = board(client, route(client, op->username))) == NULL) {
+        return -1;
+    }
+    /* a READ takes a slot of its own, so its secret has the room of the whole slot */
+    if (reading && flight->count > 0) {
+        launch(client, flight);
+        if ((flight = board(client, route(client, op->username))) == NULL) {
+            return -1;
+        }
+    }
+    size = client->links[flight->shard].shared->slot_size;
+    message = &flight->slot->messages[flight->count];
+    message->modus = op->modus;
+    message->command = op->command;
+    if (reading) {
+        (void) memcpy(message->session_id, op->session_id, SIZE_SESS_ID);
+        (void) memcpy(flight->session_id, op->session_id, SIZE_SESS_ID);
+        flight->reading = 1;
+    } else {
+        (void) slot_put(flight->slot, size, &message->username, op->username, strlen(op->username));
+        (void) slot_put(flight->slot, size, &message->password, op->password, strlen(op->password));
+    }
+    flight->user_data[flight->count++] = user_data;
+    client->pending++;
+    if (flight->count == flight->capacity || reading) {
+        launch(client, flight);
+    }
+    return 0;
+}
+
+int authclient_reap(struct authclient *client, struct authclient_completion *completions, int max, int wait) {
+    struct shared_fragment *shared;
+    uint32_t completed[SHARDS_MAX];
+    bool spread;
+    long shard;
+    int n;
+
+    flush(client);
+    for (;;) {
+        /* read the counters before collecting, so no slot finishing afterwards is missed */
+        for (int i = 0; i < client->flying; i++) {
+            shared = client->links[client->flights[i].shard].shared;
+            completed[client->flights[i].shard] = __atomic_load_n(&shared->completed, __ATOMIC_SEQ_CST);
+        }
+        (void) harvest(client);
+        if (client->ready > 0 || !wait || client->flying == 0) {
+            break;
+        }
+        /* block on the shard of the oldest slot, but only briefly if other shards may finish first */
+        shard = client->flights[0].shard;
+        shared = client->links[shard].shared;
+        spread = false;
+        for (int i = 1; i < client->flying; i++) {
+            spread = spread || client->flights[i].shard != shard;
+        }
+        if (futex_await_for(&shared->completed, completed[shard], &shared->completed_sleepers, shared->spin_us,
+                            spread ? REAP_POLL_US : WAIT_TIMEOUT_MS * 1000) == -1) {
+            errno = EINTR;
+            return -1;
+        }
+    }
+    for (n = 0; n < max && client->ready > 0; n++) {
+        completions[n] = client->completions[client->head];
+        client->head = (client->head + 1) % AUTHCLIENT_QUEUE;
+        client->ready--;
+        client->pending--;
+    }
+    return n;
+}
@@ -0,0 +1,244 @@
+/**
+ * @file authclient.h
+ * @author Martin Weise <e1429167@student.tuwien.ac.at>
+ * @date 16.10.2026
+ *
+ * @brief Client library header file.
+ * @details Talks to a running auth-server, or to the shards of a sharded deployment, without ever
+ *          terminating the process. A handle keeps the shared fragments it attached to mapped until
+ *          it is closed, so a service pays for attaching only once. Every call claims a slot, waits
+ *          for the response and gives the slot back, so a handle holds no slot between calls.
+ *
+ *          The calls return the status code of the server. STATUS_NONE reports a local error and
+ *          sets errno: ENOENT if no server runs, EPIPE if the server quit, EINVAL if a username or
+ *          password is too long, EMSGSIZE if a command does not fit into a slot. A handle must not
+ *          be used by several threads at once.
+ *
+ *          Besides the blocking calls, a handle can have many REGISTER, LOGIN and READ requests in
+ *          flight: authclient_post() packs them into slots and submits full slots right away, without
+ *          waiting. authclient_reap() submits the rest and returns the responses in the order the
+ *          slots finish, tagged with the user data given on posting. The completion of a LOGIN holds
+ *          its session id, a posted READ names it and gets a slot of its own, through which a secret
+ *          exceeding the slot is read in chunks. WRITE and LOGOUT cannot be posted, the room a slot
+ *          reserves per request does not hold a secret. They go through authclient_submit() instead.
+ *
+ *          Include shared.h first and link with libauthclient.a.
+ *
+ **/
+
+/* === Constants === */
+
+/** @brief Maximum number of slots a handle keeps in flight, the others stay free for other clients. */
+#define AUTHCLIENT_FLIGHTS (NUM_SLOTS / 2)
+/** @brief Maximum number of posted requests of a handle that were not reaped yet. */
+#define AUTHCLIENT_QUEUE (AUTHCLIENT_FLIGHTS * BATCH_MAX)
+
+/* === Structs === */
+
+/**
+ * @brief Defines the connection to a shard.
+ */
+struct authclient_link {
+    /** @brief The shared memory file descriptor, -1 until the handle first talks to the shard. */
+    int shmfd;
+    /** @brief Size of the mapping of the shared fragment in bytes. */
+    size_t size;
+    /** @brief The shared fragment of the shard. */
+    struct shared_fragment *shared;
+    /** @brief Number of slots in flight, the fragment stays mapped until they are reaped. */
+    int flights;
+};
+
+/**
+ * @brief Defines a command of a batch and its outcome.
+ */
+struct authclient_op {
+    /** @brief The operating mode, REGISTER or LOGIN. */
+    mode modus;
+    /** @brief The command of a logged-in user, COMMAND_NONE on REGISTER and LOGIN. */
+    cmd command;
+    /** @brief The username of REGISTER and LOGIN. */
+    const char *username;
+    /** @brief The password of REGISTER and LOGIN. */
+    const char *password;
+    /** @brief The secret of WRITE. */
+    const char *secret;
+    /** @brief Receives the status code of the response, STATUS_NONE if the command was not executed. */
+    status status;
+    /** @brief Receives the secret returned on READ, to be freed by the caller. @details NULL otherwise. */
+    char *result;
+    /** @brief The session id of a posted READ, SIZE_SESS_ID characters. */
+    const char *session_id;
+};
+
+/**
+ * @brief Defines the response to a posted request.
+ */
+struct authclient_completion {
+    /** @brief The user data given on posting. */
+    uint64_t user_data;
+    /** @brief The status code of the response, STATUS_NONE if the server quit meanwhile. */
+    status status;
+    /** @brief The session id of a LOGIN that succeeded. */
+    char session_id[SIZE_SESS_ID];
+    /** @brief The secret of a READ that succeeded, to be freed by the caller. @details NULL otherwise. */
+    char *result;
+};
+
+/**
+ * @brief Defines a slot holding posted requests.
+ */
+struct authclient_flight {
+    /** @brief The index of the shard. */
+    long shard;
+    /** @brief The claimed slot. */
+    struct slot *slot;
+    /** @brief Number of requests the slot has room for. */
+    uint32_t capacity;
+    /** @brief Number of requests in the slot. */
+    uint32_t count;
+    /** @brief Whether the slot was submitted, requests are only added before. */
+    int submitted;
+    /** @brief The user data of the requests. */
+    uint64_t user_data[BATCH_MAX];
+    /** @brief Whether the slot holds a single READ, which is asked again until the whole secret arrived. */
+    int reading;
+    /** @brief The session id of the READ. */
+    char session_id[SIZE_SESS_ID];
+    /** @brief The secret read so far. */
+    char *result;
+    /** @brief Number of bytes of the secret read so far. */
+    uint32_t received;
+    /** @brief Length of the secret. */
+    uint32_t total;
+    /** @brief Generation of the secret the first chunk came from. */
+    uint32_t generation;
+    /** @brief Number of times the READ started over as the secret changed. */
+    int restarts;
+};
+
+/**
+ * @brief Defines a handle of the client library.
+ */
+struct authclient {
+    /** @brief Number of shards the users are spread over. */
+    long shards;
+    /** @brief The connections to the shards. */
+    struct authclient_link links[SHARDS_MAX];
+    /** @brief The shared fragment of the current request. */
+    struct shared_fragment *shared;
+    /** @brief The claimed slot, NULL between two calls. */
+    struct slot *slot;
+    /** @brief The shard of the last login, logged-in commands are sent there. */
+    long session_shard;
+    /** @brief The session id of the last successful login. */
+    char session_id[SIZE_SESS_ID];
+    /** @brief The slots holding posted requests, oldest first. */
+    struct authclient_flight flights[AUTHCLIENT_FLIGHTS];
+    /** @brief Number of slots holding posted requests. */
+    int flying;
+    /** @brief Ring of responses of finished slots, until they are reaped. */
+    struct authclient_completion completions[AUTHCLIENT_QUEUE];
+    /** @brief Index of the oldest response in the ring. */
+    int head;
+    /** @brief Number of responses in the ring. */
+    int ready;
+    /** @brief Number of posted requests that were not reaped yet. */
+    int pending;
+};
+
+/* === Prototypes === */
+
+/**
+ * @brief Opens a handle.
+ * @details Attaches to the shards on first use, so a batch only needs the shards of its users.
+ * @param client The handle.
+ * @param shards Number of shards, 1 without sharding.
+ * @return 0 on success, -1 if the number of shards is invalid.
+ */
+int authclient_open(struct authclient *client, long shards);
+/**
+ * @brief Closes a handle and unmaps its shared fragments.
+ * @details Gives back a slot claimed by a call that was interrupted, e.g. by exit().
+ * @param client The handle.
+ */
+void authclient_close(struct authclient *client);
+/**
+ * @brief Registers a new user.
+ * @param client The handle.
+ * @param username The username.
+ * @param password The password.
+ * @return REGISTER_SUCCESS or REGISTER_FAILED, STATUS_NONE on error.
+ */
+status authclient_register(struct authclient *client, const char *username, const char *password);
+/**
+ * @brief Logs in a user, later commands of the handle run in the new session.
+ * @param client The handle.
+ * @param username The username.
+ * @param password The password.
+ * @return LOGIN_SUCCESS or LOGIN_FAILED, STATUS_NONE on error.
+ */
+status authclient_login(struct authclient *client, const char *username, const char *password);
+/**
+ * @brief Writes the secret of the logged-in user, in chunks if it exceeds a slot.
+ * @details Each chunk waits for the server to take the previous one, so a transfer occupies a
+ *          single slot at a time.
+ * @param client The handle.
+ * @param secret The secret.
+ * @param len Length of the secret.
+ * @return WRITE_SECRET_SUCCESS, WRITE_SECRET_FAILED or SESSION_FAILED, STATUS_NONE on error.
+ */
+status authclient_write(struct authclient *client, const char *secret, size_t len);
+/**
+ * @brief Reads the secret of the logged-in user, in chunks if it exceeds a slot.
+ * @details Starts over if the secret changes between two chunks.
+ * @param client The handle.
+ * @param secret Receives the secret on LOGIN_SUCCESS, to be freed by the caller.
+ * @return LOGIN_SUCCESS, READ_SECRET_FAILED or SESSION_FAILED, STATUS_NONE on error.
+ */
+status authclient_read(struct authclient *client, char **secret);
+/**
+ * @brief Logs out the logged-in user.
+ * @param client The handle.
+ * @return LOGOUT_SUCCESS or SESSION_FAILED, STATUS_NONE on error.
+ */
+status authclient_logout(struct authclient *client);
+/**
+ * @brief Executes a batch of commands, as many per round trip as fit into a slot.
+ * @details Needs several round trips if the commands or their responses do not fit into one slot,
+ *          or if they go to different shards. REGISTER and LOGIN go to the shard of their user,
+ *          logged-in commands to the shard of the last LOGIN before them, and run in its session
+ *          once it succeeded.
+ * @param client The handle.
+ * @param ops The commands, receive their outcome.
+ * @param count Number of commands.
+ * @return 0 on success, -1 on error. The commands after the failed one keep STATUS_NONE.
+ */
+int authclient_submit(struct authclient *client, struct authclient_op *ops, int count);
+/**
+ * @brief Posts a REGISTER, LOGIN or READ request without waiting for the response.
+ * @details The request joins the open slot of its shard, a full slot is submitted right away. Blocks
+ *          only while all slots of the shard are busy. A LOGIN does not change the session of the
+ *          handle. A READ runs in the given session, e.g. of a posted LOGIN, and goes to the shard of
+ *          the given username in a slot of its own. The strings need not outlive the call.
+ * @param client The handle.
+ * @param op The request, its status and result are not used.
+ * @param user_data Returned with the response.
+ * @return 0 on success, -1 on error. errno is EAGAIN if AUTHCLIENT_QUEUE requests are not reaped yet,
+ *         EINVAL if the request is WRITE or LOGOUT, a READ without session id or a username or
+ *         password is too long.
+ */
+int authclient_post(struct authclient *client, const struct authclient_op *op, uint64_t user_data);
+/**
+ * @brief Submits the posted requests and returns the responses of finished slots.
+ * @details The requests of a slot finish together, the slots in any order. A READ finishes once its
+ *          last chunk arrived, or with STATUS_NONE if its result cannot be allocated. Waiting blocks on
+ *          the shard of the oldest slot in flight, for at most a millisecond if slots of other shards
+ *          are in flight too, and collects the finished slots of all shards.
+ * @param client The handle.
+ * @param completions Receives the responses.
+ * @param max Maximum number of responses to return.
+ * @param wait Whether to wait for a response if none is ready.
+ * @return The number of responses, 0 if none is ready or nothing is in flight, -1 if interrupted.
+ */
+int authclient_reap(struct authclient *client, struct authclient_completion *completions, int max, int wait);
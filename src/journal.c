@@ -0,0 +1,486 @@
+/**
+ * @file journal.c
+ * @author Martin Weise <e1429167@student.tuwien.ac.at>
+ * @date 16.10.2026
+ *
+ * @brief Write-ahead journal.
+ *
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "shared.h"
+#include "store.h"
+#include "journal.h"
+
+/* === Constants === */
+
+/** @brief Initial size of the append buffer in bytes. */
+#define JOURNAL_BUFFER (1 << 16)
+/** @brief Size of the buffer used to copy records on rotation in bytes. */
+#define JOURNAL_COPY (1 << 16)
+
+/* === Prototypes === */
+
+/**
+ * @brief Writes a buffer completely.
+ * @param fd The file descriptor.
+ * @param data The buffer.
+ * @param len Length of the buffer in bytes.
+ * @return 0 on success, errno otherwise.
+ */
+static int write_all(int fd, const char *data, size_t len);
+/**
+ * @brief Writes the file header of an empty journal.
+ * @param fd The file descriptor.
+ * @param checkpoint The id of the checkpoint the records follow, 0 if none.
+ * @return 0 on success, errno otherwise.
+ */
+static int write_header(int fd, uint64_t checkpoint);
+/**
+ * @brief Replaces the journal by a copy holding only the records behind a position.
+ * @details Called by the writer thread once all records up to the position are written.
+ * @param journal The journal.
+ * @param position The position.
+ * @return 0 on success, errno otherwise.
+ */
+static int rotate(struct journal *journal, uint64_t position);
+/**
+ * @brief Applies a record to the store.
+ * @param store The store.
+ * @param payload The payload of the record.
+ * @param size Size of the payload in bytes.
+ * @return 1 if the record was applied, 0 if it is invalid, -1 on error.
+ */
+static int apply(struct store *store, const char *payload, uint32_t size);
+/**
+ * @brief Entry point of the writer thread.
+ * @details Takes over all buffered records at once and writes them with a single system call,
+ *          while new records go to the other buffer. A group is synced according to the policy.
+ * @param arg The journal.
+ * @return Always NULL.
+ */
+static void *writer(void *arg);
+
+/* === Implementations === */
+
+static int write_all(int fd, const char *data, size_t len) {
+    ssize_t n;
+
+    while (len > 0) {
+        if ((n = write(fd, data, len)) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno;
+        }
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int write_header(int fd, uint64_t checkpoint) {
+    char header[JOURNAL_HEADER];
+    uint32_t version = JOURNAL_VERSION;
+
+    (void) memset(header, 0, sizeof header);
+    (void) memcpy(header, JOURNAL_MAGIC, 8);
+    (void) memcpy(header + 8, &version, sizeof version);
+    (void) memcpy(header + 16, &checkpoint, sizeof checkpoint);
+    return write_all(fd, header, sizeof header);
+}
+
+static int rotate(struct journal *journal, uint64_t position) {
+    char tmp[PATH_MAX], buffer[JOURNAL_COPY];
+    off_t offset = journal->base + position;
+    ssize_t n = 1;
+    int fd, error;
+
+    (void) snprintf(tmp, sizeof tmp, "%s.tmp", journal->path);
+    if ((fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC | O_APPEND, 0644)) == -1) {
+        return errno;
+    }
+    error = write_header(fd, journal->rotate_checkpoint);
+    while (error == 0 && n > 0) {
+        if ((n = pread(journal->fd, buffer, sizeof buffer, offset)) == -1) {
+            error = errno == EINTR ? 0 : errno;
+        } else {
+            error = write_all(fd, buffer, n);
+            offset += n;
+        }
+    }
+    if (error == 0 && (fdatasync(fd) == -1 || rename(tmp, journal->path) == -1)) {
+        error = errno;
+    }
+    if (error != 0) {
+        (void) close(fd);
+        (void) unlink(tmp);
+        return error;
+    }
+    (void) close(journal->fd);
+    journal->fd = fd;
+    journal->base = JOURNAL_HEADER - (int64_t) position;
+    return 0;
+}
+
+static int apply(struct store *store, const char *payload, uint32_t size) {
+    struct entry *entry;
+    const char *username, *value;
+    uint16_t ulen;
+    uint32_t vlen;
+
+    (void) memcpy(&ulen, payload + 2, sizeof ulen);
+    (void) memcpy(&vlen, payload + 4, sizeof vlen);
+    username = payload + JOURNAL_PAYLOAD;
+    value = username + ulen + 1;
+    if ((uint64_t) JOURNAL_PAYLOAD + ulen + vlen + 2 != size || username[ulen] != '\0' || value[vlen] != '\0') {
+        return 0;
+    }
+    switch (payload[0]) {
+        case JOURNAL_REGISTER:
+            /* the user may be part of the database already */
+            if (store_add(store, username, value, "") == NULL && errno != EEXIST) {
+                return -1;
+            }
+            return 1;
+        case JOURNAL_WRITE:
+            if ((entry = store_find(store, username)) != NULL && store_set_secret(store, entry, value) == -1) {
+                return -1;
+            }
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+int journal_replay(const char *path, struct store *store, uint64_t id, uint64_t parent, size_t *applied) {
+    struct journal_record record;
+    struct stat st;
+    uint64_t checkpoint;
+    uint32_t version;
+    size_t offset = JOURNAL_HEADER, size;
+    char *map;
+    int fd, result = 0;
+
+    *applied = 0;
+    if ((fd = open(path, O_RDWR)) == -1) {
+        return errno == ENOENT ? 0 : -1;
+    }
+    if (fstat(fd, &st) == -1) {
+        (void) close(fd);
+        return -1;
+    }
+    if ((size = st.st_size) == 0) {
+        (void) close(fd);
+        return 0;
+    }
+    if ((map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+        (void) close(fd);
+        return -1;
+    }
+    if (memcmp(map, JOURNAL_MAGIC, size < 8 ? size : 8) != 0) {
+        (void) munmap(map, size);
+        (void) close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    if (size < JOURNAL_HEADER) {
+        /* torn while being created */
+        offset = 0;
+    } else {
+        (void) memcpy(&version, map + 8, sizeof version);
+        (void) memcpy(&checkpoint, map + 16, sizeof checkpoint);
+        if (version != JOURNAL_VERSION || (checkpoint != 0 && checkpoint != id && checkpoint != parent)) {
+            (void) munmap(map, size);
+            (void) close(fd);
+            errno = version != JOURNAL_VERSION ? EINVAL : ESTALE;
+            return -1;
+        }
+    }
+    while (offset > 0 && offset + sizeof record <= size) {
+        (void) memcpy(&record, map + offset, sizeof record);
+        if (record.size < JOURNAL_PAYLOAD || record.size > size - offset - sizeof record
+            || (uint32_t) hash_bytes(map + offset + sizeof record, record.size) != record.checksum) {
+            break;
+        }
+        if ((result = apply(store, map + offset + sizeof record, record.size)) != 1) {
+            break;
+        }
+        offset += sizeof record + record.size;
+        (*applied)++;
+    }
+    (void) munmap(map, size);
+    /* cut off a torn tail, so new records are not appended behind garbage */
+    if (result != -1 && offset != size && ftruncate(fd, offset) == -1) {
+        result = -1;
+    }
+    (void) close(fd);
+    return result == -1 ? -1 : 0;
+}
+
+int journal_open(struct journal *journal, const char *path, long sync_ms) {
+    sigset_t all, old;
+    struct stat st;
+    ssize_t n;
+
+    (void) memset(journal, 0, sizeof *journal);
+    journal->sync_ms = sync_ms;
+    /* read on rotation */
+    if ((journal->fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0644)) == -1) {
+        return -1;
+    }
+    if (fstat(journal->fd, &st) == -1) {
+        (void) close(journal->fd);
+        return -1;
+    }
+    if (st.st_size == 0) {
+        if ((errno = write_header(journal->fd, 0)) != 0 || fdatasync(journal->fd) == -1) {
+            (void) close(journal->fd);
+            return -1;
+        }
+        st.st_size = JOURNAL_HEADER;
+    } else if ((n = pread(journal->fd, &journal->checkpoint, sizeof journal->checkpoint, 16))
+               != sizeof journal->checkpoint) {
+        /* replay cuts off a torn header, so only a foreign file is that short */
+        (void) close(journal->fd);
+        errno = n == -1 ? errno : EINVAL;
+        return -1;
+    }
+    journal->base = st.st_size;
+    if ((journal->path = strdup(path)) == NULL || (journal->buffer = malloc(JOURNAL_BUFFER)) == NULL) {
+        free(journal->path);
+        (void) close(journal->fd);
+        return -1;
+    }
+    journal->capacity = JOURNAL_BUFFER;
+    (void) pthread_mutex_init(&journal->lock, NULL);
+    (void) pthread_cond_init(&journal->work, NULL);
+    (void) pthread_cond_init(&journal->synced, NULL);
+    /* the writer thread never handles signals */
+    (void) sigfillset(&all);
+    (void) pthread_sigmask(SIG_SETMASK, &all, &old);
+    errno = pthread_create(&journal->writer, NULL, writer, journal);
+    (void) pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (errno != 0) {
+        free(journal->path);
+        free(journal->buffer);
+        (void) close(journal->fd);
+        return -1;
+    }
+    return 0;
+}
+
+uint64_t journal_append(struct journal *journal, journal_type type, const char *username, const char *value) {
+    struct journal_record record;
+    size_t ulen = strlen(username), vlen = strlen(value), size = JOURNAL_PAYLOAD + ulen + vlen + 2, capacity;
+    uint16_t ulen16 = ulen;
+    uint32_t vlen32 = vlen;
+    uint64_t position;
+    char *p;
+
+    if (ulen > UINT16_MAX || size > UINT32_MAX) {
+        errno = EINVAL;
+        return 0;
+    }
+    (void) pthread_mutex_lock(&journal->lock);
+    if (journal->error != 0) {
+        errno = journal->error;
+        (void) pthread_mutex_unlock(&journal->lock);
+        return 0;
+    }
+    if (journal->length + sizeof record + size > journal->capacity) {
+        capacity = journal->capacity > 0 ? journal->capacity : JOURNAL_BUFFER;
+        while (journal->length + sizeof record + size > capacity) {
+            capacity *= 2;
+        }
+        if ((p = realloc(journal->buffer, capacity)) == NULL) {
+            (void) pthread_mutex_unlock(&journal->lock);
+            return 0;
+        }
+        journal->buffer = p;
+        journal->capacity = capacity;
+    }
+    p = journal->buffer + journal->length + sizeof record;
+    p[0] = type;
+    p[1] = 0;
+    (void) memcpy(p + 2, &ulen16, sizeof ulen16);
+    (void) memcpy(p + 4, &vlen32, sizeof vlen32);
+    (void) memcpy(p + JOURNAL_PAYLOAD, username, ulen + 1);
+    (void) memcpy(p + JOURNAL_PAYLOAD + ulen + 1, value, vlen + 1);
+    record.size = size;
+    record.checksum = hash_bytes(p, size);
+    (void) memcpy(journal->buffer + journal->length, &record, sizeof record);
+    /* the writer only sleeps while the buffer is empty */
+    if (journal->length == 0) {
+        (void) pthread_cond_signal(&journal->work);
+    }
+    journal->length += sizeof record + size;
+    journal->appended += sizeof record + size;
+    position = journal->appended;
+    (void) pthread_mutex_unlock(&journal->lock);
+    return position;
+}
+
+uint64_t journal_position(struct journal *journal) {
+    uint64_t position;
+
+    (void) pthread_mutex_lock(&journal->lock);
+    position = journal->appended;
+    (void) pthread_mutex_unlock(&journal->lock);
+    return position;
+}
+
+int journal_rotate(struct journal *journal, uint64_t position, uint64_t checkpoint) {
+    int error;
+
+    (void) pthread_mutex_lock(&journal->lock);
+    journal->rotate_position = position;
+    journal->rotate_checkpoint = checkpoint;
+    journal->rotating = true;
+    (void) pthread_cond_signal(&journal->work);
+    while (journal->rotating) {
+        (void) pthread_cond_wait(&journal->synced, &journal->lock);
+    }
+    error = journal->rotate_error;
+    if (error == 0) {
+        journal->checkpoint = checkpoint;
+    }
+    (void) pthread_mutex_unlock(&journal->lock);
+    if (error != 0) {
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
+int journal_wait(struct journal *journal, uint64_t position) {
+    int error;
+
+    if (journal->sync_ms != JOURNAL_SYNC_ALWAYS) {
+        return 0;
+    }
+    (void) pthread_mutex_lock(&journal->lock);
+    while (journal->durable < position && journal->error == 0) {
+        (void) pthread_cond_wait(&journal->synced, &journal->lock);
+    }
+    error = journal->error;
+    (void) pthread_mutex_unlock(&journal->lock);
+    if (error != 0) {
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
+int journal_close(struct journal *journal) {
+    int error;
+
+    (void) pthread_mutex_lock(&journal->lock);
+    journal->stop = true;
+    (void) pthread_cond_signal(&journal->work);
+    (void) pthread_mutex_unlock(&journal->lock);
+    (void) pthread_join(journal->writer, NULL);
+    error = journal->error;
+    if (close(journal->fd) == -1 && error == 0) {
+        error = errno;
+    }
+    free(journal->buffer);
+    free(journal->path);
+    (void) pthread_mutex_destroy(&journal->lock);
+    (void) pthread_cond_destroy(&journal->work);
+    (void) pthread_cond_destroy(&journal->synced);
+    if (error != 0) {
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
+static void *writer(void *arg) {
+    struct journal *journal = arg;
+    struct timespec deadline;
+    char *spare = NULL, *swap;
+    size_t spare_capacity = 0, length, capacity;
+    uint64_t position, rotate_position = 0, synced = now_ns(), due;
+    bool dirty = false, stop = false, rotating;
+    int error, rotate_error = 0;
+
+    (void) pthread_mutex_lock(&journal->lock);
+    while (!stop) {
+        while (journal->length == 0 && !journal->stop && !journal->rotating) {
+            if (!dirty || journal->sync_ms <= 0) {
+                (void) pthread_cond_wait(&journal->work, &journal->lock);
+                continue;
+            }
+            /* sync the last group once the interval is over */
+            due = synced + journal->sync_ms * 1000000ULL;
+            if (now_ns() >= due) {
+                break;
+            }
+            (void) clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += (due - now_ns()) / 1000000000ULL;
+            deadline.tv_nsec += (due - now_ns()) % 1000000000ULL;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            (void) pthread_cond_timedwait(&journal->work, &journal->lock, &deadline);
+        }
+        stop = journal->stop;
+        rotating = journal->rotating;
+        rotate_position = journal->rotate_position;
+        /* take over the whole group, appenders continue in the spare buffer */
+        swap = journal->buffer;
+        length = journal->length;
+        journal->buffer = spare;
+        journal->length = 0;
+        spare = swap;
+        capacity = journal->capacity;
+        journal->capacity = spare_capacity;
+        spare_capacity = capacity;
+        position = journal->appended;
+        (void) pthread_mutex_unlock(&journal->lock);
+
+        error = write_all(journal->fd, spare, length);
+        dirty = dirty || length > 0;
+        if (error == 0 && dirty && journal->sync_ms != JOURNAL_SYNC_NEVER
+            && (stop || journal->sync_ms == JOURNAL_SYNC_ALWAYS || now_ns() - synced >= journal->sync_ms * 1000000ULL)) {
+            if (fdatasync(journal->fd) == -1) {
+                error = errno;
+            }
+            synced = now_ns();
+            dirty = false;
+        }
+        /* everything up to the rotation position is written by now, and only this thread uses the file */
+        if (rotating) {
+            rotate_error = error != 0 ? error : rotate(journal, rotate_position);
+        }
+
+        (void) pthread_mutex_lock(&journal->lock);
+        if (error != 0 && journal->error == 0) {
+            journal->error = error;
+        }
+        journal->durable = position;
+        if (rotating) {
+            journal->rotate_error = rotate_error;
+            journal->rotating = false;
+        }
+        (void) pthread_cond_broadcast(&journal->synced);
+    }
+    (void) pthread_mutex_unlock(&journal->lock);
+    free(spare);
+    return NULL;
+}
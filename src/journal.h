@@ -0,0 +1,171 @@
+/**
+ * @file journal.h
+ * @author Martin Weise <e1429167@student.tuwien.ac.at>
+ * @date 16.10.2026
+ *
+ * @brief Write-ahead journal header file.
+ * @details Every successful REGISTER and WRITE is appended to the journal as a compact record. A
+ *          background thread writes all records buffered meanwhile with one system call and syncs
+ *          the group according to the sync policy. On startup the journal is replayed on top of the
+ *          loaded database. Replaying is idempotent: a REGISTER of an existing user is skipped, a
+ *          WRITE sets the same secret again. Once a checkpoint holds all records up to a position,
+ *          journal_rotate() drops them.
+ *
+ *          A rotated journal only holds the changes behind its checkpoint and names it by its id, see
+ *          snapshot_id(). It is only replayed on top of that checkpoint, or of a later one taken before
+ *          the journal could be rotated onto it, which names the checkpoint as its parent.
+ *
+ *          Layout: JOURNAL_MAGIC, the version as uint32_t, 4 reserved bytes, the id of the checkpoint
+ *          as uint64_t, 0 if the journal was never rotated, then the records. A
+ *          record is a struct journal_record followed by its payload: the type, a reserved byte, the
+ *          username length as uint16_t, the value length as uint32_t, the NUL-terminated username
+ *          and the NUL-terminated value (password or secret).
+ *
+ **/
+
+/* === Constants === */
+
+/** @brief Magic bytes at the start of a journal. */
+#define JOURNAL_MAGIC "AUTHJRNL"
+/** @brief Version of the journal layout. */
+#define JOURNAL_VERSION (2)
+/** @brief Size of the file header of a journal in bytes. */
+#define JOURNAL_HEADER (24)
+/** @brief Size of the fixed part of the payload of a record in bytes. */
+#define JOURNAL_PAYLOAD (8)
+/** @brief Sync policy: sync every group before the requests in it are answered. */
+#define JOURNAL_SYNC_ALWAYS (0)
+/** @brief Sync policy: leave syncing to the kernel. */
+#define JOURNAL_SYNC_NEVER (-1)
+/** @brief Default sync policy: sync at most every that many milliseconds. */
+#define JOURNAL_SYNC_MS (1000)
+
+/* === Enums === */
+
+/** @brief Types of journal records. */
+typedef enum {
+    JOURNAL_REGISTER = 1, JOURNAL_WRITE = 2
+} journal_type;
+
+/* === Structs === */
+
+/**
+ * @brief Defines the header of a journal record.
+ */
+struct journal_record {
+    /** @brief Size of the payload in bytes. */
+    uint32_t size;
+    /** @brief The lower 32 bits of the hash of the payload, detects torn and corrupt records. */
+    uint32_t checksum;
+};
+
+/**
+ * @brief Defines an open journal.
+ */
+struct journal {
+    /** @brief The journal file descriptor. */
+    int fd;
+    /** @brief The file name, needed to rotate the journal. */
+    char *path;
+    /** @brief File offset of position 0. @details Only used by the writer thread. */
+    int64_t base;
+    /** @brief Id of the checkpoint the records follow, 0 if none. @details Only set by journal_rotate(). */
+    uint64_t checkpoint;
+    /** @brief Sync policy: JOURNAL_SYNC_ALWAYS, JOURNAL_SYNC_NEVER or an interval in milliseconds. */
+    long sync_ms;
+    /** @brief Protects all fields below. */
+    pthread_mutex_t lock;
+    /** @brief Signals the writer thread. */
+    pthread_cond_t work;
+    /** @brief Signals threads waiting in journal_wait(). */
+    pthread_cond_t synced;
+    /** @brief Records not yet handed to the writer thread. */
+    char *buffer;
+    /** @brief Number of buffered bytes. */
+    size_t length;
+    /** @brief Size of the buffer in bytes. */
+    size_t capacity;
+    /** @brief Number of bytes appended since the journal was opened. */
+    uint64_t appended;
+    /** @brief Number of appended bytes that are synced, or written unless the policy is ALWAYS. */
+    uint64_t durable;
+    /** @brief errno of a failed write or sync, 0 otherwise. */
+    int error;
+    /** @brief Tells the writer thread to write everything and stop. */
+    bool stop;
+    /** @brief Tells the writer thread to drop all records up to rotate_position. */
+    bool rotating;
+    /** @brief The position up to which records are dropped on rotation. */
+    uint64_t rotate_position;
+    /** @brief The id of the checkpoint holding the dropped records. */
+    uint64_t rotate_checkpoint;
+    /** @brief errno of the last failed rotation, 0 otherwise. */
+    int rotate_error;
+    /** @brief The writer thread. */
+    pthread_t writer;
+};
+
+/* === Prototypes === */
+
+/**
+ * @brief Replays a journal into the store.
+ * @details Stops at the first torn or corrupt record and cuts it and everything behind it off, so
+ *          new records continue the valid part. A missing journal counts as empty.
+ * @param path The file name.
+ * @param store The store.
+ * @param id The id of the loaded checkpoint, 0 if the database is none.
+ * @param parent The checkpoint the loaded one names as its parent, 0 if none.
+ * @param applied Is set to the number of replayed records.
+ * @return 0 on success, -1 on error. errno is EINVAL if the file is no journal, ESTALE if it was rotated
+ *         onto another checkpoint.
+ */
+int journal_replay(const char *path, struct store *store, uint64_t id, uint64_t parent, size_t *applied);
+/**
+ * @brief Opens a journal for appending and starts its writer thread.
+ * @details Creates the journal if it does not exist. Takes over the checkpoint it names.
+ * @param journal The journal.
+ * @param path The file name.
+ * @param sync_ms The sync policy.
+ * @return 0 on success, -1 on error.
+ */
+int journal_open(struct journal *journal, const char *path, long sync_ms);
+/**
+ * @brief Appends a record.
+ * @param journal The journal.
+ * @param type The type of the record.
+ * @param username The username.
+ * @param value The password of a REGISTER or the secret of a WRITE.
+ * @return The position behind the record, to be passed to journal_wait(), or 0 on error.
+ */
+uint64_t journal_append(struct journal *journal, journal_type type, const char *username, const char *value);
+/**
+ * @brief Returns the position behind the last appended record.
+ * @param journal The journal.
+ * @return The position.
+ */
+uint64_t journal_position(struct journal *journal);
+/**
+ * @brief Drops all records up to a position, as they are part of a checkpoint now.
+ * @details Copies the records behind the position into a new journal that replaces the old one
+ *          atomically. Blocks until the writer thread is done; appending goes on meanwhile.
+ * @param journal The journal.
+ * @param position The position returned by journal_position() when the checkpoint was taken.
+ * @param checkpoint The id of the checkpoint.
+ * @return 0 on success, -1 on error. The journal is left as it was on error.
+ */
+int journal_rotate(struct journal *journal, uint64_t position, uint64_t checkpoint);
+/**
+ * @brief Waits until all records up to a position are durable.
+ * @details Returns at once unless the policy is JOURNAL_SYNC_ALWAYS.
+ * @param journal The journal.
+ * @param position The position returned by journal_append().
+ * @return 0 on success, -1 if writing the journal failed.
+ */
+int journal_wait(struct journal *journal, uint64_t position);
+/**
+ * @brief Writes all records, stops the writer thread and closes the journal.
+ * @details Syncs the journal unless the policy is JOURNAL_SYNC_NEVER.
+ * @param journal The journal.
+ * @return 0 on success, -1 if writing the journal failed.
+ */
+int journal_close(struct journal *journal);
@@ -0,0 +1,251 @@
+/**
+ * @file loader.c
+ * @author Martin Weise <e1429167@student.tuwien.ac.at>
+ * @date 16.10.2026
+ *
+ * @brief Database loader file.
+ *
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "shared.h"
+#include "store.h"
+#include "loader.h"
+
+/* === Structs === */
+
+/**
+ * @brief Defines a part of the database parsed by one thread.
+ */
+struct part {
+    /** @brief First byte of the part, the start of a line. */
+    const char *begin;
+    /** @brief End of the part, behind a newline or at the end of the file. */
+    const char *end;
+    /** @brief Holds the entries created by the thread. */
+    struct arena arena;
+    /** @brief The created entries and the hashes of their usernames, in file order. */
+    struct bucket *items;
+    /** @brief Number of created entries. */
+    size_t count;
+    /** @brief Number of allocated items. */
+    size_t capacity;
+    /** @brief The shard whose users are kept. */
+    long shard;
+    /** @brief Number of shards. */
+    long shards;
+    /** @brief Number of skipped lines of users of other shards. */
+    size_t foreign;
+    /** @brief errno of the first error, 0 on success. */
+    int error;
+};
+
+/* === Prototypes === */
+
+/**
+ * @brief Parses one line into an entry of the part.
+ * @param part The part.
+ * @param line The line, without the newline.
+ * @param len Length of the line.
+ * @return 0 on success, -1 on error.
+ */
+static int parse_line(struct part *part, const char *line, size_t len);
+/**
+ * @brief Parses all lines of a part.
+ * @details Entry point of the parser threads.
+ * @param arg The part.
+ * @return Always NULL.
+ */
+static void *parse_part(void *arg);
+
+/* === Implementations === */
+
+int split_line(const char *line, size_t len, const char *fields[3], size_t lens[3]) {
+    const char *sep, *end = line + len;
+    int n = 1;
+
+    if (len > 0 && line[len - 1] == '\r') {
+        len--;
+        end--;
+    }
+    fields[0] = line;
+    fields[1] = fields[2] = "";
+    lens[0] = len;
+    lens[1] = lens[2] = 0;
+    while ((sep = memchr(fields[n - 1], ';', end - fields[n - 1])) != NULL) {
+        if (n == 3) {
+            return -1;
+        }
+        lens[n - 1] = sep - fields[n - 1];
+        fields[n] = sep + 1;
+        lens[n] = end - fields[n];
+        n++;
+    }
+    /* nobody can log in without a username */
+    return lens[0] > 0 ? 1 : 0;
+}
+
+static int parse_line(struct part *part, const char *line, size_t len) {
+    const char *fields[3];
+    size_t lens[3];
+    struct bucket *items;
+    struct entry *entry;
+    uint64_t hash;
+
+    switch (split_line(line, len, fields, lens)) {
+        case 0:
+            return 0;
+        case -1:
+            errno = EINVAL;
+            return -1;
+    }
+    hash = hash_bytes(fields[0], lens[0]);
+    if (shard_of(hash, part->shards) != part->shard) {
+        part->foreign++;
+        return 0;
+    }
+    if (part->count == part->capacity) {
+        part->capacity = part->capacity == 0 ? 1024 : 2 * part->capacity;
+        if ((items = realloc(part->items, part->capacity * sizeof *items)) == NULL) {
+            return -1;
+        }
+        part->items = items;
+    }
+    if ((entry = entry_create(&part->arena, fields[0], lens[0], fields[1], lens[1], fields[2], lens[2])) == NULL) {
+        return -1;
+    }
+    part->items[part->count].hash = hash;
+    part->items[part->count].entry = entry;
+    part->count++;
+    return 0;
+}
+
+static void *parse_part(void *arg) {
+    struct part *part = arg;
+    const char *line = part->begin, *nl;
+
+    while (line < part->end) {
+        if ((nl = memchr(line, '\n', part->end - line)) == NULL) {
+            nl = part->end;
+        }
+        if (parse_line(part, line, nl - line) == -1) {
+            part->error = errno;
+            break;
+        }
+        line = nl + 1;
+    }
+    return NULL;
+}
+
+int load_database(struct store *store, const char *path, long shard, long shards, struct load_result *result) {
+    struct part parts[LOADER_MAX_THREADS];
+    pthread_t threads[LOADER_MAX_THREADS];
+    bool started[LOADER_MAX_THREADS] = { false };
+    const char *data, *end, *cut;
+    struct stat st;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t total = 0;
+    int fd, nparts, error = 0;
+
+    (void) memset(result, 0, sizeof *result);
+    if ((fd = open(path, O_RDONLY)) == -1) {
+        return -1;
+    }
+    if (fstat(fd, &st) == -1) {
+        (void) close(fd);
+        return -1;
+    }
+    if (st.st_size == 0) {
+        (void) close(fd);
+        return 0;
+    }
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    (void) close(fd);
+    if (data == MAP_FAILED) {
+        return -1;
+    }
+    (void) madvise((void *) data, st.st_size, MADV_SEQUENTIAL);
+    end = data + st.st_size;
+
+    /* one part per CPU, unless the parts get too small to pay off */
+    nparts = st.st_size / LOADER_MIN_PART + 1;
+    if (cpus > 0 && nparts > cpus) {
+        nparts = cpus;
+    }
+    if (nparts > LOADER_MAX_THREADS) {
+        nparts = LOADER_MAX_THREADS;
+    }
+    for (int i = 0; i < nparts; i++) {
+        (void) memset(&parts[i], 0, sizeof parts[i]);
+        parts[i].begin = i == 0 ? data : parts[i - 1].end;
+        /* move the cut behind the next newline */
+        cut = data + (size_t) st.st_size / nparts * (i + 1);
+        if (i == nparts - 1 || cut <= parts[i].begin) {
+            cut = i == nparts - 1 ? end : parts[i].begin;
+        } else if (cut[-1] != '\n') {
+            cut = memchr(cut, '\n', end - cut);
+            cut = cut == NULL ? end : cut + 1;
+        }
+        parts[i].end = cut;
+        parts[i].shard = shard;
+        parts[i].shards = shards;
+        if (arena_init(&parts[i].arena) == -1) {
+            parts[i].error = ENOMEM;
+        }
+    }
+    for (int i = 1; i < nparts; i++) {
+        started[i] = parts[i].error == 0 && pthread_create(&threads[i], NULL, parse_part, &parts[i]) == 0;
+    }
+    /* the calling thread parses the first part and every part no thread could be started for */
+    for (int i = 0; i < nparts; i++) {
+        if (i == 0 || !started[i]) {
+            if (parts[i].error == 0) {
+                (void) parse_part(&parts[i]);
+            }
+        } else {
+            (void) pthread_join(threads[i], NULL);
+        }
+        total += parts[i].count;
+        result->foreign += parts[i].foreign;
+    }
+
+    /* merge in file order, so the first line of a username wins */
+    for (int i = 0; i < nparts && error == 0; i++) {
+        error = parts[i].error;
+    }
+    if (error == 0 && store_reserve(store, store->count + total) == -1) {
+        error = ENOMEM;
+    }
+    for (int i = 0; i < nparts; i++) {
+        if (error == 0) {
+            arena_adopt(&store->arena, &parts[i].arena);
+            for (size_t j = 0; j < parts[i].count && error == 0; j++) {
+                if (store_insert(store, parts[i].items[j].hash, parts[i].items[j].entry) == 0) {
+                    result->users++;
+                } else if (errno == EEXIST) {
+                    result->duplicates++;
+                } else {
+                    error = errno;
+                }
+            }
+        }
+        arena_free(&parts[i].arena);
+        (void) pthread_mutex_destroy(&parts[i].arena.lock);
+        free(parts[i].items);
+    }
+    (void) munmap((void *) data, st.st_size);
+    result->bytes = st.st_size;
+    result->threads = nparts;
+    errno = error;
+    return error == 0 ? 0 : -1;
+}
@@ -0,0 +1,64 @@
+/**
+ * @file loader.h
+ * @author Martin Weise <e1429167@student.tuwien.ac.at>
+ * @date 16.10.2026
+ *
+ * @brief Database loader header file.
+ * @details Loads a csv database of "username;password;secret" lines into the user store. The file
+ *          is mapped into memory and split into newline-aligned parts that are parsed in parallel.
+ *          A shard only keeps the users it owns, so all shards can be loaded from the same file.
+ *
+ **/
+
+/* === Constants === */
+
+/** @brief File name the server saves the csv database to. */
+#define DATABASE_NAME "auth-server.db.csv"
+/** @brief Smallest part of the file parsed by a thread of its own. */
+#define LOADER_MIN_PART (1 << 20)
+/** @brief Maximum number of parser threads. */
+#define LOADER_MAX_THREADS (64)
+
+/* === Structs === */
+
+/**
+ * @brief Defines the outcome of loading a database.
+ */
+struct load_result {
+    /** @brief Size of the file in bytes. */
+    size_t bytes;
+    /** @brief Number of users added to the store. */
+    size_t users;
+    /** @brief Number of skipped lines whose username appeared before. */
+    size_t duplicates;
+    /** @brief Number of skipped lines of users owned by other shards, see shard_of(). */
+    size_t foreign;
+    /** @brief Number of parser threads. */
+    int threads;
+};
+
+/* === Prototypes === */
+
+/**
+ * @brief Splits a line of a csv database into its fields.
+ * @details Missing fields are empty. A trailing '\r' is dropped.
+ * @param line The line, without the newline.
+ * @param len Length of the line.
+ * @param fields Receives the username, the password and the secret, not NUL-terminated.
+ * @param lens Receives the lengths of the fields.
+ * @return 1 on success, 0 if the line holds no username, -1 if it has more than 3 fields.
+ */
+int split_line(const char *line, size_t len, const char *fields[3], size_t lens[3]);
+/**
+ * @brief Loads a csv database into the store.
+ * @details Every non-empty line holds a username, optionally followed by a password and a secret,
+ *          separated by ';'. Missing fields are empty. Lines without a username are skipped, the
+ *          first line of a username wins. Lines have no length limit.
+ * @param store The store.
+ * @param path The file name of the database.
+ * @param shard The shard whose users are loaded.
+ * @param shards Number of shards, 1 loads all users.
+ * @param result The outcome, filled in on success.
+ * @return 0 on success, -1 on error. errno is EINVAL if the database is malformed.
+ */
+int load_database(struct store *store, const char *path, long shard, long shards, struct load_result *result);
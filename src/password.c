@@ -0,0 +1,132 @@
+/**
+ * @file password.c
+ * @author Martin Weise <e1429167@student.tuwien.ac.at>
+ * @date 16.10.2026
+ *
+ * @brief Password hashing.
+ *
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <openssl/crypto.h>
+#include "password.h"
+
+/* === Prototypes === */
+
+/**
+ * @brief Derives the key of a password.
+ * @param password The password.
+ * @param salt The salt of PASSWORD_SALT bytes.
+ * @param iterations The number of iterations.
+ * @param key The buffer of PASSWORD_KEY bytes receiving the key.
+ * @return 0 on success, -1 on error.
+ */
+static int derive(const char *password, const unsigned char *salt, unsigned long iterations, unsigned char *key);
+/**
+ * @brief Encodes bytes in hex.
+ * @param data The bytes.
+ * @param len Number of bytes.
+ * @param out The buffer of 2 * len bytes receiving the hex digits, not NUL-terminated.
+ */
+static void to_hex(const unsigned char *data, size_t len, char *out);
+/**
+ * @brief Decodes exactly len bytes of hex.
+ * @param hex The hex digits.
+ * @param len Number of bytes to decode.
+ * @param out The buffer of len bytes.
+ * @return 0 on success, -1 if the digits are invalid.
+ */
+static int from_hex(const char *hex, size_t len, unsigned char *out);
+
+/* === Implementations === */
+
+static int derive(const char *password, const unsigned char *salt, unsigned long iterations, unsigned char *key) {
+    if (iterations == 0 || iterations > INT_MAX) {
+        return -1;
+    }
+    return PKCS5_PBKDF2_HMAC(password, strlen(password), salt, PASSWORD_SALT, iterations, EVP_sha256(),
+                             PASSWORD_KEY, key) == 1 ? 0 : -1;
+}
+
+static void to_hex(const unsigned char *data, size_t len, char *out) {
+    static const char digits[] = "0123456789abcdef";
+
+    for (size_t i = 0; i < len; i++) {
+        out[2 * i] = digits[data[i] >> 4];
+        out[2 * i + 1] = digits[data[i] & 15];
+    }
+}
+
+static int from_hex(const char *hex, size_t len, unsigned char *out) {
+    int value[2];
+    char c;
+
+    for (size_t i = 0; i < len; i++) {
+        for (int j = 0; j < 2; j++) {
+            c = hex[2 * i + j];
+            if (c >= '0' && c <= '9') {
+                value[j] = c - '0';
+            } else if (c >= 'a' && c <= 'f') {
+                value[j] = c - 'a' + 10;
+            } else {
+                return -1;
+            }
+        }
+        out[i] = value[0] << 4 | value[1];
+    }
+    return 0;
+}
+
+int password_hash(const char *password, unsigned long iterations, char *hash) {
+    unsigned char salt[PASSWORD_SALT], key[PASSWORD_KEY];
+    int len;
+
+    if (RAND_bytes(salt, sizeof salt) != 1 || derive(password, salt, iterations, key) == -1) {
+        return -1;
+    }
+    len = snprintf(hash, PASSWORD_HASH_MAX, "%s%lu$", PASSWORD_SCHEME, iterations);
+    to_hex(salt, sizeof salt, hash + len);
+    len += 2 * sizeof salt;
+    hash[len++] = '$';
+    to_hex(key, sizeof key, hash + len);
+    hash[len + 2 * sizeof key] = '\0';
+    return 0;
+}
+
+int password_verify(const char *password, const char *stored, unsigned long iterations, bool *rehash) {
+    unsigned char salt[PASSWORD_SALT], key[PASSWORD_KEY], expected[PASSWORD_KEY];
+    size_t len = strlen(password);
+    unsigned long cost;
+    char *end;
+
+    *rehash = false;
+    if (strncmp(stored, PASSWORD_SCHEME, strlen(PASSWORD_SCHEME)) != 0) {
+        /* plaintext of an old database */
+        if (strlen(stored) != len || CRYPTO_memcmp(stored, password, len) != 0) {
+            return 0;
+        }
+        *rehash = true;
+        return 1;
+    }
+    cost = strtoul(stored + strlen(PASSWORD_SCHEME), &end, 10);
+    if (*end != '$' || cost == 0 || cost > INT_MAX || strlen(end + 1) != 2 * PASSWORD_SALT + 1 + 2 * PASSWORD_KEY
+        || from_hex(end + 1, PASSWORD_SALT, salt) == -1 || end[1 + 2 * PASSWORD_SALT] != '$'
+        || from_hex(end + 2 + 2 * PASSWORD_SALT, PASSWORD_KEY, expected) == -1) {
+        return 0;
+    }
+    if (derive(password, salt, cost, key) == -1) {
+        return -1;
+    }
+    if (CRYPTO_memcmp(key, expected, sizeof key) != 0) {
+        return 0;
+    }
+    *rehash = cost != iterations;
+    return 1;
+}
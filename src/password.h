@@ -0,0 +1,52 @@
+/**
+ * @file password.h
+ * @author Martin Weise <e1429167@student.tuwien.ac.at>
+ * @date 16.10.2026
+ *
+ * @brief Password hashing header file.
+ * @details Passwords are stored as salted PBKDF2-HMAC-SHA256 hashes in the form
+ *          PASSWORD_SCHEME iterations$salt$key, salt and key in hex. The hash is only computed on
+ *          REGISTER and LOGIN, all other commands are authorized by the session id.
+ *
+ *          Passwords of a plaintext database are still accepted and rehashed on the next LOGIN,
+ *          just like hashes of another cost.
+ *
+ *          A hash takes milliseconds and runs on the worker thread of the request, while no lock is
+ *          held. A single worker would make all other clients wait meanwhile, so the server starts
+ *          one worker per CPU, at least two, unless -t says otherwise.
+ *
+ **/
+
+/* === Constants === */
+
+/** @brief Prefix of a hashed password. */
+#define PASSWORD_SCHEME "$pbkdf2-sha256$"
+/** @brief Default number of PBKDF2 iterations. */
+#define PASSWORD_ITERATIONS (20000)
+/** @brief Size of the salt in bytes. */
+#define PASSWORD_SALT (16)
+/** @brief Size of the derived key in bytes. */
+#define PASSWORD_KEY (32)
+/** @brief Size of a buffer holding a hashed password, including the terminating NUL. */
+#define PASSWORD_HASH_MAX (128)
+
+/* === Prototypes === */
+
+/**
+ * @brief Hashes a password with a fresh random salt.
+ * @param password The password.
+ * @param iterations The number of PBKDF2 iterations.
+ * @param hash The buffer of PASSWORD_HASH_MAX bytes receiving the hash.
+ * @return 0 on success, -1 on error.
+ */
+int password_hash(const char *password, unsigned long iterations, char *hash);
+/**
+ * @brief Checks a password against a stored one.
+ * @details Compares in constant time. A stored password without PASSWORD_SCHEME is plaintext.
+ * @param password The password given by the user.
+ * @param stored The stored hash or plaintext password.
+ * @param iterations The number of PBKDF2 iterations new hashes use.
+ * @param rehash Is set if the password matches but is not stored as a hash of that cost.
+ * @return 1 if the password matches, 0 if not, -1 on error.
+ */
+int password_verify(const char *password, const char *stored, unsigned long iterations, bool *rehash);
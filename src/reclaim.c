@@ -0,0 +1,131 @@
+/**
+ * @file reclaim.c
+ * @author Martin Weise <e1429167@student.tuwien.ac.at>
+ * @date 16.10.2026
+ *
+ * @brief Deferred reclamation file.
+ *
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include "shared.h"
+#include "reclaim.h"
+
+/* === Prototypes === */
+
+/**
+ * @brief Frees the retired records no reader can hold any more.
+ * @details The caller has to hold the lock of the reclaimer.
+ * @param reclaim The reclaimer.
+ * @return The number of freed records.
+ */
+static size_t collect(struct reclaim *reclaim);
+
+/* === Implementations === */
+
+int reclaim_init(struct reclaim *reclaim, size_t readers) {
+    reclaim->epoch = 1;
+    reclaim->nreaders = readers;
+    reclaim->retired = NULL;
+    reclaim->pending = 0;
+    if (posix_memalign((void **) &reclaim->readers, CACHE_LINE, readers * sizeof *reclaim->readers) != 0) {
+        reclaim->readers = NULL;
+        return -1;
+    }
+    (void) memset(reclaim->readers, 0, readers * sizeof *reclaim->readers);
+    return pthread_mutex_init(&reclaim->lock, NULL) == 0 ? 0 : -1;
+}
+
+void reclaim_free(struct reclaim *reclaim) {
+    struct retired *tmp;
+
+    if (reclaim->readers == NULL) {
+        return;
+    }
+    while (reclaim->retired != NULL) {
+        tmp = reclaim->retired;
+        reclaim->retired = tmp->next;
+        free(tmp->record);
+        free(tmp);
+    }
+    reclaim->pending = 0;
+    free(reclaim->readers);
+    reclaim->readers = NULL;
+    (void) pthread_mutex_destroy(&reclaim->lock);
+}
+
+void reclaim_online(struct reclaim *reclaim, size_t reader) {
+    __atomic_store_n(&reclaim->readers[reader].seen, __atomic_load_n(&reclaim->epoch, __ATOMIC_SEQ_CST),
+                     __ATOMIC_SEQ_CST);
+    /* the collector must see the reader online before it reads a pointer */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void reclaim_quiescent(struct reclaim *reclaim, size_t reader) {
+    /* release: all reads of the records taken before are done */
+    __atomic_store_n(&reclaim->readers[reader].seen, __atomic_load_n(&reclaim->epoch, __ATOMIC_ACQUIRE),
+                     __ATOMIC_RELEASE);
+}
+
+void reclaim_offline(struct reclaim *reclaim, size_t reader) {
+    __atomic_store_n(&reclaim->readers[reader].seen, 0, __ATOMIC_RELEASE);
+}
+
+int reclaim_retire(struct reclaim *reclaim, void *record) {
+    struct retired *retired;
+
+    if ((retired = malloc(sizeof *retired)) == NULL) {
+        return -1;
+    }
+    (void) pthread_mutex_lock(&reclaim->lock);
+    retired->record = record;
+    retired->epoch = __atomic_add_fetch(&reclaim->epoch, 1, __ATOMIC_SEQ_CST);
+    retired->next = reclaim->retired;
+    reclaim->retired = retired;
+    if (++reclaim->pending >= RECLAIM_PENDING) {
+        (void) collect(reclaim);
+    }
+    (void) pthread_mutex_unlock(&reclaim->lock);
+    return 0;
+}
+
+size_t reclaim_collect(struct reclaim *reclaim) {
+    size_t freed;
+
+    (void) pthread_mutex_lock(&reclaim->lock);
+    freed = collect(reclaim);
+    (void) pthread_mutex_unlock(&reclaim->lock);
+    return freed;
+}
+
+static size_t collect(struct reclaim *reclaim) {
+    struct retired **link = &reclaim->retired, *tmp;
+    uint64_t oldest = reclaim->epoch, seen;
+    size_t freed = 0;
+
+    /* a record is safe once every online reader was quiescent after it was retired */
+    for (size_t i = 0; i < reclaim->nreaders; i++) {
+        seen = __atomic_load_n(&reclaim->readers[i].seen, __ATOMIC_SEQ_CST);
+        if (seen != 0 && seen < oldest) {
+            oldest = seen;
+        }
+    }
+    while (*link != NULL) {
+        if ((*link)->epoch <= oldest) {
+            tmp = *link;
+            *link = tmp->next;
+            free(tmp->record);
+            free(tmp);
+            freed++;
+        } else {
+            link = &(*link)->next;
+        }
+    }
+    reclaim->pending -= freed;
+    return freed;
+}
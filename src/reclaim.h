@@ -0,0 +1,110 @@
+/**
+ * @file reclaim.h
+ * @author Martin Weise <e1429167@student.tuwien.ac.at>
+ * @date 16.10.2026
+ *
+ * @brief Deferred reclamation header file.
+ * @details Frees memory that readers without a lock may still be using, once they are all done
+ *          with it. A writer first unpublishes a record, e.g. by swapping the pointer to it, and
+ *          then retires it. Every reader reports a quiescent state whenever it holds no record,
+ *          and goes offline before it blocks. A retired record is freed once every online reader
+ *          reported a quiescent state after it was retired.
+ *
+ *          Reporting costs a reader a single store, so readers report after every pass over the
+ *          request slots. Retired records are collected once per tick and once RECLAIM_PENDING of
+ *          them are waiting.
+ *
+ **/
+
+/* === Constants === */
+
+/** @brief Number of waiting records that makes a retire try to collect them right away. */
+#define RECLAIM_PENDING (64)
+
+/* === Structs === */
+
+/**
+ * @brief Defines a retired record.
+ */
+struct retired {
+    /** @brief The record retired before. */
+    struct retired *next;
+    /** @brief The record, allocated with malloc(). */
+    void *record;
+    /** @brief The epoch the record was retired in. */
+    uint64_t epoch;
+};
+
+/**
+ * @brief Defines the state of a reader.
+ */
+struct reader {
+    /** @brief The epoch of the last quiescent state of the reader, 0 while it is offline. */
+    uint64_t seen;
+} __attribute__((aligned(CACHE_LINE)));
+
+/**
+ * @brief Defines the reclaimer.
+ */
+struct reclaim {
+    /** @brief Serializes retiring and collecting. */
+    pthread_mutex_t lock;
+    /** @brief Incremented by every retire. */
+    uint64_t epoch;
+    /** @brief The readers, each on a cache line of its own. */
+    struct reader *readers;
+    /** @brief Number of readers. */
+    size_t nreaders;
+    /** @brief The retired records, most recent first. */
+    struct retired *retired;
+    /** @brief Number of retired records. */
+    size_t pending;
+};
+
+/* === Prototypes === */
+
+/**
+ * @brief Initializes a reclaimer with all readers offline.
+ * @param reclaim The reclaimer.
+ * @param readers Number of readers.
+ * @return 0 on success, -1 on error.
+ */
+int reclaim_init(struct reclaim *reclaim, size_t readers);
+/**
+ * @brief Frees all retired records and the reclaimer.
+ * @details No reader may be online.
+ * @param reclaim The reclaimer.
+ */
+void reclaim_free(struct reclaim *reclaim);
+/**
+ * @brief Lets a reader take records again after it was offline.
+ * @param reclaim The reclaimer.
+ * @param reader The index of the reader.
+ */
+void reclaim_online(struct reclaim *reclaim, size_t reader);
+/**
+ * @brief Tells the reclaimer a reader holds no records until it takes them anew.
+ * @param reclaim The reclaimer.
+ * @param reader The index of the reader.
+ */
+void reclaim_quiescent(struct reclaim *reclaim, size_t reader);
+/**
+ * @brief Tells the reclaimer a reader takes no records until reclaim_online(), e.g. while it blocks.
+ * @param reclaim The reclaimer.
+ * @param reader The index of the reader.
+ */
+void reclaim_offline(struct reclaim *reclaim, size_t reader);
+/**
+ * @brief Frees an unpublished record once no reader can hold it any more.
+ * @details A record that cannot be queued for lack of memory is leaked rather than freed early.
+ * @param reclaim The reclaimer.
+ * @param record The record, allocated with malloc().
+ * @return 0 on success, -1 on error.
+ */
+int reclaim_retire(struct reclaim *reclaim, void *record);
+/**
+ * @brief Frees the retired records no reader can hold any more.
+ * @param reclaim The reclaimer.
+ * @return The number of freed records.
+ */
+size_t reclaim_collect(struct reclaim *reclaim);
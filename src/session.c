@@ -0,0 +1,407 @@
+/**
+ * @file session.c
+ * @author Martin Weise <e1429167@student.tuwien.ac.at>
+ * @date 16.10.2026
+ *
+ * @brief Session table file.
+ *
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/random.h>
+#include "shared.h"
+#include "session.h"
+
+/* === Prototypes === */
+
+/**
+ * @brief Returns the current tick of the timer wheel.
+ * @return The tick.
+ */
+static uint32_t current_tick(void);
+/**
+ * @brief Returns the bucket holding a session id, or the empty bucket where it would be placed.
+ * @param sessions The session table.
+ * @param id The session id.
+ * @param hash The hash of the session id.
+ * @return The bucket.
+ */
+static struct session_bucket *lookup(struct sessions *sessions, const char *id, uint64_t hash);
+/**
+ * @brief Marks the buckets as changing, so concurrent sessions_find() calls repeat their lookup.
+ * @param sessions The session table.
+ */
+static void begin_change(struct sessions *sessions);
+/**
+ * @brief Marks the change of the buckets as done.
+ * @param sessions The session table.
+ */
+static void end_change(struct sessions *sessions);
+/**
+ * @brief Adds a session to the wheel slot of its due tick.
+ * @param sessions The session table.
+ * @param index The index of the session.
+ */
+static void link_slot(struct sessions *sessions, uint32_t index);
+/**
+ * @brief Removes a session from its wheel slot.
+ * @param sessions The session table.
+ * @param index The index of the session.
+ */
+static void unlink_slot(struct sessions *sessions, uint32_t index);
+/**
+ * @brief Moves a session that was used to the wheel slot of its new deadline.
+ * @details Takes the lock only on the first use of the session in a tick.
+ * @param sessions The session table.
+ * @param index The index of the session.
+ * @param entry The entry the session belonged to when it was found.
+ */
+static void touch(struct sessions *sessions, uint32_t index, const struct entry *entry);
+/**
+ * @brief Removes a session from the table and the wheel and returns it to the free list.
+ * @param sessions The session table.
+ * @param index The index of the session.
+ */
+static void erase(struct sessions *sessions, uint32_t index);
+/**
+ * @brief Picks the session to replace once the table is full.
+ * @details Takes the session with the earliest deadline of the next non-empty slot of the wheel.
+ * @param sessions The session table.
+ * @return The index of the session.
+ */
+static uint32_t victim(struct sessions *sessions);
+/**
+ * @brief Draws a session id from the pool of random bytes.
+ * @details Refills the pool with getrandom() once it is used up.
+ * @param sessions The session table.
+ * @param id Receives the SIZE_SESS_ID characters of the session id.
+ * @return 0 on success, -1 on error.
+ */
+static int draw_id(struct sessions *sessions, char *id);
+
+/* === Implementations === */
+
+int sessions_init(struct sessions *sessions, size_t memory, uint32_t idle) {
+    /* the table is at most half full and its capacity a power of two, so it takes up to 4 buckets a session */
+    size_t max = memory / (sizeof *sessions->pool + 4 * sizeof *sessions->buckets);
+    uint32_t wheel;
+
+    if (max == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    sessions->max = max < UINT32_MAX - 1 ? max : UINT32_MAX - 1;
+    for (sessions->capacity = 2; sessions->capacity < 2 * (size_t) sessions->max; sessions->capacity *= 2) {
+        continue;
+    }
+    sessions->version = 0;
+    sessions->used = 0;
+    sessions->free = SESSIONS_NONE;
+    sessions->count = 0;
+    sessions->idle = ((uint64_t) idle * 1000 + SESSIONS_TICK_MS - 1) / SESSIONS_TICK_MS;
+    if (sessions->idle == 0) {
+        sessions->idle = 1;
+    }
+    /* a slot comes up again only after all deadlines of the sessions in it */
+    for (wheel = 2; wheel <= sessions->idle && wheel < SESSIONS_WHEEL_MAX; wheel *= 2) {
+        continue;
+    }
+    sessions->wheel_mask = wheel - 1;
+    sessions->tick = current_tick();
+    sessions->consumed = SESSIONS_POOL;
+    if (pthread_mutex_init(&sessions->lock, NULL) != 0) {
+        return -1;
+    }
+    /* untouched pages of the pool cost no memory until the sessions are used */
+    sessions->buckets = NULL;
+    sessions->pool = NULL;
+    if ((sessions->wheel = malloc(wheel * sizeof *sessions->wheel)) == NULL
+        || (sessions->buckets = calloc(sessions->capacity, sizeof *sessions->buckets)) == NULL
+        || (sessions->pool = calloc(sessions->max, sizeof *sessions->pool)) == NULL) {
+        free(sessions->wheel);
+        free(sessions->buckets);
+        sessions->wheel = NULL;
+        sessions->buckets = NULL;
+        return -1;
+    }
+    for (uint32_t i = 0; i < wheel; i++) {
+        sessions->wheel[i] = SESSIONS_NONE;
+    }
+    return 0;
+}
+
+void sessions_free(struct sessions *sessions) {
+    if (sessions->buckets == NULL) {
+        return;
+    }
+    (void) pthread_mutex_destroy(&sessions->lock);
+    free(sessions->buckets);
+    free(sessions->pool);
+    free(sessions->wheel);
+    sessions->buckets = NULL;
+    sessions->pool = NULL;
+    sessions->wheel = NULL;
+    sessions->capacity = 0;
+    sessions->count = 0;
+}
+
+struct entry *sessions_find(struct sessions *sessions, const char *id) {
+    uint64_t hash = hash_bytes(id, SIZE_SESS_ID);
+    size_t mask = sessions->capacity - 1;
+    uint32_t version, index, found;
+    struct entry *entry;
+
+    while (1) {
+        if ((version = __atomic_load_n(&sessions->version, __ATOMIC_ACQUIRE)) & 1) {
+            (void) sched_yield();
+            continue;
+        }
+        index = 0;
+        entry = NULL;
+        /* a lookup overlapping a change may see any mix of buckets, so bound the probes */
+        for (size_t i = hash & mask, probes = 0; probes <= mask; i = (i + 1) & mask, probes++) {
+            if ((found = __atomic_load_n(&sessions->buckets[i].session, __ATOMIC_RELAXED)) == 0) {
+                break;
+            }
+            if (__atomic_load_n(&sessions->buckets[i].hash, __ATOMIC_RELAXED) == (uint32_t) hash
+                && memcmp(sessions->pool[found - 1].id, id, SIZE_SESS_ID) == 0) {
+                index = found;
+                entry = __atomic_load_n(&sessions->pool[found - 1].entry, __ATOMIC_RELAXED);
+                break;
+            }
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&sessions->version, __ATOMIC_RELAXED) == version) {
+            break;
+        }
+    }
+    if (index != 0 && entry != NULL) {
+        touch(sessions, index - 1, entry);
+    }
+    return entry;
+}
+
+int sessions_create(struct sessions *sessions, struct entry *entry, char *id) {
+    struct session_bucket *bucket;
+    struct session *session;
+    uint32_t now = current_tick(), index = SESSIONS_NONE;
+    uint64_t hash;
+    int replaced = 0;
+
+    (void) pthread_mutex_lock(&sessions->lock);
+    /* a collision of 119 random bits is a formality, but costs nothing to rule out */
+    do {
+        if (draw_id(sessions, id) == -1) {
+            (void) pthread_mutex_unlock(&sessions->lock);
+            return -1;
+        }
+        hash = hash_bytes(id, SIZE_SESS_ID);
+    } while (lookup(sessions, id, hash)->session != 0);
+    begin_change(sessions);
+    if (sessions->free == SESSIONS_NONE && sessions->used == sessions->max) {
+        index = victim(sessions);
+        erase(sessions, index);
+        replaced = 1;
+    }
+    if (sessions->free != SESSIONS_NONE) {
+        index = sessions->free;
+        sessions->free = sessions->pool[index].next;
+    } else {
+        index = sessions->used++;
+    }
+    session = &sessions->pool[index];
+    (void) memcpy(session->id, id, SIZE_SESS_ID);
+    session->entry = entry;
+    session->due = now + sessions->idle;
+    link_slot(sessions, index);
+    bucket = lookup(sessions, id, hash);
+    bucket->session = index + 1;
+    bucket->hash = hash;
+    end_change(sessions);
+    sessions->count++;
+    (void) pthread_mutex_unlock(&sessions->lock);
+    return replaced;
+}
+
+struct entry *sessions_remove(struct sessions *sessions, const char *id, const struct entry *owner) {
+    uint64_t hash = hash_bytes(id, SIZE_SESS_ID);
+    struct session_bucket *bucket;
+    struct entry *entry = NULL;
+
+    (void) pthread_mutex_lock(&sessions->lock);
+    bucket = lookup(sessions, id, hash);
+    if (bucket->session != 0 && (owner == NULL || sessions->pool[bucket->session - 1].entry == owner)) {
+        entry = sessions->pool[bucket->session - 1].entry;
+        begin_change(sessions);
+        erase(sessions, bucket->session - 1);
+        end_change(sessions);
+    }
+    (void) pthread_mutex_unlock(&sessions->lock);
+    return entry;
+}
+
+size_t sessions_expire(struct sessions *sessions) {
+    uint32_t now = current_tick(), index, next;
+    size_t expired = 0;
+
+    (void) pthread_mutex_lock(&sessions->lock);
+    /* a round visits every slot, so catching up more than a round is pointless */
+    if (now - sessions->tick > sessions->wheel_mask + 1) {
+        sessions->tick = now - (sessions->wheel_mask + 1);
+    }
+    while (sessions->tick != now) {
+        sessions->tick++;
+        /* used sessions left the slot already, only those of later rounds of a short wheel stay */
+        for (index = sessions->wheel[sessions->tick & sessions->wheel_mask]; index != SESSIONS_NONE; index = next) {
+            next = sessions->pool[index].next;
+            if ((int32_t) (sessions->pool[index].due - sessions->tick) <= 0) {
+                begin_change(sessions);
+                erase(sessions, index);
+                end_change(sessions);
+                expired++;
+            }
+        }
+    }
+    (void) pthread_mutex_unlock(&sessions->lock);
+    return expired;
+}
+
+static uint32_t current_tick(void) {
+    return now_ns() / (SESSIONS_TICK_MS * 1000000ULL);
+}
+
+static struct session_bucket *lookup(struct sessions *sessions, const char *id, uint64_t hash) {
+    size_t mask = sessions->capacity - 1;
+    struct session_bucket *bucket;
+
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        bucket = &sessions->buckets[i];
+        if (bucket->session == 0 || (bucket->hash == (uint32_t) hash
+                                     && memcmp(sessions->pool[bucket->session - 1].id, id, SIZE_SESS_ID) == 0)) {
+            return bucket;
+        }
+    }
+}
+
+static void begin_change(struct sessions *sessions) {
+    __atomic_store_n(&sessions->version, sessions->version + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void end_change(struct sessions *sessions) {
+    __atomic_store_n(&sessions->version, sessions->version + 1, __ATOMIC_RELEASE);
+}
+
+static void link_slot(struct sessions *sessions, uint32_t index) {
+    struct session *session = &sessions->pool[index];
+    uint32_t *head = &sessions->wheel[session->due & sessions->wheel_mask];
+
+    session->prev = SESSIONS_NONE;
+    session->next = *head;
+    if (*head != SESSIONS_NONE) {
+        sessions->pool[*head].prev = index;
+    }
+    *head = index;
+}
+
+static void unlink_slot(struct sessions *sessions, uint32_t index) {
+    struct session *session = &sessions->pool[index];
+
+    if (session->prev != SESSIONS_NONE) {
+        sessions->pool[session->prev].next = session->next;
+    } else {
+        sessions->wheel[session->due & sessions->wheel_mask] = session->next;
+    }
+    if (session->next != SESSIONS_NONE) {
+        sessions->pool[session->next].prev = session->prev;
+    }
+}
+
+static void touch(struct sessions *sessions, uint32_t index, const struct entry *entry) {
+    struct session *session = &sessions->pool[index];
+    uint32_t due = current_tick() + sessions->idle;
+
+    if (__atomic_load_n(&session->due, __ATOMIC_RELAXED) == due) {
+        return;
+    }
+    (void) pthread_mutex_lock(&sessions->lock);
+    /* should the session be replaced meanwhile by one of the same user, that one just lives a tick longer */
+    if (session->entry == entry && session->due != due) {
+        unlink_slot(sessions, index);
+        __atomic_store_n(&session->due, due, __ATOMIC_RELAXED);
+        link_slot(sessions, index);
+    }
+    (void) pthread_mutex_unlock(&sessions->lock);
+}
+
+static void erase(struct sessions *sessions, uint32_t index) {
+    struct session *session = &sessions->pool[index];
+    size_t mask = sessions->capacity - 1, hole, i, home;
+
+    /* shift back the following sessions of the cluster, so lookups need no tombstones */
+    hole = lookup(sessions, session->id, hash_bytes(session->id, SIZE_SESS_ID)) - sessions->buckets;
+    for (i = (hole + 1) & mask; sessions->buckets[i].session != 0; i = (i + 1) & mask) {
+        home = sessions->buckets[i].hash & mask;
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            sessions->buckets[hole] = sessions->buckets[i];
+            hole = i;
+        }
+    }
+    sessions->buckets[hole].session = 0;
+    unlink_slot(sessions, index);
+    session->entry = NULL;
+    session->next = sessions->free;
+    sessions->free = index;
+    sessions->count--;
+}
+
+static uint32_t victim(struct sessions *sessions) {
+    uint32_t index = SESSIONS_NONE, best, deadline, earliest = UINT32_MAX;
+
+    for (uint32_t i = 1; index == SESSIONS_NONE; i++) {
+        index = sessions->wheel[(sessions->tick + i) & sessions->wheel_mask];
+    }
+    /* a wheel shorter than the idle time also holds sessions of later rounds in the slot */
+    for (best = index; index != SESSIONS_NONE; index = sessions->pool[index].next) {
+        /* relative to the wheel, so the comparison survives a wrap of the tick */
+        deadline = sessions->pool[index].due - sessions->tick;
+        if (deadline < earliest) {
+            earliest = deadline;
+            best = index;
+        }
+    }
+    return best;
+}
+
+static int draw_id(struct sessions *sessions, char *id) {
+    static const char chars[] = "AaBbCcDdEeFfGgHhIiJjKkLlMmNnOoPpQqRrSsTtUuVvWwXxYyZz0123456789";
+    size_t filled;
+    ssize_t n;
+    unsigned char byte;
+
+    for (int i = 0; i < SIZE_SESS_ID;) {
+        if (sessions->consumed == SESSIONS_POOL) {
+            for (filled = 0; filled < SESSIONS_POOL; filled += n) {
+                if ((n = getrandom(sessions->random + filled, SESSIONS_POOL - filled, 0)) == -1) {
+                    if (errno != EINTR) {
+                        return -1;
+                    }
+                    n = 0;
+                }
+            }
+            sessions->consumed = 0;
+        }
+        byte = sessions->random[sessions->consumed++];
+        /* 248 is the largest multiple of 62 up to 256, larger bytes would favour some characters */
+        if (byte < 248) {
+            id[i++] = chars[byte % (sizeof chars - 1)];
+        }
+    }
+    return 0;
+}
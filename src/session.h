@@ -0,0 +1,154 @@
+/**
+ * @file session.h
+ * @author Martin Weise <e1429167@student.tuwien.ac.at>
+ * @date 16.10.2026
+ *
+ * @brief Session table header file.
+ * @details Maps the session ids handed out on LOGIN to the entries of the logged-in users.
+ *
+ *          All memory is allocated up front, so the table never exceeds its memory limit. Once it
+ *          is full, a new session replaces the session with the earliest deadline in the next
+ *          non-empty slot of the wheel, which is the session closest to expiry. Session ids are
+ *          drawn from a buffered pool of kernel randomness.
+ *
+ *          Idle sessions expire through a timer wheel with a slot per tick, large enough to span the
+ *          idle time up to SESSIONS_WHEEL_MAX slots. A session waits in the list of the slot of its
+ *          deadline. The first use of a session in a tick takes the lock and moves the session to
+ *          the slot of its new deadline, later uses in the same tick take no lock. So a slot only
+ *          holds the sessions due when it comes up, and a tick only visits the sessions it expires.
+ *          With an idle time beyond the wheel, a slot also holds sessions of later rounds.
+ *
+ *          Resolving a session id takes no lock otherwise. The pool and the buckets are never freed
+ *          while the table is in use, and writers bump a version around every change of the buckets,
+ *          like a seqlock, so a lookup overlapping a change is repeated.
+ *
+ **/
+
+/* === Constants === */
+
+/** @brief Default memory limit of the session table in KiB. */
+#define SESSIONS_MEMORY (64 * 1024)
+/** @brief Default number of seconds after which an unused session expires. */
+#define SESSIONS_IDLE (1800)
+/** @brief Maximum number of slots of the timer wheel. @details Must be a power of two. */
+#define SESSIONS_WHEEL_MAX (1 << 18)
+/** @brief Duration of a tick of the timer wheel in milliseconds. */
+#define SESSIONS_TICK_MS (1000)
+/** @brief Size of the pool of random bytes session ids are drawn from. */
+#define SESSIONS_POOL (4096)
+/** @brief Marks the end of a list of sessions. */
+#define SESSIONS_NONE (UINT32_MAX)
+
+/* === Structs === */
+
+/**
+ * @brief Defines a session.
+ */
+struct session {
+    /** @brief The session id. */
+    char id[SIZE_SESS_ID];
+    /** @brief The next session in the same wheel slot or in the free list. */
+    uint32_t next;
+    /** @brief The previous session in the same wheel slot. */
+    uint32_t prev;
+    /** @brief The tick the session expires in, the last use plus the idle time. @details Locates its wheel slot. */
+    uint32_t due;
+    /** @brief The logged-in user. */
+    struct entry *entry;
+};
+
+/**
+ * @brief Defines a bucket of the session table.
+ */
+struct session_bucket {
+    /** @brief Index of the session plus one, 0 marks an empty bucket. */
+    uint32_t session;
+    /** @brief The lower 32 bits of the hash of the session id. */
+    uint32_t hash;
+};
+
+/**
+ * @brief Defines the session table.
+ * @details Uses linear probing with backward shift deletion and is kept at most half full. All
+ *          operations lock the table, sessions_find() only to move a session in the wheel.
+ */
+struct sessions {
+    /** @brief Serializes concurrent changes. */
+    pthread_mutex_t lock;
+    /** @brief Odd while the buckets change, raised by two by every change. */
+    uint32_t version;
+    /** @brief The buckets. */
+    struct session_bucket *buckets;
+    /** @brief Number of buckets. @details Is always a power of two. */
+    size_t capacity;
+    /** @brief The sessions. */
+    struct session *pool;
+    /** @brief Maximum number of sessions. */
+    uint32_t max;
+    /** @brief Number of sessions ever taken from the pool. */
+    uint32_t used;
+    /** @brief First session of the free list. */
+    uint32_t free;
+    /** @brief Number of active sessions. */
+    size_t count;
+    /** @brief Number of ticks after which an unused session expires. */
+    uint32_t idle;
+    /** @brief First session of each slot of the timer wheel. */
+    uint32_t *wheel;
+    /** @brief Number of slots of the timer wheel minus one. @details The number is a power of two. */
+    uint32_t wheel_mask;
+    /** @brief The last tick the wheel was advanced to. */
+    uint32_t tick;
+    /** @brief Random bytes for session ids. */
+    unsigned char random[SESSIONS_POOL];
+    /** @brief Number of random bytes consumed. */
+    size_t consumed;
+};
+
+/* === Prototypes === */
+
+/**
+ * @brief Initializes an empty session table.
+ * @param sessions The session table.
+ * @param memory The memory limit in bytes.
+ * @param idle Number of seconds after which an unused session expires.
+ * @return 0 on success, -1 on error.
+ */
+int sessions_init(struct sessions *sessions, size_t memory, uint32_t idle);
+/**
+ * @brief Frees a session table.
+ * @param sessions The session table.
+ */
+void sessions_free(struct sessions *sessions);
+/**
+ * @brief Resolves a session id and marks the session as used.
+ * @details Takes the lock only on the first use of the session in a tick, to move it in the wheel.
+ * @param sessions The session table.
+ * @param id The session id.
+ * @return The entry of the logged-in user on success, NULL if the session is invalid.
+ */
+struct entry *sessions_find(struct sessions *sessions, const char *id);
+/**
+ * @brief Creates a session with a fresh random id.
+ * @details Replaces the session with the earliest deadline in the next non-empty slot of the wheel
+ *          if the table is full.
+ * @param sessions The session table.
+ * @param entry The logged-in user.
+ * @param id Receives the SIZE_SESS_ID characters of the session id, not NUL-terminated.
+ * @return The number of replaced sessions on success, -1 on error.
+ */
+int sessions_create(struct sessions *sessions, struct entry *entry, char *id);
+/**
+ * @brief Removes a session.
+ * @param sessions The session table.
+ * @param id The session id.
+ * @param owner Only remove the session if it belongs to this entry, NULL removes any session.
+ * @return The entry of the logged-out user on success, NULL if the session does not exist.
+ */
+struct entry *sessions_remove(struct sessions *sessions, const char *id, const struct entry *owner);
+/**
+ * @brief Advances the timer wheel to the current tick and removes the expired sessions.
+ * @param sessions The session table.
+ * @return The number of expired sessions.
+ */
+size_t sessions_expire(struct sessions *sessions);
@@ -16,18 +16,306 @@
 #include <sys/wait.h>
 #include <sys/types.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <stdarg.h>
 #include <assert.h>
 #include <fcntl.h>
-#include <semaphore.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <stdbool.h>
 #include <sys/time.h>
+#include <signal.h>
 #include "shared.h"
 
-/* === Global Variables === */
+/* === Implementations === */
 
-/** @brief Semaphor to allow client the initial request. @details Is a binary semaphor. */
-sem_t *sem1;
-/** @brief Semaphor to allow client further commands when logged in. @details Is a binary semaphor. */
-sem_t *sem2;
-/** @brief Semaphor to sync waiting for response from server. @details Is a binary semaphor. */
-sem_t *sem3;
+/**
+ * @brief Tells the CPU that the caller busy-waits.
+ */
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+uint64_t now_ns(void) {
+    struct timespec ts;
+
+    (void) clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+const char *status_name(status code) {
+    static const char *names[] = {
+        "STATUS_NONE", "SESSION_FAILED", "LOGIN_SUCCESS", "LOGIN_FAILED", "REGISTER_SUCCESS", "LOGOUT_SUCCESS",
+        "LOGOUT_FAILED", "REGISTER_FAILED", "WRITE_SECRET_SUCCESS", "WRITE_SECRET_FAILED", "READ_SECRET_FAILED",
+        "IMPORT_SUCCESS", "IMPORT_FAILED", "EXPORT_SUCCESS", "EXPORT_FAILED"
+    };
+
+    if ((size_t) code >= sizeof names / sizeof names[0]) {
+        return "STATUS_INVALID";
+    }
+    return names[code];
+}
+
+uint64_t hash_string(const char *s) {
+    return hash_bytes(s, strlen(s));
+}
+
+long shard_of(uint64_t hash, long shards) {
+    /* the finalizer of MurmurHash3, every input bit affects every output bit */
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return (long) (((hash >> 32) * (uint64_t) shards) >> 32);
+}
+
+int shard_parse(const char *spec, long *shard, long *shards) {
+    char *end;
+
+    *shard = strtol(spec, &end, 10);
+    if (end == spec || *end != '/') {
+        return -1;
+    }
+    spec = end + 1;
+    *shards = strtol(spec, &end, 10);
+    if (end == spec || *end != '\0' || *shards < 1 || *shards > SHARDS_MAX || *shard < 0 || *shard >= *shards) {
+        return -1;
+    }
+    return 0;
+}
+
+void shard_name(char *name, size_t size, const char *base, long shard, long shards) {
+    const char *dot = strchr(base, '.');
+
+    if (shards == 1) {
+        (void) snprintf(name, size, "%s", base);
+    } else if (dot == NULL) {
+        (void) snprintf(name, size, "%s-%ld", base, shard);
+    } else {
+        (void) snprintf(name, size, "%.*s-%ld%s", (int) (dot - base), base, shard, dot);
+    }
+}
+
+uint64_t hash_bytes(const void *data, size_t len) {
+    const unsigned char *p = data;
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (size_t i = 0; i < len; i++) {
+        hash ^= p[i];
+        hash *= 1099511628211ULL;
+    }
+    /* 0 marks empty buckets */
+    return hash != 0 ? hash : 1;
+}
+
+int futex_await(uint32_t *word, uint32_t old, uint32_t *sleepers, uint32_t spin_us) {
+    return futex_await_for(word, old, sleepers, spin_us, WAIT_TIMEOUT_MS * 1000);
+}
+
+int futex_await_for(uint32_t *word, uint32_t old, uint32_t *sleepers, uint32_t spin_us, uint32_t timeout_us) {
+    const struct timespec timeout = { timeout_us / 1000000, (timeout_us % 1000000) * 1000L };
+    uint64_t deadline;
+    int ret = 0;
+
+    /* spin phase: a busy peer answers within microseconds */
+    if (spin_us > 0) {
+        deadline = now_ns() + (uint64_t) spin_us * 1000;
+        for (int i = 1; __atomic_load_n(word, __ATOMIC_ACQUIRE) == old; i++) {
+            cpu_relax();
+            if (i % 64 == 0 && now_ns() >= deadline) {
+                break;
+            }
+        }
+    }
+    /* block phase: announce the sleeper before the final check, futex_wake() checks it after the change */
+    (void) __atomic_add_fetch(sleepers, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(word, __ATOMIC_SEQ_CST) == old) {
+        if (syscall(SYS_futex, word, FUTEX_WAIT, old, &timeout, NULL, 0) == -1 && errno == EINTR) {
+            ret = -1;
+        }
+    }
+    (void) __atomic_sub_fetch(sleepers, 1, __ATOMIC_SEQ_CST);
+    return ret;
+}
+
+void futex_wake(uint32_t *word, uint32_t *sleepers) {
+    if (__atomic_load_n(sleepers, __ATOMIC_SEQ_CST) > 0) {
+        (void) syscall(SYS_futex, word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+    }
+}
+
+size_t fragment_size(uint32_t slot_size) {
+    return sizeof(struct shared_fragment) + (size_t) NUM_SLOTS * slot_size;
+}
+
+struct shared_fragment *fragment_attach(int shmfd, size_t *size) {
+    struct shared_fragment *shared;
+    struct stat st;
+
+    if (fstat(shmfd, &st) == -1) {
+        return NULL;
+    }
+    /* the server sizes the object right after creating it */
+    if ((size_t) st.st_size < fragment_size(SLOT_SIZE_MIN)) {
+        errno = EAGAIN;
+        return NULL;
+    }
+    if ((shared = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, shmfd, 0)) == MAP_FAILED) {
+        return NULL;
+    }
+    if (shared->slot_size < SLOT_SIZE_MIN || shared->slot_size > SLOT_SIZE_MAX
+        || shared->slot_size % CACHE_LINE != 0 || fragment_size(shared->slot_size) > (size_t) st.st_size) {
+        (void) munmap(shared, st.st_size);
+        errno = EAGAIN;
+        return NULL;
+    }
+    *size = st.st_size;
+    return shared;
+}
+
+struct slot *slot_at(struct shared_fragment *shared, int index) {
+    return (struct slot *) (shared->slots + (size_t) index * shared->slot_size);
+}
+
+void slot_begin(struct slot *slot, uint32_t count) {
+    (void) memset(slot->messages, 0, count * sizeof slot->messages[0]);
+    slot->count = count;
+    slot->length = sizeof *slot + count * sizeof slot->messages[0];
+}
+
+int slot_put(struct slot *slot, size_t size, struct field *field, const char *s, size_t len) {
+    uint32_t offset = slot->length;
+
+    if (offset > size || len >= size - offset) {
+        return -1;
+    }
+    (void) memmove((char *) slot + offset, s, len);
+    ((char *) slot)[offset + len] = '\0';
+    field->offset = offset;
+    field->length = len;
+    slot->length = offset + len + 1;
+    return 0;
+}
+
+char *slot_get(struct slot *slot, size_t size, const struct field *field, size_t *len) {
+    /* read once, the peer may change the slot meanwhile */
+    uint32_t offset = field->offset, length = field->length;
+    char *s = (char *) slot + offset;
+
+    if (offset < sizeof *slot || offset >= size || length >= size - offset) {
+        return NULL;
+    }
+    s[length] = '\0';
+    if (len != NULL) {
+        *len = length;
+    }
+    return s;
+}
+
+struct slot *slot_claim(struct shared_fragment *shared) {
+    struct slot *slot;
+    uint32_t expected;
+    int32_t owner, pid = (int32_t) getpid();
+    int start = pid % NUM_SLOTS;
+
+    for (int i = 0; i < NUM_SLOTS; i++) {
+        slot = slot_at(shared, (start + i) % NUM_SLOTS);
+        /* take the owner first, so a client killed while claiming leaves a slot the server can recover */
+        owner = 0;
+        if (!__atomic_compare_exchange_n(&slot->owner, &owner, pid, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+            continue;
+        }
+        expected = SLOT_FREE;
+        if (__atomic_compare_exchange_n(&slot->state, &expected, SLOT_CLAIMED, false,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            return slot;
+        }
+        __atomic_store_n(&slot->owner, 0, __ATOMIC_SEQ_CST);
+    }
+    return NULL;
+}
+
+struct slot *slot_acquire(struct shared_fragment *shared) {
+    struct slot *slot;
+    uint32_t released;
+
+    while (shared->server_down == -1) {
+        released = __atomic_load_n(&shared->released, __ATOMIC_SEQ_CST);
+        if ((slot = slot_claim(shared)) != NULL) {
+            return slot;
+        }
+        /* all slots busy, wait for a release */
+        if (futex_await(&shared->released, released, &shared->released_sleepers, shared->spin_us) == -1) {
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+void slot_post(struct shared_fragment *shared, struct slot *slot) {
+    __atomic_store_n(&slot->state, SLOT_SUBMITTED, __ATOMIC_SEQ_CST);
+    /* ring the doorbell */
+    (void) __atomic_add_fetch(&shared->doorbell, 1, __ATOMIC_SEQ_CST);
+    futex_wake(&shared->doorbell, &shared->doorbell_sleepers);
+}
+
+int slot_submit(struct shared_fragment *shared, struct slot *slot) {
+    uint32_t state;
+
+    slot_post(shared, slot);
+    /* wait for the response */
+    while ((state = __atomic_load_n(&slot->state, __ATOMIC_ACQUIRE)) != SLOT_DONE) {
+        if (shared->server_down != -1) {
+            return -1;
+        }
+        if (futex_await(&slot->state, state, &slot->sleepers, shared->spin_us) == -1) {
+            return -1;
+        }
+    }
+    __atomic_store_n(&slot->state, SLOT_CLAIMED, __ATOMIC_RELAXED);
+    return 0;
+}
+
+int slot_release(struct shared_fragment *shared, struct slot *slot) {
+    uint32_t state = SLOT_SUBMITTED;
+
+    /* withdraw the request if the server did not pick it up yet, otherwise wait for it */
+    if (__atomic_compare_exchange_n(&slot->state, &state, SLOT_CLAIMED, false,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE) == false) {
+        while (state == SLOT_PROCESSING && shared->server_down == -1) {
+            (void) futex_await(&slot->state, state, &slot->sleepers, shared->spin_us);
+            state = __atomic_load_n(&slot->state, __ATOMIC_ACQUIRE);
+        }
+    }
+    /* give the owner back last, nobody claims the slot before */
+    __atomic_store_n(&slot->state, SLOT_FREE, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&slot->owner, 0, __ATOMIC_SEQ_CST);
+    (void) __atomic_add_fetch(&shared->released, 1, __ATOMIC_SEQ_CST);
+    futex_wake(&shared->released, &shared->released_sleepers);
+    return 0;
+}
+
+int slot_recover(struct shared_fragment *shared, struct slot *slot) {
+    uint32_t state = __atomic_load_n(&slot->state, __ATOMIC_SEQ_CST);
+    int32_t owner = __atomic_load_n(&slot->owner, __ATOMIC_SEQ_CST);
+
+    /* only ESRCH means dead, EPERM is a living process of another user */
+    if (!SLOT_RECOVERABLE(state) || owner <= 0 || kill(owner, 0) == 0 || errno != ESRCH) {
+        return 0;
+    }
+    /* a slot released and claimed again meanwhile changed its state or its owner */
+    if (__atomic_load_n(&slot->owner, __ATOMIC_SEQ_CST) != owner
+        || !__atomic_compare_exchange_n(&slot->state, &state, SLOT_CLAIMED, false,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        return 0;
+    }
+    /* the dead owner may have been blocked on the state word */
+    __atomic_store_n(&slot->sleepers, 0, __ATOMIC_RELAXED);
+    (void) slot_release(shared, slot);
+    return 1;
+}
@@ -11,19 +11,44 @@
 
 /** @brief File name of the shared fragment */
 #define SHM_NAME "/1429167fragment"
-/** @brief Permission of the semaphor files created in /dev/shm/ */
+/** @brief Permission of the shared memory object created in /dev/shm/ */
 #define PERMISSION (0660)
-/** @brief Maximum length of all input data strings. */
+/** @brief Maximum length of usernames and passwords, including the terminating NUL. */
 #define MAX_DATA (100)
 /** @brief Size of the session id */
 #define SIZE_SESS_ID (20)
-
-/** @brief File name of semaphor 1. */
-#define SEM1_NAME "/1429167sem1"
-/** @brief File name of semaphor 2. */
-#define SEM2_NAME "/1429167sem2"
-/** @brief File name of semaphor 3. */
-#define SEM3_NAME "/1429167sem3"
+/** @brief Number of request slots in the shared fragment. */
+#define NUM_SLOTS (32)
+/** @brief Maximum number of commands submitted at once in one slot. */
+#define BATCH_MAX (16)
+/** @brief Size of a cache line, slots are aligned to it to avoid false sharing between clients. */
+#define CACHE_LINE (64)
+/** @brief Default size of a request slot in bytes, bounds the size of the secrets. */
+#define SLOT_SIZE (4096)
+/** @brief Smallest size of a request slot in bytes. */
+#define SLOT_SIZE_MIN (1024)
+/** @brief Largest size of a request slot in bytes. */
+#define SLOT_SIZE_MAX (1 << 24)
+/** @brief Maximum length of a secret, larger ones than a slot are transferred in chunks. */
+#define SECRET_MAX (64 * 1024 * 1024)
+/** @brief Default time in microseconds a waiter spins before it blocks in the kernel. */
+#define SPIN_US (50)
+/** @brief Time in milliseconds after which a blocked waiter re-checks whether the server is still up. */
+#define WAIT_TIMEOUT_MS (1000)
+/** @brief File name of the statistics page of the server. */
+#define STATS_NAME "/1429167stats"
+/** @brief Permission of the statistics page, only the server writes to it. */
+#define STATS_PERMISSION (0444)
+/** @brief Maximum number of shards of a sharded deployment. */
+#define SHARDS_MAX (64)
+/** @brief Size of the name of an object of a shard, including the terminating NUL. */
+#define SHARD_NAME_MAX (64)
+/** @brief Number of counted request kinds: register, login, write, read and logout. */
+#define STATS_COMMANDS (5)
+/** @brief Number of counted status codes. */
+#define STATS_STATUSES (EXPORT_FAILED + 1)
+/** @brief Number of latency buckets, bucket i counts latencies in [2^i, 2^(i+1)) nanoseconds. */
+#define STATS_BUCKETS (40)
 
 /* === Enums === */
 
@@ -31,58 +56,360 @@
 typedef enum {
     COMMAND_NONE, WRITE, READ, LOGOUT
 } cmd;
-/** @brief Possible operating modes of the client. */
+/** @brief Possible operating modes of the client. @details IMPORT and EXPORT are sent by auth-admin. */
 typedef enum {
-    MODE_UNSET, REGISTER, LOGIN
+    MODE_UNSET, REGISTER, LOGIN, IMPORT, EXPORT
 } mode;
 /** @brief Possible status codes in shared_command. */
 typedef enum {
     STATUS_NONE, SESSION_FAILED, LOGIN_SUCCESS, LOGIN_FAILED, REGISTER_SUCCESS, LOGOUT_SUCCESS,
-    LOGOUT_FAILED, REGISTER_FAILED, WRITE_SECRET_SUCCESS, WRITE_SECRET_FAILED
+    LOGOUT_FAILED, REGISTER_FAILED, WRITE_SECRET_SUCCESS, WRITE_SECRET_FAILED, READ_SECRET_FAILED,
+    IMPORT_SUCCESS, IMPORT_FAILED, EXPORT_SUCCESS, EXPORT_FAILED
 } status;
+/** @brief Possible states of a request slot. */
+typedef enum {
+    SLOT_FREE, SLOT_CLAIMED, SLOT_SUBMITTED, SLOT_PROCESSING, SLOT_DONE
+} slot_state;
 
 /* === Structs === */
 
 /**
- * @brief Defines an entry in the database of the server.
+ * @brief Refers to a string in the payload of a request slot.
  */
-struct entry {
-    /** @brief Holds the username of a registered user. */
-    char username[MAX_DATA];
-    /** @brief Holds the password of a registered user. */
-    char password[MAX_DATA];
-    /** @brief Holds the secret of a registered user. @details Can be left blank if user has no secret stored. */
-    char secret[MAX_DATA];
-    /** @brief Holds the session id of a registered user. @details Is left blank if user is not logged in. */
-    char session_id[MAX_DATA];
-    /** @brief Points to the next entry in the list. */
-    struct entry* next;
+struct field {
+    /** @brief Offset of the string from the start of the slot. */
+    uint32_t offset;
+    /** @brief Length of the string, excluding the terminating NUL behind it. */
+    uint32_t length;
 };
 
 /**
- * @brief Defines a shared memory consisting a command and data from the client.
+ * @brief Defines a command of a request slot and its response.
+ * @details The strings live in the payload of the slot, so a message only moves the bytes it uses.
+ *
+ *          A secret exceeding a slot is moved in chunks, one round trip each, so a transfer never
+ *          holds more than one slot and small requests pass in between. On WRITE, the client sends
+ *          the chunks in order with their position and the total length, the server keeps them
+ *          until the last one arrives. On READ, the server returns as much as fits from the
+ *          requested position, see MESSAGE_PARTIAL(). The client asks for the rest with the
+ *          generation of the first chunk, a READ_SECRET_FAILED tells it the secret changed meanwhile.
+ *
+ *          IMPORT carries whole lines of a csv database in the secret, the server adds their users
+ *          and returns the number of added users in total and of skipped lines in position, with
+ *          IMPORT_SUCCESS or IMPORT_FAILED. EXPORT carries the path of a FIFO in the secret, the
+ *          server writes a csv image of all users into it and returns their number in total, with
+ *          EXPORT_SUCCESS or EXPORT_FAILED.
  */
-struct shared_command {
+struct message {
     /** @brief Holds the response code of the server when a user requests a action. */
-    status status;
-/** @brief Defines the modus in which a client operates for a given user (username, password). @details Is either REGISTER or LOGIN. */
-    mode modus;
+    uint8_t status;
+    /** @brief Defines the modus in which a client operates for a given user (username, password). @details Is either REGISTER, LOGIN, IMPORT or EXPORT. */
+    uint8_t modus;
     /** @brief Defines the command the server should execute for a given logged-in user (username, password). @details Is either READ, WRITE or LOGOUT */
-    cmd command;
-    /** @brief Holds the session id. Has to be sent on every request from the client to the server. */
-    char session_id[MAX_DATA];
-    /** @brief Required username attribute. @details Is checked on every request */
-    char username[MAX_DATA];
-    /** @brief Required password attribute. @details Is checked on every request */
-    char password[MAX_DATA];
-    /** @brief Holds the secret of a user. */
-    char secret[MAX_DATA];
+    uint8_t command;
+    /** @brief Unused, keeps the session id aligned. */
+    uint8_t reserved;
+    /** @brief Holds the session id. Has to be sent on every request from the client to the server.
+     *  @details Is the only credential of a logged-in command, not NUL-terminated. */
+    char session_id[SIZE_SESS_ID];
+    /** @brief Username attribute. @details Is only sent on REGISTER and LOGIN. */
+    struct field username;
+    /** @brief Password attribute. @details Is only sent on REGISTER and LOGIN. */
+    struct field password;
+    /** @brief The secret sent on WRITE, or returned on READ. @details Is a chunk of it if the secret
+     *         exceeds a slot. */
+    struct field secret;
+    /** @brief Offset of the chunk within the secret. */
+    uint32_t position;
+    /** @brief Length of the whole secret. @details Sent on WRITE, returned on READ. */
+    uint32_t total;
+    /** @brief Generation of the secret returned on READ, sent back to read its next chunk. */
+    uint32_t generation;
+};
+
+/**
+ * @brief Defines a request slot in the shared fragment.
+ * @details A client claims a free slot, submits up to BATCH_MAX commands and waits on the slot's
+ *          state word until the server executed all of them. A logged-in command of a batch with an
+ *          empty session id uses the session of the last successful LOGIN before it in the batch.
+ *
+ *          A client killed while holding a slot would keep it forever, so the slot carries the
+ *          process id of its owner, which the server checks for life.
+ *
+ *          The messages are followed by the payload, holding their strings back to back. The server
+ *          appends the secrets returned on READ behind the request strings. A slot occupies
+ *          shared_fragment.slot_size bytes.
+ */
+struct slot {
+    /** @brief The slot_state of the slot. @details Futex word, only accessed with atomic operations. */
+    uint32_t state;
+    /** @brief Number of clients blocked in the kernel on the state word. */
+    uint32_t sleepers;
+    /** @brief Number of submitted commands. */
+    uint32_t count;
+    /** @brief Number of used bytes from the start of the slot, i.e. the offset of the free payload. */
+    uint32_t length;
+    /** @brief Process id of the client holding the slot, 0 while it is free.
+     *  @details Taken before the state on claiming and given back after it on releasing, so no slot
+     *           is claimed without an owner. The server frees the slot once the owner died, see
+     *           SLOT_RECOVERABLE(). */
+    int32_t owner;
+    /** @brief The commands, executed in order. */
+    struct message messages[];
+} __attribute__((aligned(CACHE_LINE)));
+
+/**
+ * @brief Defines the shared fragment consisting of NUM_SLOTS request slots.
+ * @details The futex words are kept on separate cache lines, so clients ringing the doorbell do not
+ *          contend with clients waiting for a free slot.
+ */
+struct shared_fragment {
     /** @brief Indicates a termination of the server. */
     int server_down;
+    /** @brief Time in microseconds a waiter spins before blocking. @details Set by the server. */
+    uint32_t spin_us;
+    /** @brief Size of a request slot in bytes, a multiple of CACHE_LINE. @details Set by the server. */
+    uint32_t slot_size;
+    /** @brief Doorbell of the server. @details Futex word, incremented on every submitted request. */
+    uint32_t doorbell __attribute__((aligned(CACHE_LINE)));
+    /** @brief Number of server threads blocked on the doorbell. */
+    uint32_t doorbell_sleepers;
+    /** @brief Incremented whenever a slot is released. @details Futex word. */
+    uint32_t released __attribute__((aligned(CACHE_LINE)));
+    /** @brief Number of clients blocked while waiting for a free slot. */
+    uint32_t released_sleepers;
+    /** @brief Incremented once per pass in which the server finished slots. @details Futex word. */
+    uint32_t completed __attribute__((aligned(CACHE_LINE)));
+    /** @brief Number of clients blocked while waiting for any of their slots to finish. */
+    uint32_t completed_sleepers;
+    /** @brief The NUM_SLOTS request slots, see slot_at(). */
+    unsigned char slots[] __attribute__((aligned(CACHE_LINE)));
 };
 
+/**
+ * @brief Counters of one server thread in the statistics page.
+ * @details Only written by the owning thread, so counting needs no atomic read-modify-write.
+ *          Readers sum up the blocks of all threads.
+ */
+struct stats_block {
+    /** @brief Handled commands per kind, see STATS_COMMANDS. */
+    uint64_t commands[STATS_COMMANDS];
+    /** @brief Responses per status code. */
+    uint64_t statuses[STATS_STATUSES];
+    /** @brief Handled request slots. */
+    uint64_t requests;
+    /** @brief Submitted slots the thread found in its last pass over the slots. */
+    uint64_t queued;
+    /** @brief Histogram of the time spent handling a request slot. */
+    uint64_t latency[STATS_BUCKETS];
+} __attribute__((aligned(CACHE_LINE)));
+
+/**
+ * @brief Statistics page of the server, mapped read-only by monitoring tools.
+ */
+struct stats {
+    /** @brief Set to 1 once the server shuts down. */
+    int32_t server_down;
+    /** @brief Number of server threads, i.e. of counter blocks. */
+    uint32_t nthreads;
+    /** @brief Monotonic time in nanoseconds at which the server started. */
+    uint64_t started;
+    /** @brief Number of registered users. */
+    uint64_t users;
+    /** @brief Number of active sessions. */
+    uint64_t sessions;
+    /** @brief The counter blocks of the server threads. */
+    struct stats_block threads[];
+};
+
+/* === Prototypes === */
+
+/**
+ * @brief Hashes a string with 64 bit FNV-1a.
+ * @param s The string.
+ * @return The hash, never 0.
+ */
+uint64_t hash_string(const char *s);
+/**
+ * @brief Hashes a buffer with 64 bit FNV-1a.
+ * @param data The buffer.
+ * @param len Length of the buffer in bytes.
+ * @return The hash, never 0.
+ */
+uint64_t hash_bytes(const void *data, size_t len);
+/**
+ * @brief Returns the shard owning a username.
+ * @details Every shard owns a contiguous range of the hash space. The hash is mixed first, since
+ *          FNV-1a leaves the upper bits of short usernames alike.
+ * @param hash The hash of the username, see hash_string().
+ * @param shards Number of shards.
+ * @return The index of the shard.
+ */
+long shard_of(uint64_t hash, long shards);
+/**
+ * @brief Parses a shard given as "index/count", e.g. "0/4".
+ * @param spec The shard.
+ * @param shard Receives the index of the shard.
+ * @param shards Receives the number of shards, at most SHARDS_MAX.
+ * @return 0 on success, -1 if the shard is invalid.
+ */
+int shard_parse(const char *spec, long *shard, long *shards);
+/**
+ * @brief Names an object of a shard, such as its shared fragment or its database.
+ * @details Inserts "-index" in front of the first '.' of the name, or appends it to a name
+ *          without one, e.g. "auth-server-2.db.csv". Without sharding the name is unchanged, so
+ *          an unsharded server keeps its names.
+ * @param name Receives the name.
+ * @param size Size of the buffer.
+ * @param base The name of the object of an unsharded server.
+ * @param shard The index of the shard.
+ * @param shards Number of shards.
+ */
+void shard_name(char *name, size_t size, const char *base, long shard, long shards);
+
+/**
+ * @brief Returns the name of a status code.
+ * @param code The status code.
+ * @return The name, e.g. "LOGIN_SUCCESS".
+ */
+const char *status_name(status code);
+/**
+ * @brief Returns the monotonic time in nanoseconds.
+ */
+uint64_t now_ns(void);
+/**
+ * @brief Waits until a futex word differs from a given value.
+ * @details Spins for up to spin_us microseconds, then blocks in the kernel for at most
+ *          WAIT_TIMEOUT_MS milliseconds. Callers have to re-check their condition in a loop.
+ * @param word The futex word.
+ * @param old The value to wait away from.
+ * @param sleepers Counter of blocked waiters, used by futex_wake() to skip needless system calls.
+ * @param spin_us Time in microseconds to spin before blocking.
+ * @return 0 on success, -1 if interrupted by a signal.
+ */
+int futex_await(uint32_t *word, uint32_t old, uint32_t *sleepers, uint32_t spin_us);
+/**
+ * @brief Waits until a futex word differs from a given value, blocking for at most a given time.
+ * @details Like futex_await(), for callers that have to look at other words meanwhile.
+ * @param word The futex word.
+ * @param old The value to wait away from.
+ * @param sleepers Counter of blocked waiters.
+ * @param spin_us Time in microseconds to spin before blocking.
+ * @param timeout_us Time in microseconds to block at most.
+ * @return 0 on success, -1 if interrupted by a signal.
+ */
+int futex_await_for(uint32_t *word, uint32_t old, uint32_t *sleepers, uint32_t spin_us, uint32_t timeout_us);
+/**
+ * @brief Wakes up all waiters blocked on a futex word.
+ * @details The caller has to change the word before. Does nothing if nobody sleeps.
+ * @param word The futex word.
+ * @param sleepers Counter of blocked waiters.
+ */
+void futex_wake(uint32_t *word, uint32_t *sleepers);
+
+/**
+ * @brief Returns the size of a shared fragment.
+ * @param slot_size Size of a request slot in bytes.
+ * @return The size in bytes.
+ */
+size_t fragment_size(uint32_t slot_size);
+/**
+ * @brief Maps the shared fragment created by the server.
+ * @param shmfd The file descriptor of the shared memory object.
+ * @param size Receives the size of the mapping in bytes.
+ * @return The fragment on success, NULL on error. errno is EAGAIN if the server did not size it yet.
+ */
+struct shared_fragment *fragment_attach(int shmfd, size_t *size);
+/**
+ * @brief Returns a request slot of the shared fragment.
+ * @param shared The shared fragment.
+ * @param index The index of the slot, less than NUM_SLOTS.
+ * @return The slot.
+ */
+struct slot *slot_at(struct shared_fragment *shared, int index);
+/**
+ * @brief Clears a claimed slot for a number of commands.
+ * @param slot The slot.
+ * @param count Number of commands, at most BATCH_MAX.
+ */
+void slot_begin(struct slot *slot, uint32_t count);
+/**
+ * @brief Appends a string to the payload of a slot.
+ * @param slot The slot.
+ * @param size Size of the slot in bytes.
+ * @param field Receives the location of the string.
+ * @param s The string, need not be NUL-terminated. May already lie at the end of the payload.
+ * @param len Length of the string.
+ * @return 0 on success, -1 if the string does not fit into the slot.
+ */
+int slot_put(struct slot *slot, size_t size, struct field *field, const char *s, size_t len);
+/**
+ * @brief Resolves a string in the payload of a slot.
+ * @details Terminates the string, so a peer cannot make the reader run past it.
+ * @param slot The slot.
+ * @param size Size of the slot in bytes.
+ * @param field The location of the string.
+ * @param len Receives the length of the string, may be NULL.
+ * @return The string on success, NULL if the field lies outside the payload.
+ */
+char *slot_get(struct slot *slot, size_t size, const struct field *field, size_t *len);
+/**
+ * @brief Claims a free slot in the shared fragment without waiting.
+ * @param shared The shared fragment.
+ * @return The claimed slot, NULL if all slots are busy.
+ */
+struct slot *slot_claim(struct shared_fragment *shared);
+/**
+ * @brief Claims a free slot in the shared fragment.
+ * @details Blocks until a slot is free.
+ * @param shared The shared fragment.
+ * @return The claimed slot on success, NULL otherwise.
+ */
+struct slot *slot_acquire(struct shared_fragment *shared);
+/**
+ * @brief Submits the commands of a claimed slot without waiting for the response.
+ * @details The slot is finished once its state is SLOT_DONE, shared_fragment.completed tells when
+ *          to look.
+ * @param shared The shared fragment.
+ * @param slot The claimed slot.
+ */
+void slot_post(struct shared_fragment *shared, struct slot *slot);
+/**
+ * @brief Submits the command of a claimed slot and waits for the response of the server.
+ * @param shared The shared fragment.
+ * @param slot The claimed slot.
+ * @return 0 on success, -1 on error.
+ */
+int slot_submit(struct shared_fragment *shared, struct slot *slot);
+/**
+ * @brief Frees a slot whose owner died.
+ * @details Nobody else claims a slot while it has an owner, so a dead owner means nobody will release
+ *          the slot, even if the owner died while claiming or releasing it. A reused process id keeps
+ *          the slot until that process exits.
+ * @param shared The shared fragment.
+ * @param slot The slot.
+ * @return 1 if the slot was freed, 0 otherwise.
+ */
+int slot_recover(struct shared_fragment *shared, struct slot *slot);
+/**
+ * @brief Gives a slot back to the shared fragment.
+ * @details If the request is still pending, waits until the server has finished it.
+ * @param shared The shared fragment.
+ * @param slot The slot to release.
+ * @return 0 on success, -1 on error.
+ */
+int slot_release(struct shared_fragment *shared, struct slot *slot);
+
 /* === Macros === */
 
+/** @brief Whether a slot may be held by a dead client, i.e. is claimed or finished but not released, or
+ *         free but still owned by a client that died while claiming or releasing it. */
+#define SLOT_RECOVERABLE(state) ((state) == SLOT_CLAIMED || (state) == SLOT_DONE || (state) == SLOT_FREE)
+
+/** @brief Whether a READ returned only part of the secret, the server stops the batch after it. */
+#define MESSAGE_PARTIAL(m) ((m)->command == READ && (m)->status == LOGIN_SUCCESS \
+                            && (uint64_t) (m)->position + (m)->secret.length < (m)->total)
+
 /**
  * @brief Provides a debugging function to output status messages
  * @details Activate/Deactivate by adding/removing -DENDEBUG to DEFS in Makefile.
@@ -0,0 +1,295 @@
+/**
+ * @file snapshot.c
+ * @author Martin Weise <e1429167@student.tuwien.ac.at>
+ * @date 16.10.2026
+ *
+ * @brief Binary snapshot file.
+ *
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "shared.h"
+#include "store.h"
+#include "snapshot.h"
+
+/* === Constants === */
+
+/** @brief Size of the stdio buffer used to write a snapshot. */
+#define SNAPSHOT_BUFFER (1 << 20)
+
+/* === Prototypes === */
+
+/**
+ * @brief Continues a checksum over a buffer.
+ * @details Consumes 8 bytes per step, so verifying a large snapshot costs little more than reading
+ *          it. The checksum of consecutive buffers equals that of their concatenation as long as
+ *          all but the last one have a length that is a multiple of 8.
+ * @param sum The checksum of the preceding data, 0 at the start.
+ * @param data The buffer.
+ * @param len Length of the buffer in bytes.
+ * @return The new checksum.
+ */
+static uint64_t checksum(uint64_t sum, const void *data, size_t len);
+/**
+ * @brief Returns the size of an entry in the heap of a snapshot.
+ * @param entry The entry.
+ * @return The size in bytes, a multiple of 8.
+ */
+static size_t record_size(struct entry *entry);
+/**
+ * @brief Maps a snapshot and verifies its header.
+ * @param path The file name.
+ * @param prot The protection of the mapping.
+ * @param flags The flags of the mapping.
+ * @param size Is set to the size of the mapping.
+ * @return The mapping on success, NULL on error. errno is EINVAL if the header is invalid.
+ */
+static char *map_snapshot(const char *path, int prot, int flags, size_t *size);
+
+/* === Implementations === */
+
+static uint64_t checksum(uint64_t sum, const void *data, size_t len) {
+    const unsigned char *p = data;
+    uint64_t word;
+
+    for (; len >= 8; len -= 8, p += 8) {
+        (void) memcpy(&word, p, 8);
+        sum = (sum ^ word) * 0x9E3779B97F4A7C15ULL;
+        sum ^= sum >> 32;
+    }
+    if (len > 0) {
+        word = 0;
+        (void) memcpy(&word, p, len);
+        sum = (sum ^ word ^ len) * 0x9E3779B97F4A7C15ULL;
+        sum ^= sum >> 32;
+    }
+    return sum;
+}
+
+static size_t record_size(struct entry *entry) {
+    size_t size = offsetof(struct entry, data) + entry->username_len + strlen(ENTRY_PASSWORD(entry))
+                  + strlen(ENTRY_SECRET(entry)) + 3;
+
+    return (size + 7) & ~(size_t) 7;
+}
+
+static char *map_snapshot(const char *path, int prot, int flags, size_t *size) {
+    const struct snapshot_header *header;
+    struct stat st;
+    char *map;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) == -1) {
+        return NULL;
+    }
+    if (fstat(fd, &st) == -1) {
+        (void) close(fd);
+        return NULL;
+    }
+    if ((size_t) st.st_size < sizeof *header) {
+        (void) close(fd);
+        errno = EINVAL;
+        return NULL;
+    }
+    map = mmap(NULL, st.st_size, prot, flags, fd, 0);
+    (void) close(fd);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+    header = (const struct snapshot_header *) map;
+    if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof header->magic) != 0
+        || header->version != SNAPSHOT_VERSION || header->entry_size != offsetof(struct entry, data)
+        || header->header_checksum != checksum(0, header, offsetof(struct snapshot_header, header_checksum))
+        || header->capacity == 0 || (header->capacity & (header->capacity - 1)) != 0
+        || header->count >= header->capacity
+        || header->index_offset % 8 != 0 || header->heap_offset % 8 != 0 || header->index_offset < sizeof *header
+        || header->capacity > (UINT64_MAX - header->index_offset) / sizeof(struct snapshot_bucket)
+        || header->index_offset + header->capacity * sizeof(struct snapshot_bucket) > header->heap_offset
+        || header->heap_offset > (uint64_t) st.st_size || header->heap_size != st.st_size - header->heap_offset) {
+        (void) munmap(map, st.st_size);
+        errno = EINVAL;
+        return NULL;
+    }
+    *size = st.st_size;
+    return map;
+}
+
+int snapshot_probe(const char *path) {
+    char magic[sizeof ((struct snapshot_header *) NULL)->magic];
+    ssize_t len;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) == -1) {
+        return -1;
+    }
+    len = read(fd, magic, sizeof magic);
+    (void) close(fd);
+    if (len == -1) {
+        return -1;
+    }
+    return len == sizeof magic && memcmp(magic, SNAPSHOT_MAGIC, sizeof magic) == 0;
+}
+
+int snapshot_save(struct store *store, const char *path, uint64_t parent) {
+    static const char zeros[64];
+    struct snapshot_header header;
+    struct snapshot_bucket *index;
+    struct entry *entry, *record;
+    char tmp[PATH_MAX], *buffer = NULL, *grown;
+    size_t cursor = 0, count = 0, capacity = 16, offset = 0, i, size, buffer_size = 0;
+    const char *secret;
+    uint64_t hash;
+    FILE *file;
+    bool failed;
+
+    while ((entry = store_next(store, &cursor)) != NULL) {
+        count++;
+    }
+    while (capacity < 2 * count) {
+        capacity *= 2;
+    }
+    if ((index = calloc(capacity, sizeof *index)) == NULL) {
+        return -1;
+    }
+    /* lay out the heap in iteration order */
+    cursor = 0;
+    while ((entry = store_next(store, &cursor)) != NULL) {
+        hash = hash_bytes(ENTRY_USERNAME(entry), entry->username_len);
+        for (i = hash & (capacity - 1); index[i].hash != 0; i = (i + 1) & (capacity - 1)) {
+            continue;
+        }
+        index[i].hash = hash;
+        index[i].offset = offset;
+        offset += record_size(entry);
+    }
+
+    (void) memset(&header, 0, sizeof header);
+    (void) memcpy(header.magic, SNAPSHOT_MAGIC, sizeof header.magic);
+    header.version = SNAPSHOT_VERSION;
+    header.entry_size = offsetof(struct entry, data);
+    header.count = count;
+    header.capacity = capacity;
+    header.index_offset = (sizeof header + 63) & ~(size_t) 63;
+    header.heap_offset = header.index_offset + capacity * sizeof *index;
+    header.heap_size = offset;
+    header.parent = parent;
+    header.index_checksum = checksum(0, index, capacity * sizeof *index);
+
+    (void) snprintf(tmp, sizeof tmp, "%s.tmp", path);
+    if ((file = fopen(tmp, "w")) == NULL) {
+        free(index);
+        return -1;
+    }
+    (void) setvbuf(file, NULL, _IOFBF, SNAPSHOT_BUFFER);
+    /* the header is rewritten once the checksum of the heap is known */
+    failed = fwrite(&header, sizeof header, 1, file) != 1
+             || fwrite(zeros, header.index_offset - sizeof header, 1, file) != 1
+             || fwrite(index, sizeof *index, capacity, file) != capacity;
+    free(index);
+    cursor = 0;
+    while (!failed && (entry = store_next(store, &cursor)) != NULL) {
+        size = record_size(entry);
+        if (size > buffer_size) {
+            if ((grown = realloc(buffer, size)) == NULL) {
+                failed = true;
+                break;
+            }
+            buffer = grown;
+            buffer_size = size;
+        }
+        /* password and secret move back behind the username, the session is not persisted */
+        (void) memset(buffer, 0, size);
+        record = (struct entry *) buffer;
+        secret = ENTRY_SECRET(entry);
+        record->secret = NULL;
+        record->password = NULL;
+        record->secret_cap = strlen(secret) + 1;
+        record->username_len = entry->username_len;
+        record->password_len = strlen(ENTRY_PASSWORD(entry));
+        (void) memcpy(ENTRY_USERNAME(record), ENTRY_USERNAME(entry), entry->username_len + 1);
+        (void) memcpy(ENTRY_PASSWORD(record), ENTRY_PASSWORD(entry), record->password_len + 1);
+        (void) memcpy(ENTRY_SECRET(record), secret, record->secret_cap);
+        header.heap_checksum = checksum(header.heap_checksum, buffer, size);
+        failed = fwrite(buffer, size, 1, file) != 1;
+    }
+    free(buffer);
+    header.header_checksum = checksum(0, &header, offsetof(struct snapshot_header, header_checksum));
+    failed = failed || fseek(file, 0, SEEK_SET) == -1 || fwrite(&header, sizeof header, 1, file) != 1
+             || fflush(file) == EOF || fsync(fileno(file)) == -1;
+    if (fclose(file) == EOF) {
+        failed = true;
+    }
+    if (failed || rename(tmp, path) == -1) {
+        (void) unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+int snapshot_load(struct store *store, const char *path) {
+    const struct snapshot_header *header;
+    size_t size;
+    char *map;
+
+    /* logins and writes modify the entries in place, private pages keep the file untouched */
+    if ((map = map_snapshot(path, PROT_READ | PROT_WRITE, MAP_PRIVATE, &size)) == NULL) {
+        return -1;
+    }
+    header = (const struct snapshot_header *) map;
+    if (store_attach(store, map, size, (const struct snapshot_bucket *) (map + header->index_offset),
+                     header->capacity, header->count, map + header->heap_offset) == -1) {
+        (void) munmap(map, size);
+        return -1;
+    }
+    return 0;
+}
+
+int snapshot_verify(const char *path) {
+    const struct snapshot_header *header;
+    size_t size;
+    char *map;
+    bool valid;
+
+    if ((map = map_snapshot(path, PROT_READ, MAP_SHARED, &size)) == NULL) {
+        return -1;
+    }
+    (void) madvise(map, size, MADV_SEQUENTIAL);
+    header = (const struct snapshot_header *) map;
+    valid = header->index_checksum == checksum(0, map + header->index_offset,
+                                               header->capacity * sizeof(struct snapshot_bucket))
+            && header->heap_checksum == checksum(0, map + header->heap_offset, header->heap_size);
+    (void) munmap(map, size);
+    if (!valid) {
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+int snapshot_id(const char *path, uint64_t *id, uint64_t *parent) {
+    const struct snapshot_header *header;
+    size_t size;
+    char *map;
+
+    if ((map = map_snapshot(path, PROT_READ, MAP_SHARED, &size)) == NULL) {
+        return -1;
+    }
+    header = (const struct snapshot_header *) map;
+    /* 0 stands for a journal that was never rotated */
+    *id = header->header_checksum != 0 ? header->header_checksum : 1;
+    *parent = header->parent;
+    (void) munmap(map, size);
+    return 0;
+}
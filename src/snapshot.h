@@ -0,0 +1,99 @@
+/**
+ * @file snapshot.h
+ * @author Martin Weise <e1429167@student.tuwien.ac.at>
+ * @date 16.10.2026
+ *
+ * @brief Binary snapshot header file.
+ * @details A snapshot holds a prebuilt hash index and a heap of entries in their in-memory layout.
+ *          Loading it maps the file and attaches it to the store, so no entry is parsed or copied.
+ *
+ *          Layout: the header, the index of capacity snapshot_bucket at index_offset, and the heap
+ *          at heap_offset. Every entry in the heap starts at a multiple of 8 and carries its
+ *          strings behind it, see struct entry.
+ *
+ **/
+
+/* === Constants === */
+
+/** @brief Magic bytes at the start of a snapshot. */
+#define SNAPSHOT_MAGIC "AUTHSNAP"
+/** @brief Version of the snapshot layout, increased on every incompatible change. */
+#define SNAPSHOT_VERSION (4)
+/** @brief File name of the snapshot written on exit. */
+#define SNAPSHOT_NAME "auth-server.db.snap"
+
+/* === Structs === */
+
+/**
+ * @brief Defines the header of a snapshot.
+ */
+struct snapshot_header {
+    /** @brief Holds SNAPSHOT_MAGIC without the terminating NUL. */
+    char magic[8];
+    /** @brief Holds SNAPSHOT_VERSION. */
+    uint32_t version;
+    /** @brief Size of the header of an entry, rejects snapshots of incompatible builds. */
+    uint32_t entry_size;
+    /** @brief Number of users. */
+    uint64_t count;
+    /** @brief Number of buckets of the index, a power of two. */
+    uint64_t capacity;
+    /** @brief File offset of the index. */
+    uint64_t index_offset;
+    /** @brief File offset of the heap. */
+    uint64_t heap_offset;
+    /** @brief Size of the heap in bytes. */
+    uint64_t heap_size;
+    /** @brief Id of the checkpoint the journal followed when the snapshot was taken, 0 if none. */
+    uint64_t parent;
+    /** @brief Checksum of the index. */
+    uint64_t index_checksum;
+    /** @brief Checksum of the heap. */
+    uint64_t heap_checksum;
+    /** @brief Checksum of all fields above. */
+    uint64_t header_checksum;
+};
+
+/* === Prototypes === */
+
+/**
+ * @brief Checks whether a file is a snapshot.
+ * @param path The file name.
+ * @return 1 if the file starts with SNAPSHOT_MAGIC, 0 if not, -1 on error.
+ */
+int snapshot_probe(const char *path);
+/**
+ * @brief Writes all users of the store to a snapshot.
+ * @details Writes a temporary file first and renames it, so a crash never leaves a torn snapshot.
+ *          Not safe against concurrent modifications of the store.
+ * @param store The store.
+ * @param path The file name.
+ * @param parent The id of the checkpoint the journal follows, 0 if none.
+ * @return 0 on success, -1 on error.
+ */
+int snapshot_save(struct store *store, const char *path, uint64_t parent);
+/**
+ * @brief Maps a snapshot and attaches it to an empty store.
+ * @details Only verifies the header, so loading takes the same time for any number of users. The
+ *          index and the heap are verified by snapshot_verify().
+ * @param store The store.
+ * @param path The file name.
+ * @return 0 on success, -1 on error. errno is EINVAL if the snapshot is malformed or incompatible.
+ */
+int snapshot_load(struct store *store, const char *path);
+/**
+ * @brief Verifies the checksums of the index and the heap of a snapshot.
+ * @details Maps the file on its own, since the mapping of a loaded snapshot is modified in place.
+ * @param path The file name.
+ * @return 0 on success, -1 on error. errno is EINVAL if the snapshot is malformed or corrupt.
+ */
+int snapshot_verify(const char *path);
+/**
+ * @brief Reads the id of a snapshot, which names it in a rotated journal, see journal.h.
+ * @details The id is derived from the checksum of the header, so every checkpoint gets another one.
+ * @param path The file name.
+ * @param id Is set to the id, never 0.
+ * @param parent Is set to the id of the parent checkpoint, 0 if none.
+ * @return 0 on success, -1 on error. errno is EINVAL if the snapshot is malformed or incompatible.
+ */
+int snapshot_id(const char *path, uint64_t *id, uint64_t *parent);
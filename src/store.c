@@ -0,0 +1,694 @@
+/**
+ * @file store.c
+ * @author Martin Weise <e1429167@student.tuwien.ac.at>
+ * @date 16.10.2026
+ *
+ * @brief User store file.
+ *
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include "shared.h"
+#include "store.h"
+#include "reclaim.h"
+
+/* === Prototypes === */
+
+/**
+ * @brief Inserts an entry into a hash index without growing it.
+ * @details Fills the bucket before its hash, so concurrent lookups never see a half filled bucket.
+ * @param table The hash index.
+ * @param hash The hash of the username of the entry.
+ * @param entry The entry.
+ */
+static void place(struct table *table, uint64_t hash, struct entry *entry);
+/**
+ * @brief Creates an entry and inserts it into the index.
+ * @details The caller has to hold the index lock for writing.
+ * @param store The store.
+ * @param hash The hash of the username.
+ * @param username The username.
+ * @param password The password.
+ * @param secret The secret.
+ * @return The new entry on success, NULL on error.
+ */
+static struct entry *create(struct store *store, uint64_t hash, const char *username, const char *password,
+                            const char *secret);
+/**
+ * @brief Looks up the entry of a user in the current hash index and the snapshot index.
+ * @param store The store.
+ * @param username The username.
+ * @param hash The hash of the username.
+ * @return The entry on success, NULL if no such user exists.
+ */
+static struct entry *lookup(struct store *store, const char *username, uint64_t hash);
+/**
+ * @brief Resolves a bucket of the snapshot index to its entry.
+ * @details The snapshot is served before snapshot_verify() finished, so an entry is checked on its
+ *          first use: it has to lie inside the heap, keep all its strings behind the header and
+ *          terminate them. Later uses skip the checks, logins and writes change the entry in place.
+ * @param store The store.
+ * @param i The index of the bucket.
+ * @return The entry on success, NULL if the entry is malformed.
+ */
+static struct entry *snap_entry(const struct store *store, size_t i);
+/**
+ * @brief Doubles the number of buckets and re-inserts all entries.
+ * @param store The store.
+ * @return 0 on success, -1 on error.
+ */
+static int grow(struct store *store);
+/**
+ * @brief Frees memory concurrent readers may still hold once they are done with it.
+ * @param store The store.
+ * @param record The memory, allocated with malloc().
+ */
+static void retire(struct store *store, void *record);
+/**
+ * @brief Marks the secret of an entry as being replaced, see store_read_secret().
+ * @param entry The entry.
+ */
+static void begin_write(struct entry *entry);
+/**
+ * @brief Marks the replacement of the secret of an entry as done.
+ * @param entry The entry.
+ */
+static void end_write(struct entry *entry);
+/**
+ * @brief Returns storage for a secret, reusing replaced storage if possible.
+ * @param store The store.
+ * @param cap Size of the storage in bytes, a power of two from SECRET_MIN_CAP up to SECRET_LARGE.
+ * @return The storage on success, NULL on error.
+ */
+static char *take_storage(struct store *store, uint32_t cap);
+/**
+ * @brief Returns the size of the storage taken for a string.
+ * @details Grows geometrically, so repeated writes waste at most as much as they use.
+ * @param len Length of the string.
+ * @return The smallest power of two of at least SECRET_MIN_CAP bytes holding the string and its NUL.
+ */
+static uint32_t storage_cap(size_t len);
+/**
+ * @brief Keeps replaced storage of a secret for later writes.
+ * @details Readers copy a secret optimistically and retry once the generation of the entry changed,
+ *          so the storage may be reused right away. The arena is never unmapped while in use.
+ * @param store The store.
+ * @param storage The storage.
+ * @param cap Size of the storage in bytes.
+ */
+static void spill(struct store *store, char *storage, uint32_t cap);
+/**
+ * @brief Makes new storage the storage of the secret of an entry.
+ * @details The capacity readers see never exceeds the storage they see, see store_read_secret().
+ * @param entry The entry.
+ * @param secret The new storage, holding the new secret.
+ * @param cap Size of the new storage in bytes.
+ */
+static void publish(struct entry *entry, char *secret, uint32_t cap);
+
+/* === Implementations === */
+
+int arena_init(struct arena *arena) {
+    arena->head = NULL;
+    arena->reserved = 0;
+    return pthread_mutex_init(&arena->lock, NULL) != 0 ? -1 : 0;
+}
+
+void *arena_alloc(struct arena *arena, size_t size, size_t align) {
+    struct chunk *chunk;
+    size_t offset = 0, length;
+
+    (void) pthread_mutex_lock(&arena->lock);
+    chunk = arena->head;
+    if (chunk != NULL) {
+        offset = (chunk->used + align - 1) & ~(align - 1);
+    }
+    if (chunk == NULL || offset + size > chunk->size) {
+        length = size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE;
+        if ((chunk = malloc(sizeof *chunk + length)) == NULL) {
+            (void) pthread_mutex_unlock(&arena->lock);
+            return NULL;
+        }
+        chunk->size = length;
+        chunk->next = arena->head;
+        arena->head = chunk;
+        arena->reserved += length;
+        offset = 0;
+    }
+    chunk->used = offset + size;
+    (void) pthread_mutex_unlock(&arena->lock);
+    return chunk->data + offset;
+}
+
+void arena_free(struct arena *arena) {
+    struct chunk *tmp;
+
+    while (arena->head != NULL) {
+        tmp = arena->head;
+        arena->head = tmp->next;
+        free(tmp);
+    }
+    arena->reserved = 0;
+}
+
+void arena_adopt(struct arena *dst, struct arena *src) {
+    struct chunk *tail = src->head;
+
+    if (tail == NULL) {
+        return;
+    }
+    while (tail->next != NULL) {
+        tail = tail->next;
+    }
+    (void) pthread_mutex_lock(&dst->lock);
+    /* keep allocating from the current chunk of dst */
+    if (dst->head == NULL) {
+        dst->head = src->head;
+    } else {
+        tail->next = dst->head->next;
+        dst->head->next = src->head;
+    }
+    dst->reserved += src->reserved;
+    (void) pthread_mutex_unlock(&dst->lock);
+    src->head = NULL;
+    src->reserved = 0;
+}
+
+struct entry *entry_create(struct arena *arena, const char *username, size_t ulen, const char *password,
+                           size_t plen, const char *secret, size_t slen) {
+    struct entry *entry;
+
+    if (ulen > UINT16_MAX || plen > UINT16_MAX || slen >= UINT32_MAX) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if ((entry = arena_alloc(arena, sizeof *entry + ulen + plen + slen + 3, sizeof(void *))) == NULL) {
+        return NULL;
+    }
+    entry->secret = NULL;
+    entry->password = NULL;
+    entry->secret_cap = slen + 1;
+    entry->generation = 0;
+    entry->username_len = ulen;
+    entry->password_len = plen;
+    entry->session_id[0] = '\0';
+    (void) memcpy(ENTRY_USERNAME(entry), username, ulen);
+    ENTRY_USERNAME(entry)[ulen] = '\0';
+    (void) memcpy(ENTRY_PASSWORD(entry), password, plen);
+    ENTRY_PASSWORD(entry)[plen] = '\0';
+    (void) memcpy(ENTRY_SECRET(entry), secret, slen);
+    ENTRY_SECRET(entry)[slen] = '\0';
+    return entry;
+}
+
+int store_init(struct store *store) {
+    store->reclaim = NULL;
+    store->count = 0;
+    store->large = 0;
+    (void) memset(store->spilled, 0, sizeof store->spilled);
+    store->snap_buckets = NULL;
+    store->snap_capacity = 0;
+    store->snap_count = 0;
+    store->snap_heap = NULL;
+    store->snap_checked = NULL;
+    store->snap_map = NULL;
+    store->snap_size = 0;
+    if (pthread_rwlock_init(&store->lock, NULL) != 0 || arena_init(&store->arena) == -1
+        || pthread_mutex_init(&store->spill_lock, NULL) != 0) {
+        return -1;
+    }
+    for (int i = 0; i < STORE_STRIPES; i++) {
+        if (pthread_rwlock_init(&store->stripes[i], NULL) != 0) {
+            return -1;
+        }
+    }
+    if ((store->table = calloc(1, sizeof *store->table + STORE_INITIAL_CAPACITY * sizeof(struct bucket))) == NULL) {
+        return -1;
+    }
+    store->table->capacity = STORE_INITIAL_CAPACITY;
+    return 0;
+}
+
+void store_free(struct store *store) {
+    struct entry *entry;
+    size_t cursor = 0;
+
+    if (store->table == NULL) {
+        return;
+    }
+    /* only secrets above SECRET_LARGE live outside the arena and the snapshot */
+    while (store->large > 0 && (entry = store_next(store, &cursor)) != NULL) {
+        if (ENTRY_SECRET_LARGE(entry)) {
+            free(entry->secret);
+            store->large--;
+        }
+    }
+    free(store->table);
+    store->table = NULL;
+    store->count = 0;
+    arena_free(&store->arena);
+    if (store->snap_map != NULL) {
+        (void) munmap(store->snap_map, store->snap_size);
+        store->snap_map = NULL;
+        store->snap_buckets = NULL;
+        store->snap_count = 0;
+        free(store->snap_checked);
+        store->snap_checked = NULL;
+    }
+    (void) pthread_rwlock_destroy(&store->lock);
+    (void) pthread_mutex_destroy(&store->arena.lock);
+    (void) pthread_mutex_destroy(&store->spill_lock);
+    (void) memset(store->spilled, 0, sizeof store->spilled);
+    for (int i = 0; i < STORE_STRIPES; i++) {
+        (void) pthread_rwlock_destroy(&store->stripes[i]);
+    }
+}
+
+struct entry *store_find(struct store *store, const char *username) {
+    return lookup(store, username, hash_string(username));
+}
+
+struct entry *store_add(struct store *store, const char *username, const char *password, const char *secret) {
+    uint64_t hash = hash_string(username);
+    struct entry *entry = NULL;
+
+    (void) pthread_rwlock_wrlock(&store->lock);
+    if (lookup(store, username, hash) != NULL) {
+        errno = EEXIST;
+    } else {
+        entry = create(store, hash, username, password, secret);
+    }
+    (void) pthread_rwlock_unlock(&store->lock);
+    return entry;
+}
+
+int store_reserve(struct store *store, size_t count) {
+    int ret = 0;
+
+    (void) pthread_rwlock_wrlock(&store->lock);
+    while (ret == 0 && 2 * count > store->table->capacity) {
+        ret = grow(store);
+    }
+    (void) pthread_rwlock_unlock(&store->lock);
+    return ret;
+}
+
+int store_insert(struct store *store, uint64_t hash, struct entry *entry) {
+    int ret = -1;
+
+    (void) pthread_rwlock_wrlock(&store->lock);
+    if (lookup(store, ENTRY_USERNAME(entry), hash) != NULL) {
+        errno = EEXIST;
+    } else if (2 * (store->count + 1) <= store->table->capacity || grow(store) == 0) {
+        place(store->table, hash, entry);
+        store->count++;
+        ret = 0;
+    }
+    (void) pthread_rwlock_unlock(&store->lock);
+    return ret;
+}
+
+int store_attach(struct store *store, void *map, size_t size, const struct snapshot_bucket *buckets,
+                 size_t capacity, size_t count, char *heap) {
+    uint64_t *checked;
+
+    if ((checked = calloc((capacity + 63) / 64, sizeof *checked)) == NULL) {
+        return -1;
+    }
+    (void) pthread_rwlock_wrlock(&store->lock);
+    store->snap_checked = checked;
+    store->snap_map = map;
+    store->snap_size = size;
+    store->snap_buckets = buckets;
+    store->snap_capacity = capacity;
+    store->snap_count = count;
+    store->snap_heap = heap;
+    (void) pthread_rwlock_unlock(&store->lock);
+    return 0;
+}
+
+int store_set_secret(struct store *store, struct entry *entry, const char *secret) {
+    size_t len = strlen(secret);
+    uint32_t cap;
+    char *tmp, *large = NULL, *outgrown = NULL;
+    uint32_t outgrown_cap = entry->secret_cap;
+
+    if (len >= SECRET_LARGE) {
+        if ((tmp = malloc(len + 1)) == NULL) {
+            return -1;
+        }
+        (void) memcpy(tmp, secret, len + 1);
+        return store_adopt_secret(store, entry, tmp, len);
+    }
+    /* a small secret does not keep the heap storage of a large one alive */
+    if (ENTRY_SECRET_LARGE(entry) || len >= entry->secret_cap) {
+        cap = storage_cap(len);
+        if ((tmp = take_storage(store, cap)) == NULL) {
+            return -1;
+        }
+        large = ENTRY_SECRET_LARGE(entry) ? entry->secret : NULL;
+        outgrown = large == NULL ? ENTRY_SECRET(entry) : NULL;
+        /* fresh storage is filled before readers can see it */
+        (void) memcpy(tmp, secret, len + 1);
+        begin_write(entry);
+        publish(entry, tmp, cap);
+        end_write(entry);
+    } else {
+        begin_write(entry);
+        (void) memcpy(ENTRY_SECRET(entry), secret, len + 1);
+        end_write(entry);
+    }
+    if (large != NULL) {
+        retire(store, large);
+        (void) __atomic_sub_fetch(&store->large, 1, __ATOMIC_RELAXED);
+    }
+    if (outgrown != NULL) {
+        spill(store, outgrown, outgrown_cap);
+    }
+    return 0;
+}
+
+int store_adopt_secret(struct store *store, struct entry *entry, char *secret, size_t len) {
+    char *large, *outgrown;
+    uint32_t outgrown_cap;
+    int ret;
+
+    if (len < SECRET_LARGE) {
+        ret = store_set_secret(store, entry, secret);
+        free(secret);
+        return ret;
+    }
+    if (len >= UINT32_MAX) {
+        free(secret);
+        errno = EINVAL;
+        return -1;
+    }
+    large = ENTRY_SECRET_LARGE(entry) ? entry->secret : NULL;
+    outgrown = large == NULL ? ENTRY_SECRET(entry) : NULL;
+    outgrown_cap = entry->secret_cap;
+    begin_write(entry);
+    publish(entry, secret, len + 1);
+    end_write(entry);
+    if (large != NULL) {
+        retire(store, large);
+    } else {
+        (void) __atomic_add_fetch(&store->large, 1, __ATOMIC_RELAXED);
+        spill(store, outgrown, outgrown_cap);
+    }
+    return 0;
+}
+
+int64_t store_read_secret(const struct entry *entry, size_t position, char *buffer, size_t room, size_t *total,
+                          uint32_t *generation) {
+    const char *secret, *end;
+    uint32_t before, cap;
+    size_t len, n;
+
+    while (1) {
+        if ((before = __atomic_load_n(&entry->generation, __ATOMIC_ACQUIRE)) & 1) {
+            /* a writer is replacing the secret, let it finish on this CPU */
+            (void) sched_yield();
+            continue;
+        }
+        /* the storage and its capacity change separately, a pair seen around an unchanged pointer fits */
+        secret = __atomic_load_n(&entry->secret, __ATOMIC_ACQUIRE);
+        cap = __atomic_load_n(&entry->secret_cap, __ATOMIC_ACQUIRE);
+        if (secret != __atomic_load_n(&entry->secret, __ATOMIC_RELAXED)) {
+            continue;
+        }
+        if (secret != NULL && cap > SECRET_LARGE) {
+            /* a secret on the heap is never changed in place */
+            len = cap - 1;
+        } else {
+            if (secret == NULL) {
+                secret = entry->data + entry->username_len + entry->password_len + 2;
+            }
+            if ((end = memchr(secret, '\0', cap)) == NULL) {
+                continue;
+            }
+            len = end - secret;
+        }
+        n = position <= len ? len - position : 0;
+        n = n < room ? n : room;
+        (void) memcpy(buffer, secret + (position <= len ? position : 0), n);
+        /* the copy is only valid if no writer started meanwhile */
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&entry->generation, __ATOMIC_RELAXED) == before) {
+            break;
+        }
+    }
+    *total = len;
+    *generation = before;
+    return position <= len ? (int64_t) n : -1;
+}
+
+int store_set_password(struct store *store, struct entry *entry, const char *expected, const char *password) {
+    size_t len = strlen(password);
+    uint32_t cap = storage_cap(len), old_cap = 0;
+    char *tmp, *old;
+    int ret = 0;
+
+    /* passwords share the size classes of the secrets */
+    if ((tmp = take_storage(store, cap)) == NULL) {
+        return -1;
+    }
+    (void) memcpy(tmp, password, len + 1);
+    store_lock(store, entry, true);
+    old = ENTRY_PASSWORD(entry);
+    if (strcmp(old, expected) == 0) {
+        /* storage of a former rehash was taken the same way, the one behind the username is exact */
+        old_cap = entry->password != NULL ? storage_cap(strlen(old)) : (uint32_t) entry->password_len + 1;
+        entry->password = tmp;
+        ret = 1;
+    }
+    store_unlock(store, entry);
+    if (ret == 1) {
+        spill(store, old, old_cap);
+    } else {
+        spill(store, tmp, cap);
+    }
+    return ret;
+}
+
+void store_lock(struct store *store, struct entry *entry, bool write) {
+    pthread_rwlock_t *stripe = &store->stripes[((uintptr_t) entry / sizeof(void *)) % STORE_STRIPES];
+
+    if (write) {
+        (void) pthread_rwlock_wrlock(stripe);
+    } else {
+        (void) pthread_rwlock_rdlock(stripe);
+    }
+}
+
+void store_unlock(struct store *store, struct entry *entry) {
+    (void) pthread_rwlock_unlock(&store->stripes[((uintptr_t) entry / sizeof(void *)) % STORE_STRIPES]);
+}
+
+void store_freeze(struct store *store) {
+    (void) pthread_rwlock_wrlock(&store->lock);
+    for (int i = 0; i < STORE_STRIPES; i++) {
+        (void) pthread_rwlock_wrlock(&store->stripes[i]);
+    }
+}
+
+void store_thaw(struct store *store) {
+    for (int i = STORE_STRIPES - 1; i >= 0; i--) {
+        (void) pthread_rwlock_unlock(&store->stripes[i]);
+    }
+    (void) pthread_rwlock_unlock(&store->lock);
+}
+
+struct entry *store_next(struct store *store, size_t *cursor) {
+    struct table *table = store->table;
+    struct entry *entry;
+    size_t i;
+
+    while (*cursor < table->capacity) {
+        if (table->buckets[(*cursor)++].hash != 0) {
+            return table->buckets[*cursor - 1].entry;
+        }
+    }
+    /* continue behind the buckets with the snapshot index */
+    while ((i = *cursor - table->capacity) < store->snap_capacity) {
+        (*cursor)++;
+        if (store->snap_buckets[i].hash != 0 && (entry = snap_entry(store, i)) != NULL) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static struct entry *create(struct store *store, uint64_t hash, const char *username, const char *password,
+                            const char *secret) {
+    struct entry *entry;
+
+    if (2 * (store->count + 1) > store->table->capacity && grow(store) == -1) {
+        return NULL;
+    }
+    if ((entry = entry_create(&store->arena, username, strlen(username), password, strlen(password),
+                              secret, strlen(secret))) == NULL) {
+        return NULL;
+    }
+    place(store->table, hash, entry);
+    store->count++;
+    return entry;
+}
+
+static struct entry *lookup(struct store *store, const char *username, uint64_t hash) {
+    struct table *table = __atomic_load_n(&store->table, __ATOMIC_ACQUIRE);
+    size_t mask = table->capacity - 1;
+    struct entry *entry;
+    uint64_t found;
+
+    for (size_t i = hash & mask; (found = __atomic_load_n(&table->buckets[i].hash, __ATOMIC_ACQUIRE)) != 0;
+         i = (i + 1) & mask) {
+        /* only compare the username if the hash matches */
+        if (found == hash && strcmp(ENTRY_USERNAME(table->buckets[i].entry), username) == 0) {
+            return table->buckets[i].entry;
+        }
+    }
+    if (store->snap_buckets == NULL) {
+        return NULL;
+    }
+    mask = store->snap_capacity - 1;
+    /* a corrupt index may have no empty bucket */
+    for (size_t i = hash & mask, n = 0; store->snap_buckets[i].hash != 0 && n <= mask; i = (i + 1) & mask, n++) {
+        if (store->snap_buckets[i].hash == hash && (entry = snap_entry(store, i)) != NULL
+            && strcmp(ENTRY_USERNAME(entry), username) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static struct entry *snap_entry(const struct store *store, size_t i) {
+    size_t heap = store->snap_size - (size_t) (store->snap_heap - (char *) store->snap_map);
+    uint64_t offset = store->snap_buckets[i].offset, bit = (uint64_t) 1 << (i % 64);
+    uint64_t *checked = &store->snap_checked[i / 64];
+    struct entry *entry;
+    size_t strings;
+
+    if ((__atomic_load_n(checked, __ATOMIC_ACQUIRE) & bit) != 0) {
+        return (struct entry *) (store->snap_heap + offset);
+    }
+    if (offset % 8 != 0 || offset > heap || heap - offset < offsetof(struct entry, data)) {
+        return NULL;
+    }
+    entry = (struct entry *) (store->snap_heap + offset);
+    /* snapshot_save() writes all strings behind the header, a pointer in the file points anywhere */
+    if (entry->secret != NULL || entry->password != NULL || entry->secret_cap == 0
+        || entry->secret_cap > SECRET_MAX + 1) {
+        /* unless the first use of the entry passed the checks meanwhile and changed it */
+        return (__atomic_load_n(checked, __ATOMIC_ACQUIRE) & bit) != 0 ? entry : NULL;
+    }
+    strings = (size_t) entry->username_len + entry->password_len + 2 + entry->secret_cap;
+    if (strings > heap - offset - offsetof(struct entry, data) || entry->data[entry->username_len] != '\0'
+        || entry->data[entry->username_len + entry->password_len + 1] != '\0' || entry->data[strings - 1] != '\0') {
+        return NULL;
+    }
+    (void) __atomic_fetch_or(checked, bit, __ATOMIC_RELEASE);
+    return entry;
+}
+
+static void place(struct table *table, uint64_t hash, struct entry *entry) {
+    size_t mask = table->capacity - 1, i;
+
+    for (i = hash & mask; table->buckets[i].hash != 0; i = (i + 1) & mask) {
+        continue;
+    }
+    table->buckets[i].entry = entry;
+    __atomic_store_n(&table->buckets[i].hash, hash, __ATOMIC_RELEASE);
+}
+
+static int grow(struct store *store) {
+    struct table *table, *old = store->table;
+    size_t capacity = 2 * old->capacity;
+
+    if ((table = calloc(1, sizeof *table + capacity * sizeof table->buckets[0])) == NULL) {
+        return -1;
+    }
+    table->capacity = capacity;
+    for (size_t i = 0; i < old->capacity; i++) {
+        if (old->buckets[i].hash != 0) {
+            place(table, old->buckets[i].hash, old->buckets[i].entry);
+        }
+    }
+    /* lookups still walking the old index find every entry it held */
+    __atomic_store_n(&store->table, table, __ATOMIC_RELEASE);
+    retire(store, old);
+    return 0;
+}
+
+static void retire(struct store *store, void *record) {
+    if (store->reclaim == NULL) {
+        free(record);
+    } else {
+        /* leaked if it cannot be queued, a reader may still hold it */
+        (void) reclaim_retire(store->reclaim, record);
+    }
+}
+
+static char *take_storage(struct store *store, uint32_t cap) {
+    int class = __builtin_ctz(cap / SECRET_MIN_CAP);
+    char *storage;
+
+    (void) pthread_mutex_lock(&store->spill_lock);
+    if ((storage = store->spilled[class]) != NULL) {
+        (void) memcpy(&store->spilled[class], storage, sizeof storage);
+    }
+    (void) pthread_mutex_unlock(&store->spill_lock);
+    return storage != NULL ? storage : arena_alloc(&store->arena, cap, 1);
+}
+
+static uint32_t storage_cap(size_t len) {
+    uint32_t cap = SECRET_MIN_CAP;
+
+    while (cap <= len) {
+        cap *= 2;
+    }
+    return cap;
+}
+
+static void spill(struct store *store, char *storage, uint32_t cap) {
+    int class = SECRET_CLASSES - 1;
+
+    /* the storage behind the password may be too small to hold the link */
+    if (cap < SECRET_MIN_CAP) {
+        return;
+    }
+    /* the largest class the storage fully serves */
+    if (cap < SECRET_LARGE) {
+        class = 31 - __builtin_clz(cap / SECRET_MIN_CAP);
+    }
+    (void) pthread_mutex_lock(&store->spill_lock);
+    (void) memcpy(storage, &store->spilled[class], sizeof storage);
+    store->spilled[class] = storage;
+    (void) pthread_mutex_unlock(&store->spill_lock);
+}
+
+static void begin_write(struct entry *entry) {
+    __atomic_store_n(&entry->generation, entry->generation + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void end_write(struct entry *entry) {
+    __atomic_store_n(&entry->generation, entry->generation + 1, __ATOMIC_RELEASE);
+}
+
+static void publish(struct entry *entry, char *secret, uint32_t cap) {
+    /* a reader seeing either storage may only scan as far as both reach */
+    if (cap < entry->secret_cap) {
+        __atomic_store_n(&entry->secret_cap, cap, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&entry->secret, secret, __ATOMIC_RELEASE);
+    __atomic_store_n(&entry->secret_cap, cap, __ATOMIC_RELEASE);
+}
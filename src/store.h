@@ -0,0 +1,366 @@
+/**
+ * @file store.h
+ * @author Martin Weise <e1429167@student.tuwien.ac.at>
+ * @date 16.10.2026
+ *
+ * @brief User store header file.
+ * @details Open-addressing hash index over the database entries, keyed by username. The entries
+ *          live in an arena and are freed in bulk.
+ *
+ *          Lookups and reading a secret take no lock. Entries are never removed and the buckets of
+ *          an index are published before they are filled, so a lookup only has to load the index
+ *          with acquire semantics. A grown index and a replaced secret on the heap are retired
+ *          through the reclaimer of the store, so readers still holding them are not disturbed.
+ *          Writers of a secret bump its generation around the change, like a seqlock, and readers
+ *          copy it again if it changed meanwhile.
+ *
+ **/
+
+/* === Constants === */
+
+/** @brief Initial number of buckets of the hash index. @details Must be a power of two. */
+#define STORE_INITIAL_CAPACITY (1024)
+/** @brief Size of an arena chunk in bytes. @details Larger records get a chunk of their own. */
+#define ARENA_CHUNK_SIZE (1 << 20)
+/** @brief Smallest storage in bytes reserved for a secret that outgrew its initial storage. */
+#define SECRET_MIN_CAP (16)
+/** @brief Size in bytes above which a secret gets storage of its own on the heap, freed once replaced.
+ *  @details Must be a power of two, so the storage of smaller secrets never exceeds it. */
+#define SECRET_LARGE (64 * 1024)
+/** @brief Number of size classes of replaced secret storage, one per power of two from SECRET_MIN_CAP
+ *  up to SECRET_LARGE. */
+#define SECRET_CLASSES (13)
+/** @brief Number of locks protecting the mutable parts of the entries. */
+#define STORE_STRIPES (64)
+
+/* === Structs === */
+
+struct reclaim;
+
+/**
+ * @brief Defines an entry in the database of the server.
+ * @details The username, the password and the initial secret are stored right behind the header,
+ *          so an entry holds no pointers until its secret outgrows the initial storage on WRITE or
+ *          its password is rehashed on LOGIN.
+ */
+struct entry {
+    /** @brief Holds the secret once it outgrew its initial storage. @details NULL while the secret is
+     *         stored behind the password, see ENTRY_SECRET(). */
+    char *secret;
+    /** @brief Holds the password once it was rehashed. @details NULL while the password is stored
+     *         behind the username, see ENTRY_PASSWORD(). */
+    char *password;
+    /** @brief Size of the storage of the secret in bytes, including the terminating NUL. */
+    uint32_t secret_cap;
+    /** @brief Odd while the secret is replaced, raised by two by every write. @details Lets a reader copy
+     *         the secret without the entry lock, see store_read_secret(), and a client read it in chunks. */
+    uint32_t generation;
+    /** @brief Length of the username. */
+    uint16_t username_len;
+    /** @brief Length of the password stored behind the username. */
+    uint16_t password_len;
+    /** @brief Holds the session id of a registered user. @details Is left blank if user is not logged in. */
+    char session_id[SIZE_SESS_ID + 1];
+    /** @brief Holds the username, the password and the initial secret, each NUL-terminated. */
+    char data[];
+};
+
+/**
+ * @brief Defines a chunk of the arena.
+ */
+struct chunk {
+    /** @brief The previously allocated chunk. */
+    struct chunk *next;
+    /** @brief Number of used bytes. */
+    size_t used;
+    /** @brief Number of usable bytes. */
+    size_t size;
+    /** @brief The storage. */
+    char data[];
+};
+
+/**
+ * @brief Defines a bump allocator that is only freed as a whole.
+ */
+struct arena {
+    /** @brief Serializes allocations of concurrent threads. */
+    pthread_mutex_t lock;
+    /** @brief The chunk allocations are served from. */
+    struct chunk *head;
+    /** @brief Number of bytes reserved by all chunks. */
+    size_t reserved;
+};
+
+/**
+ * @brief Defines a bucket of the hash index.
+ */
+struct bucket {
+    /** @brief Hash of the username. @details Compared before the username itself, 0 marks an empty bucket. */
+    uint64_t hash;
+    /** @brief The indexed entry. */
+    struct entry *entry;
+};
+
+/**
+ * @brief Defines a hash index.
+ * @details Replaced as a whole when it grows, so readers always see a capacity matching the buckets.
+ */
+struct table {
+    /** @brief Number of buckets. @details Is always a power of two. */
+    size_t capacity;
+    /** @brief The buckets. */
+    struct bucket buckets[];
+};
+
+/**
+ * @brief Defines a bucket of the hash index of a snapshot.
+ * @details Refers to the entry by offset, so the index can be mapped at any address.
+ */
+struct snapshot_bucket {
+    /** @brief Hash of the username, 0 marks an empty bucket. */
+    uint64_t hash;
+    /** @brief Offset of the entry in the heap of the snapshot. */
+    uint64_t offset;
+};
+
+/**
+ * @brief Defines the user store.
+ * @details The hash index uses linear probing and is kept at most half full. Changes of the secret,
+ *          the password and the session id of an entry are serialized by one of STORE_STRIPES locks,
+ *          see store_lock(). Users of a mapped snapshot are found through a second, immutable index,
+ *          see store_attach().
+ */
+struct store {
+    /** @brief Serializes changes of the hash index. @details Lookups take no lock. */
+    pthread_rwlock_t lock;
+    /** @brief Serialize changes of the entries. */
+    pthread_rwlock_t stripes[STORE_STRIPES];
+    /** @brief The hash index. */
+    struct table *table;
+    /** @brief Frees replaced indexes and secrets once no reader holds them. @details NULL frees them
+     *         right away, if the store has no concurrent readers. */
+    struct reclaim *reclaim;
+    /** @brief Number of indexed entries. */
+    size_t count;
+    /** @brief Holds the entries and secrets. */
+    struct arena arena;
+    /** @brief Number of secrets on the heap, see SECRET_LARGE. */
+    size_t large;
+    /** @brief Serializes the lists of replaced secret storage. */
+    pthread_mutex_t spill_lock;
+    /** @brief Replaced storage of secrets in the arena or behind the password, reused by later writes.
+     *  @details List i holds blocks of at least SECRET_MIN_CAP << i bytes, linked through their first
+     *           bytes. */
+    char *spilled[SECRET_CLASSES];
+    /** @brief The index of the attached snapshot. @details NULL if no snapshot is attached. */
+    const struct snapshot_bucket *snap_buckets;
+    /** @brief Number of buckets of the snapshot index. @details Is always a power of two. */
+    size_t snap_capacity;
+    /** @brief Number of users in the snapshot. */
+    size_t snap_count;
+    /** @brief The heap of the snapshot, holding its entries. */
+    char *snap_heap;
+    /** @brief Bit i is set once the entry of bucket i passed its checks. @details The checks only hold
+     *         for the entry as read from the file, logins and writes change it in place afterwards. */
+    uint64_t *snap_checked;
+    /** @brief The mapping of the snapshot, unmapped by store_free(). */
+    void *snap_map;
+    /** @brief Size of the mapping of the snapshot in bytes. */
+    size_t snap_size;
+};
+
+/* === Macros === */
+
+/** @brief The username of an entry. */
+#define ENTRY_USERNAME(e) ((e)->data)
+/** @brief The password of an entry, a hash unless it was loaded from a plaintext database. */
+#define ENTRY_PASSWORD(e) ((e)->password != NULL ? (e)->password : (e)->data + (e)->username_len + 1)
+/** @brief The secret of an entry. */
+#define ENTRY_SECRET(e) ((e)->secret != NULL ? (e)->secret : (e)->data + (e)->username_len + (e)->password_len + 2)
+/** @brief Whether the secret of an entry lives on the heap. */
+#define ENTRY_SECRET_LARGE(e) ((e)->secret != NULL && (e)->secret_cap > SECRET_LARGE)
+/** @brief The length of the secret of an entry, without scanning a secret on the heap. */
+#define ENTRY_SECRET_LENGTH(e) (ENTRY_SECRET_LARGE(e) ? (size_t) (e)->secret_cap - 1 : strlen(ENTRY_SECRET(e)))
+
+/* === Prototypes === */
+
+/**
+ * @brief Initializes an empty arena.
+ * @param arena The arena.
+ * @return 0 on success, -1 on error.
+ */
+int arena_init(struct arena *arena);
+/**
+ * @brief Allocates memory from the arena.
+ * @param arena The arena.
+ * @param size Number of bytes.
+ * @param align Alignment of the memory, has to be a power of two.
+ * @return The memory on success, NULL on error.
+ */
+void *arena_alloc(struct arena *arena, size_t size, size_t align);
+/**
+ * @brief Frees all chunks of the arena.
+ * @param arena The arena.
+ */
+void arena_free(struct arena *arena);
+/**
+ * @brief Moves all chunks of an arena into another one.
+ * @details The source arena is left empty, its lock is not destroyed.
+ * @param dst The arena taking over the chunks.
+ * @param src The arena giving up the chunks.
+ */
+void arena_adopt(struct arena *dst, struct arena *src);
+/**
+ * @brief Creates an entry in an arena without indexing it.
+ * @details The strings need not be NUL-terminated.
+ * @param arena The arena.
+ * @param username The username.
+ * @param ulen Length of the username.
+ * @param password The password.
+ * @param plen Length of the password.
+ * @param secret The secret.
+ * @param slen Length of the secret.
+ * @return The new entry on success, NULL on error.
+ */
+struct entry *entry_create(struct arena *arena, const char *username, size_t ulen, const char *password,
+                           size_t plen, const char *secret, size_t slen);
+/**
+ * @brief Initializes an empty store.
+ * @param store The store.
+ * @return 0 on success, -1 on error.
+ */
+int store_init(struct store *store);
+/**
+ * @brief Frees the hash index and all entries of a store.
+ * @param store The store.
+ */
+void store_free(struct store *store);
+/**
+ * @brief Looks up the entry of a user.
+ * @details Takes no lock. A concurrent reader has to be online in the reclaimer of the store.
+ * @param store The store.
+ * @param username The username.
+ * @return The entry on success, NULL if no such user exists.
+ */
+struct entry *store_find(struct store *store, const char *username);
+/**
+ * @brief Creates an entry and adds it to the store, unless the username exists already.
+ * @param store The store.
+ * @param username The username.
+ * @param password The password.
+ * @param secret The secret, may be empty.
+ * @return The new entry on success, NULL on error. errno is EEXIST if the username exists.
+ */
+struct entry *store_add(struct store *store, const char *username, const char *password, const char *secret);
+/**
+ * @brief Grows the hash index so it holds a number of entries without further growing.
+ * @param store The store.
+ * @param count The expected number of entries.
+ * @return 0 on success, -1 on error.
+ */
+int store_reserve(struct store *store, size_t count);
+/**
+ * @brief Indexes an entry created by entry_create(), unless its username exists already.
+ * @details The entry has to live in the arena of the store, see arena_adopt().
+ * @param store The store.
+ * @param hash The hash of the username.
+ * @param entry The entry.
+ * @return 0 on success, -1 on error. errno is EEXIST if the username exists.
+ */
+int store_insert(struct store *store, uint64_t hash, struct entry *entry);
+/**
+ * @brief Attaches the users of a mapped snapshot to an empty store.
+ * @details The entries stay in the mapping, which has to be private and writable, since logins and
+ *          writes modify them in place. The store unmaps it in store_free().
+ * @param store The store.
+ * @param map The mapping.
+ * @param size Size of the mapping in bytes.
+ * @param buckets The index of the snapshot.
+ * @param capacity Number of buckets of the index, a power of two.
+ * @param count Number of users in the snapshot.
+ * @param heap The heap the offsets of the index refer to.
+ * @return 0 on success, -1 on error. The mapping is left to the caller on error.
+ */
+int store_attach(struct store *store, void *map, size_t size, const struct snapshot_bucket *buckets,
+                  size_t capacity, size_t count, char *heap);
+/**
+ * @brief Replaces the secret of an entry.
+ * @details Reuses the storage of the old secret if it is large enough, unless the old secret lives
+ *          on the heap. Storage that is outgrown or replaced by a secret on the heap is kept for
+ *          later writes of any entry, so the arena does not grow with alternating writes. The
+ *          caller has to hold the entry lock for writing.
+ * @param store The store.
+ * @param entry The entry.
+ * @param secret The new secret.
+ * @return 0 on success, -1 on error.
+ */
+int store_set_secret(struct store *store, struct entry *entry, const char *secret);
+/**
+ * @brief Replaces the secret of an entry by a buffer, without copying secrets above SECRET_LARGE.
+ * @details The store takes over the buffer in any case. The caller has to hold the entry lock for
+ *          writing.
+ * @param store The store.
+ * @param entry The entry.
+ * @param secret The new secret, allocated with malloc() and NUL-terminated.
+ * @param len Length of the secret.
+ * @return 0 on success, -1 on error.
+ */
+int store_adopt_secret(struct store *store, struct entry *entry, char *secret, size_t len);
+/**
+ * @brief Copies part of the secret of an entry without locking the entry.
+ * @details Copies again while a concurrent write changes the secret. The caller has to be online in
+ *          the reclaimer of the store.
+ * @param entry The entry.
+ * @param position Offset of the first byte to copy.
+ * @param buffer Receives the bytes, not NUL-terminated.
+ * @param room Size of the buffer.
+ * @param total Receives the length of the secret.
+ * @param generation Receives the generation of the copied secret.
+ * @return The number of copied bytes, -1 if the position lies behind the end of the secret.
+ */
+int64_t store_read_secret(const struct entry *entry, size_t position, char *buffer, size_t room, size_t *total,
+                          uint32_t *generation);
+/**
+ * @brief Replaces the password of an entry, e.g. by a hash of higher cost, unless it changed meanwhile.
+ * @details Takes the entry lock only to compare and swap, the new storage is prepared before. The
+ *          replaced storage is reused by later writes, readers of a password hold the entry lock.
+ * @param store The store.
+ * @param entry The entry.
+ * @param expected The password the new one replaces.
+ * @param password The new password.
+ * @return 1 if replaced, 0 if the password changed meanwhile, -1 on error.
+ */
+int store_set_password(struct store *store, struct entry *entry, const char *expected, const char *password);
+/**
+ * @brief Locks the secret and session id of an entry.
+ * @param store The store.
+ * @param entry The entry.
+ * @param write Whether the caller modifies the entry.
+ */
+void store_lock(struct store *store, struct entry *entry, bool write);
+/**
+ * @brief Unlocks the secret and session id of an entry.
+ * @param store The store.
+ * @param entry The entry.
+ */
+void store_unlock(struct store *store, struct entry *entry);
+/**
+ * @brief Blocks all changes to the store until store_thaw().
+ * @details Takes the index lock and all stripe locks for writing, so no change is half done. Used
+ *          to fork a consistent image of the store.
+ * @param store The store.
+ */
+void store_freeze(struct store *store);
+/**
+ * @brief Allows changes to the store again.
+ * @param store The store.
+ */
+void store_thaw(struct store *store);
+/**
+ * @brief Iterates over all entries, including those of an attached snapshot.
+ * @details Not safe against concurrent store_add().
+ * @param store The store.
+ * @param cursor Iteration state, has to be 0 on the first call.
+ * @return The next entry, NULL if all entries were visited.
+ */
+struct entry *store_next(struct store *store, size_t *cursor);
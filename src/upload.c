@@ -0,0 +1,134 @@
+/**
+ * @file upload.c
+ * @author Martin Weise <e1429167@student.tuwien.ac.at>
+ * @date 16.10.2026
+ *
+ * @brief Upload table file.
+ *
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include "shared.h"
+#include "upload.h"
+
+/* === Prototypes === */
+
+/**
+ * @brief Returns the upload of a session.
+ * @param uploads The upload table.
+ * @param session_id The session id.
+ * @return The upload, NULL if the session has none.
+ */
+static struct upload *lookup(struct uploads *uploads, const char *session_id);
+/**
+ * @brief Frees the buffer of an upload and releases its reservation.
+ * @param uploads The upload table.
+ * @param upload The upload.
+ */
+static void drop(struct uploads *uploads, struct upload *upload);
+
+/* === Implementations === */
+
+int uploads_init(struct uploads *uploads, size_t memory) {
+    (void) memset(uploads->uploads, 0, sizeof uploads->uploads);
+    uploads->memory = memory;
+    uploads->reserved = 0;
+    return pthread_mutex_init(&uploads->lock, NULL) == 0 ? 0 : -1;
+}
+
+void uploads_free(struct uploads *uploads) {
+    for (int i = 0; i < UPLOADS_MAX; i++) {
+        drop(uploads, &uploads->uploads[i]);
+    }
+    (void) pthread_mutex_destroy(&uploads->lock);
+}
+
+int uploads_put(struct uploads *uploads, const char *session_id, struct entry *entry, uint32_t position,
+                uint32_t total, const char *chunk, size_t len, char **secret) {
+    struct upload *upload;
+    int ret = 0;
+
+    (void) pthread_mutex_lock(&uploads->lock);
+    upload = lookup(uploads, session_id);
+    if (position == 0) {
+        if (upload != NULL) {
+            drop(uploads, upload);
+        }
+        /* reserve the whole secret up front, so a started upload never runs out of memory */
+        for (int i = 0; upload == NULL && i < UPLOADS_MAX; i++) {
+            upload = uploads->uploads[i].buffer == NULL ? &uploads->uploads[i] : NULL;
+        }
+        if (upload == NULL || total > SECRET_MAX || total + 1 > uploads->memory - uploads->reserved
+            || (upload->buffer = malloc(total + 1)) == NULL) {
+            (void) pthread_mutex_unlock(&uploads->lock);
+            errno = ENOMEM;
+            return -1;
+        }
+        uploads->reserved += total + 1;
+        (void) memcpy(upload->session_id, session_id, SIZE_SESS_ID);
+        upload->entry = entry;
+        upload->total = total;
+        upload->received = 0;
+    }
+    if (upload == NULL || upload->entry != entry || position != upload->received || total != upload->total
+        || len > total - position) {
+        if (upload != NULL) {
+            drop(uploads, upload);
+        }
+        (void) pthread_mutex_unlock(&uploads->lock);
+        errno = EINVAL;
+        return -1;
+    }
+    (void) memcpy(upload->buffer + position, chunk, len);
+    upload->received += len;
+    upload->used = now_ns();
+    if (upload->received == total) {
+        upload->buffer[total] = '\0';
+        *secret = upload->buffer;
+        /* the caller owns the buffer now */
+        upload->buffer = NULL;
+        uploads->reserved -= total + 1;
+        ret = 1;
+    }
+    (void) pthread_mutex_unlock(&uploads->lock);
+    return ret;
+}
+
+size_t uploads_expire(struct uploads *uploads, uint64_t idle_ns) {
+    uint64_t now = now_ns();
+    size_t dropped = 0;
+
+    (void) pthread_mutex_lock(&uploads->lock);
+    for (int i = 0; i < UPLOADS_MAX; i++) {
+        if (uploads->uploads[i].buffer != NULL && now - uploads->uploads[i].used > idle_ns) {
+            drop(uploads, &uploads->uploads[i]);
+            dropped++;
+        }
+    }
+    (void) pthread_mutex_unlock(&uploads->lock);
+    return dropped;
+}
+
+static struct upload *lookup(struct uploads *uploads, const char *session_id) {
+    for (int i = 0; i < UPLOADS_MAX; i++) {
+        if (uploads->uploads[i].buffer != NULL
+            && memcmp(uploads->uploads[i].session_id, session_id, SIZE_SESS_ID) == 0) {
+            return &uploads->uploads[i];
+        }
+    }
+    return NULL;
+}
+
+static void drop(struct uploads *uploads, struct upload *upload) {
+    if (upload->buffer == NULL) {
+        return;
+    }
+    free(upload->buffer);
+    upload->buffer = NULL;
+    uploads->reserved -= upload->total + 1;
+}
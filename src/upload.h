@@ -0,0 +1,98 @@
+/**
+ * @file upload.h
+ * @author Martin Weise <e1429167@student.tuwien.ac.at>
+ * @date 16.10.2026
+ *
+ * @brief Upload table header file.
+ * @details Collects the chunks of secrets too large for a request slot until the last chunk
+ *          arrives. Each session has at most one upload, whose chunks have to arrive in order. The
+ *          table reserves the full size of a secret with its first chunk, so all uploads together
+ *          never exceed the memory limit.
+ *
+ **/
+
+/* === Constants === */
+
+/** @brief Maximum number of concurrent uploads. */
+#define UPLOADS_MAX (64)
+/** @brief Memory limit of all uploads together in bytes. */
+#define UPLOADS_MEMORY (256 * 1024 * 1024)
+/** @brief Number of seconds after which an upload without a new chunk is dropped. */
+#define UPLOADS_IDLE (60)
+
+/* === Structs === */
+
+struct entry;
+
+/**
+ * @brief Defines an upload.
+ */
+struct upload {
+    /** @brief The session sending the chunks. */
+    char session_id[SIZE_SESS_ID];
+    /** @brief The user the secret belongs to. */
+    struct entry *entry;
+    /** @brief Collects the chunks. @details NULL marks an unused upload. */
+    char *buffer;
+    /** @brief Length of the secret. */
+    uint32_t total;
+    /** @brief Number of bytes received so far. */
+    uint32_t received;
+    /** @brief Monotonic time in nanoseconds the last chunk arrived at. */
+    uint64_t used;
+};
+
+/**
+ * @brief Defines the upload table.
+ * @details All operations lock the table, chunks are copied under the lock. A chunk is at most a
+ *          slot large, so the lock is only held for a few microseconds.
+ */
+struct uploads {
+    /** @brief Serializes concurrent access. */
+    pthread_mutex_t lock;
+    /** @brief The uploads. */
+    struct upload uploads[UPLOADS_MAX];
+    /** @brief Memory limit in bytes. */
+    size_t memory;
+    /** @brief Bytes reserved by the current uploads. */
+    size_t reserved;
+};
+
+/* === Prototypes === */
+
+/**
+ * @brief Initializes an empty upload table.
+ * @param uploads The upload table.
+ * @param memory The memory limit in bytes.
+ * @return 0 on success, -1 on error.
+ */
+int uploads_init(struct uploads *uploads, size_t memory);
+/**
+ * @brief Drops all uploads and frees the table.
+ * @param uploads The upload table.
+ */
+void uploads_free(struct uploads *uploads);
+/**
+ * @brief Adds a chunk to the upload of a session.
+ * @details A chunk at position 0 starts a new upload and drops an unfinished one of the session. A
+ *          rejected chunk drops the upload.
+ * @param uploads The upload table.
+ * @param session_id The session sending the chunk.
+ * @param entry The user the secret belongs to.
+ * @param position Offset of the chunk within the secret.
+ * @param total Length of the secret, at most SECRET_MAX.
+ * @param chunk The chunk.
+ * @param len Length of the chunk.
+ * @param secret Receives the NUL-terminated secret once complete, to be freed by the caller.
+ * @return 1 if the secret is complete, 0 if more chunks are expected, -1 if the chunk was rejected.
+ *         errno is ENOMEM if the memory limit or the table is exhausted.
+ */
+int uploads_put(struct uploads *uploads, const char *session_id, struct entry *entry, uint32_t position,
+                uint32_t total, const char *chunk, size_t len, char **secret);
+/**
+ * @brief Drops the uploads of clients that stopped sending.
+ * @param uploads The upload table.
+ * @param idle_ns Time in nanoseconds without a chunk after which an upload is dropped.
+ * @return The number of dropped uploads.
+ */
+size_t uploads_expire(struct uploads *uploads, uint64_t idle_ns);
@@ -0,0 +1,51 @@
+/**
+ * @file embed.c
+ * @author Martin Weise <e1429167@student.tuwien.ac.at>
+ * @date 16.10.2026
+ *
+ * @brief Test program that embeds libauthclient.
+ * @details Registers, logs in, writes, reads and logs out 100 users through one handle and prints how
+ *          many of them saw the expected status codes. With an argument it expects no running server
+ *          and exits successfully if a call reports ENOENT instead of terminating the process.
+ *
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include "shared.h"
+#include "authclient.h"
+
+/* === Implementations === */
+
+int main(int argc, char **argv) {
+    struct authclient client;
+    char name[32], secret[32], *read = NULL;
+    int ok = 0;
+
+    (void) authclient_open(&client, 1);
+    if (argc > 1) {
+        /* without a server, the calls report an error instead of exiting */
+        ok = authclient_login(&client, "nobody", "pw") == STATUS_NONE && errno == ENOENT;
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    for (int i = 0; i < 100; i++) {
+        (void) snprintf(name, sizeof name, "embed%d", i);
+        (void) snprintf(secret, sizeof secret, "secret%d", i);
+        if (authclient_register(&client, name, "pw") == REGISTER_SUCCESS
+            && authclient_register(&client, name, "pw") == REGISTER_FAILED
+            && authclient_login(&client, name, "pw") == LOGIN_SUCCESS
+            && authclient_write(&client, secret, strlen(secret)) == WRITE_SECRET_SUCCESS
+            && authclient_read(&client, &read) == LOGIN_SUCCESS && strcmp(read, secret) == 0
+            && authclient_logout(&client) == LOGOUT_SUCCESS && authclient_logout(&client) == SESSION_FAILED) {
+            ok++;
+        }
+        free(read);
+        read = NULL;
+    }
+    authclient_close(&client);
+    (void) printf("%d\n", ok);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,74 @@
+/**
+ * @file hog.c
+ * @author Martin Weise <e1429167@student.tuwien.ac.at>
+ * @date 16.10.2026
+ *
+ * @brief Test program that holds slots like a client killed before releasing them.
+ * @details Takes the given number of slots of the auth-server, prints how many it got and pauses
+ *          until it is killed. Of every three slots, one is submitted and finishes, one is only
+ *          claimed, and one only has its owner taken, like a client killed in the middle of
+ *          slot_claim().
+ *
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include "shared.h"
+
+/* === Prototypes === */
+
+/**
+ * @brief Takes the owner of a free slot without claiming the slot itself.
+ * @param shared The shared fragment.
+ * @return The slot, NULL if all slots are taken.
+ */
+static struct slot *pin(struct shared_fragment *shared);
+
+/* === Implementations === */
+
+int main(int argc, char **argv) {
+    struct shared_fragment *shared;
+    struct slot *slot;
+    size_t size;
+    long want = argc > 1 ? strtol(argv[1], NULL, 10) : NUM_SLOTS;
+    int fd, held = 0;
+
+    if ((fd = shm_open(SHM_NAME, O_RDWR, PERMISSION)) == -1 || (shared = fragment_attach(fd, &size)) == NULL) {
+        return EXIT_FAILURE;
+    }
+    for (int tries = 0; held < want && tries < 5000; tries++) {
+        if ((slot = held % 3 == 2 ? pin(shared) : slot_claim(shared)) == NULL) {
+            (void) usleep(1000);
+            continue;
+        }
+        /* a submitted slot finishes and waits for the release */
+        if (held++ % 3 == 0) {
+            slot_begin(slot, 0);
+            slot_post(shared, slot);
+        }
+    }
+    (void) printf("%d\n", held);
+    (void) fflush(stdout);
+    (void) pause();
+    return EXIT_SUCCESS;
+}
+
+static struct slot *pin(struct shared_fragment *shared) {
+    struct slot *slot;
+    int32_t expected;
+
+    for (int i = 0; i < NUM_SLOTS; i++) {
+        slot = slot_at(shared, i);
+        expected = 0;
+        if (__atomic_compare_exchange_n(&slot->owner, &expected, (int32_t) getpid(), false,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+            return slot;
+        }
+    }
+    return NULL;
+}
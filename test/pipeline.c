@@ -0,0 +1,152 @@
+/**
+ * @file pipeline.c
+ * @author Martin Weise <e1429167@student.tuwien.ac.at>
+ * @date 16.10.2026
+ *
+ * @brief Test program that pipelines requests through libauthclient.
+ * @details Posts REGISTER for 1000 users, then LOGIN for all of them, the odd ones with a wrong
+ *          password, and then READ in the sessions of the logins, and prints how many responses of
+ *          each round matched. Some users get a secret exceeding a slot before, which is read in
+ *          chunks. The optional argument is the number of shards.
+ *
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include "shared.h"
+#include "authclient.h"
+
+/* === Constants === */
+
+/** @brief Number of users posted per round. */
+#define USERS (1000)
+/** @brief Maximum number of responses reaped at once. */
+#define REAP_MAX (64)
+/** @brief Every that many users get a large secret. */
+#define LARGE_EVERY (100)
+/** @brief Length of a large secret, several slots. */
+#define LARGE_LEN (10000)
+
+/* === Prototypes === */
+
+/**
+ * @brief Posts a request, reaps responses while the queue of the handle is full.
+ * @param client The handle.
+ * @param op The request.
+ * @param tag The user data of the request.
+ * @param seen Receives the reaped responses, indexed by user data.
+ * @return 0 on success, -1 on error.
+ */
+static int post(struct authclient *client, const struct authclient_op *op, uint64_t tag,
+                struct authclient_completion *seen);
+/**
+ * @brief Posts a request for every user and counts the expected responses.
+ * @details A READ must return the secret secret_of() gives.
+ * @param client The handle.
+ * @param modus REGISTER or LOGIN, the odd users log in with a wrong password.
+ * @param command COMMAND_NONE or READ, in the sessions of the last LOGIN round.
+ * @param expect The expected status code of the even users.
+ * @param odd The expected status code of the odd users.
+ * @return The number of expected responses, -1 on error.
+ */
+static int run(struct authclient *client, mode modus, cmd command, status expect, status odd);
+/**
+ * @brief Writes the secret of a user.
+ * @param user The index of the user.
+ * @param secret Receives the secret, LARGE_LEN + 1 bytes.
+ */
+static void secret_of(int user, char *secret);
+
+/* === Implementations === */
+
+int main(int argc, char **argv) {
+    struct authclient client;
+    static char secret[LARGE_LEN + 1];
+    char name[32];
+    int registered, logins, reads;
+
+    if (authclient_open(&client, argc > 1 ? strtol(argv[1], NULL, 10) : 1) == -1) {
+        return EXIT_FAILURE;
+    }
+    registered = run(&client, REGISTER, COMMAND_NONE, REGISTER_SUCCESS, REGISTER_SUCCESS);
+    for (int i = 0; i < USERS; i += LARGE_EVERY) {
+        (void) snprintf(name, sizeof name, "pipe%d", i);
+        secret_of(i, secret);
+        if (authclient_login(&client, name, "pw") != LOGIN_SUCCESS
+            || authclient_write(&client, secret, strlen(secret)) != WRITE_SECRET_SUCCESS) {
+            registered = -1;
+        }
+    }
+    logins = run(&client, LOGIN, COMMAND_NONE, LOGIN_SUCCESS, LOGIN_FAILED);
+    reads = run(&client, LOGIN, READ, LOGIN_SUCCESS, SESSION_FAILED);
+    authclient_close(&client);
+    (void) printf("%d %d %d\n", registered, logins, reads);
+    return EXIT_SUCCESS;
+}
+
+static int post(struct authclient *client, const struct authclient_op *op, uint64_t tag,
+                struct authclient_completion *seen) {
+    struct authclient_completion done[REAP_MAX];
+    int n;
+
+    while (authclient_post(client, op, tag) == -1) {
+        if (errno != EAGAIN || (n = authclient_reap(client, done, REAP_MAX, 1)) == -1) {
+            return -1;
+        }
+        for (int i = 0; i < n; i++) {
+            seen[done[i].user_data] = done[i];
+        }
+    }
+    return 0;
+}
+
+static int run(struct authclient *client, mode modus, cmd command, status expect, status odd) {
+    struct authclient_op op = { modus, command, NULL, NULL, NULL, STATUS_NONE, NULL, NULL };
+    struct authclient_completion done[REAP_MAX];
+    static struct authclient_completion seen[USERS];
+    static char sessions[USERS][SIZE_SESS_ID];
+    static char secret[LARGE_LEN + 1];
+    char name[32];
+    int n, ok = 0;
+
+    for (int i = 0; i < USERS; i++) {
+        (void) snprintf(name, sizeof name, "pipe%d", i);
+        op.username = name;
+        op.password = modus == LOGIN && i % 2 == 1 ? "wrong" : "pw";
+        op.session_id = sessions[i];
+        seen[i].status = STATUS_NONE;
+        seen[i].result = NULL;
+        if (post(client, &op, i, seen) == -1) {
+            return -1;
+        }
+    }
+    while ((n = authclient_reap(client, done, REAP_MAX, 1)) > 0) {
+        for (int i = 0; i < n; i++) {
+            seen[done[i].user_data] = done[i];
+        }
+    }
+    for (int i = 0; i < USERS; i++) {
+        if (command == READ && seen[i].status == LOGIN_SUCCESS) {
+            secret_of(i, secret);
+            ok += seen[i].result != NULL && strcmp(seen[i].result, secret) == 0;
+        } else {
+            ok += seen[i].status == (i % 2 == 0 ? expect : odd);
+        }
+        /* the failed logins leave no session, so their reads fail */
+        if (modus == LOGIN && command == COMMAND_NONE) {
+            (void) memcpy(sessions[i], seen[i].session_id, SIZE_SESS_ID);
+        }
+        free(seen[i].result);
+    }
+    return ok;
+}
+
+static void secret_of(int user, char *secret) {
+    size_t len = user % LARGE_EVERY == 0 ? LARGE_LEN : 0;
+
+    (void) memset(secret, 'a' + user % 26, len);
+    secret[len] = '\0';
+}
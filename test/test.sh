@@ -8,11 +8,16 @@ NO_ERR=0
 
 #! TRY RUNNING THE SERVER
 echo "################ TEST 1 ################"
-if src/auth-server > /dev/null 2>&1; then
+src/auth-server > /dev/null 2>&1 &
+SERVER=$!
+sleep 0.5
+if kill -0 $SERVER 2> /dev/null; then
+    kill -TERM $SERVER
+    wait $SERVER
     printf "${GREEN}OK${NC}\n"
 else
     printf "${RED}FAILED${NC}\n"
-    ((NO_ERR++))
+    NO_ERR=$((NO_ERR+1))
 fi
 
 #! TRY RUNNING THE CLIENT
@@ -21,7 +26,7 @@ if src/auth-client 2>&1 | grep -q "USAGE"; then
     printf "${GREEN}OK${NC}\n"
 else
     printf "${RED}FAILED${NC}\n"
-    ((NO_ERR++))
+    NO_ERR=$((NO_ERR+1))
 fi
 
 #! TRY RUNNING THE SERVER WITH INVALID ARGUMENTS
@@ -30,7 +35,7 @@ if src/auth-server -l idonotexist 2>&1 | grep -q "No such file"; then
     printf "${GREEN}OK${NC}\n"
 else
     printf "${RED}FAILED${NC}\n"
-    ((NO_ERR++))
+    NO_ERR=$((NO_ERR+1))
 fi
 
 #! TRY RUNNING THE SERVER WITH INVALID ARGUMENTS 2
@@ -39,7 +44,7 @@ if src/auth-server -l database argtoomuch 2>&1 | grep -q "USAGE"; then
     printf "${GREEN}OK${NC}\n"
 else
     printf "${RED}FAILED${NC}\n"
-    ((NO_ERR++))
+    NO_ERR=$((NO_ERR+1))
 fi
 
 #! TRY RUNNING THE SERVER WITH INVALID ARGUMENTS 3
@@ -48,18 +53,22 @@ if src/auth-server idonotbelonghere 2>&1 | grep -q "USAGE"; then
     printf "${GREEN}OK${NC}\n"
 else
     printf "${RED}FAILED${NC}\n"
-    ((NO_ERR++))
+    NO_ERR=$((NO_ERR+1))
 fi
 
 #! DATABASE (CHECK SAVING)
 echo "################ TEST 6 ################"
 printf "foo;password;secret\nbar;1234\nbaz;23456;santa" > test/input.txt
-src/auth-server -l test/input.txt > /dev/null 2>&1
+src/auth-server -l test/input.txt > /dev/null 2>&1 &
+SERVER=$!
+sleep 0.5
+kill -TERM $SERVER
+wait $SERVER
 if cat auth-server.db.csv | grep -q "foo;password;secret"; then
     printf "${GREEN}OK${NC}\n"
 else
     printf "${RED}FAILED${NC}\n"
-    ((NO_ERR++))
+    NO_ERR=$((NO_ERR+1))
 fi
 
 #! CHECK SEMAPHOR CREATION (CLIENT)
@@ -67,7 +76,607 @@ echo "################ TEST 7 ################"
 src/auth-client -l Theodor ilovemilka > /dev/null 2>&1
 if ls /dev/shm | grep -q "1429167"; then
     printf "${RED}FAILED${NC}\n"
-    ((NO_ERR++))
+    NO_ERR=$((NO_ERR+1))
 else
     printf "${GREEN}OK${NC}\n"
 fi
+
+#! CONCURRENT CLIENTS (REQUEST SLOTS)
+echo "################ TEST 8 ################"
+src/auth-server > /dev/null 2>&1 &
+SERVER=$!
+sleep 0.5
+CLIENTS=""
+for i in $(seq 1 64); do
+    src/auth-client -r user$i password$i > /dev/null 2>&1 &
+    CLIENTS="$CLIENTS $!"
+done
+FAILED=0
+for pid in $CLIENTS; do
+    wait $pid || FAILED=$((FAILED+1))
+done
+kill -TERM $SERVER
+wait $SERVER
+if [ $FAILED -eq 0 ] && [ "$(grep -c '^user' auth-server.db.csv)" -eq 64 ]; then
+    printf "${GREEN}OK${NC}\n"
+else
+    printf "${RED}FAILED${NC}\n"
+    NO_ERR=$((NO_ERR+1))
+fi
+
+#! DUPLICATE USERNAMES (HASH INDEX)
+echo "################ TEST 9 ################"
+src/auth-server -l database > /dev/null 2>&1 &
+SERVER=$!
+sleep 0.5
+if ! src/auth-client -r Anton otherpassword > /dev/null 2>&1 \
+   && printf "3\n" | src/auth-client -l Anton cforever > /dev/null 2>&1 \
+   && ! printf "3\n" | src/auth-client -l Anton otherpassword > /dev/null 2>&1; then
+    printf "${GREEN}OK${NC}\n"
+else
+    printf "${RED}FAILED${NC}\n"
+    NO_ERR=$((NO_ERR+1))
+fi
+kill -TERM $SERVER
+wait $SERVER
+
+#! WORKER POOL (CONCURRENT WRITES AND READS)
+echo "################ TEST 10 ################"
+src/auth-server -t 4 > /dev/null 2>&1 &
+SERVER=$!
+sleep 0.5
+CLIENTS=""
+for i in $(seq 1 32); do
+    (src/auth-client -r worker$i password$i > /dev/null 2>&1 \
+     && printf "1\nsecret$i\n2\n3\n" | src/auth-client -l worker$i password$i 2>&1 \
+        | grep -q "Your secret is: secret$i\$") &
+    CLIENTS="$CLIENTS $!"
+done
+FAILED=0
+for pid in $CLIENTS; do
+    wait $pid || FAILED=$((FAILED+1))
+done
+kill -TERM $SERVER
+wait $SERVER
+if [ $FAILED -eq 0 ] && [ "$(grep -c '^worker' auth-server.db.csv)" -eq 32 ]; then
+    printf "${GREEN}OK${NC}\n"
+else
+    printf "${RED}FAILED${NC}\n"
+    NO_ERR=$((NO_ERR+1))
+fi
+
+#! BATCHED COMMANDS
+echo "################ TEST 11 ################"
+src/auth-server > /dev/null 2>&1 &
+SERVER=$!
+sleep 0.5
+printf "register batch secretpw\nlogin batch secretpw\nwrite one two\nread\nlogout\n" > test/batch.txt
+if src/auth-client -b test/batch.txt 2> /dev/null | tail -2 | tr '\n' ' ' \
+   | grep -q "^read LOGIN_SUCCESS one two logout LOGOUT_SUCCESS \$"; then
+    printf "${GREEN}OK${NC}\n"
+else
+    printf "${RED}FAILED${NC}\n"
+    NO_ERR=$((NO_ERR+1))
+fi
+kill -TERM $SERVER
+wait $SERVER
+
+echo "################ TEST 12 ################"
+src/auth-server > /dev/null 2>&1 &
+SERVER=$!
+sleep 0.5
+src/auth-client -r script scriptpw > /dev/null 2>&1
+if printf "write first\nread\n\nwrite second secret\nread\n" \
+   | src/auth-client -l script scriptpw -s - 2> /dev/null | tr '\n' ' ' \
+   | grep -q "^login LOGIN_SUCCESS write WRITE_SECRET_SUCCESS read LOGIN_SUCCESS first write WRITE_SECRET_SUCCESS read LOGIN_SUCCESS second secret \$" \
+   && printf "read\n" | src/auth-client -l script scriptpw -s - 2> /dev/null \
+   | grep -q "^read LOGIN_SUCCESS second secret\$"; then
+    printf "${GREEN}OK${NC}\n"
+else
+    printf "${RED}FAILED${NC}\n"
+    NO_ERR=$((NO_ERR+1))
+fi
+kill -TERM $SERVER
+wait $SERVER
+
+echo "################ TEST 13 ################"
+if src/auth-bench -n 100 -c 4 -d 1 2> /dev/null | grep -q "^total .* 0\$"; then
+    printf "${GREEN}OK${NC}\n"
+else
+    printf "${RED}FAILED${NC}\n"
+    NO_ERR=$((NO_ERR+1))
+fi
+
+echo "################ TEST 14 ################"
+src/auth-server > /dev/null 2>&1 &
+SERVER=$!
+sleep 0.5
+printf "register stat statpw\nlogin stat statpw\nread\n" > test/batch.txt
+src/auth-client -b test/batch.txt > /dev/null 2>&1
+if src/auth-stat -c 1 2> /dev/null | tail -1 | grep -q "^ *1 *1 "; then
+    printf "${GREEN}OK${NC}\n"
+else
+    printf "${RED}FAILED${NC}\n"
+    NO_ERR=$((NO_ERR+1))
+fi
+kill -TERM $SERVER
+wait $SERVER
+
+echo "################ TEST 15 ################"
+LONG=$(printf "%0300d" 0)
+printf "long;;$LONG\r\n\nshort;pw\nlong;other;x" > test/input.txt
+src/auth-server -l test/input.txt > /dev/null 2>&1 &
+SERVER=$!
+sleep 0.5
+kill -TERM $SERVER
+wait $SERVER
+if grep -qx "long;;$LONG" auth-server.db.csv && grep -qx "short;pw;" auth-server.db.csv \
+   && [ "$(wc -l < auth-server.db.csv)" -eq 2 ]; then
+    printf "${GREEN}OK${NC}\n"
+else
+    printf "${RED}FAILED${NC}\n"
+    NO_ERR=$((NO_ERR+1))
+fi
+
+echo "################ TEST 16 ################"
+src/auth-server -l database > /dev/null 2>&1 &
+SERVER=$!
+sleep 0.5
+printf "login Anton cforever\nwrite snapshot secret\n" > test/batch.txt
+src/auth-client -b test/batch.txt > /dev/null 2>&1
+kill -TERM $SERVER
+wait $SERVER
+src/auth-server -l auth-server.db.snap > /dev/null 2>&1 &
+SERVER=$!
+sleep 0.5
+printf "login Anton cforever\nread\nlogin Emil osueisgreat\n" > test/batch.txt
+src/auth-client -b test/batch.txt > test/input.txt 2> /dev/null
+kill -TERM $SERVER
+wait $SERVER
+cp auth-server.db.snap test/test.snap
+# flip a byte of the heap, the server has to notice and quit on its own
+printf 'X' | dd of=auth-server.db.snap bs=1 seek=$(($(wc -c < auth-server.db.snap) - 2)) conv=notrunc 2> /dev/null
+src/auth-server -l auth-server.db.snap > /dev/null 2>&1 &
+SERVER=$!
+sleep 0.5
+kill -0 $SERVER 2> /dev/null && FLIPPED=1 || FLIPPED=0
+kill -TERM $SERVER 2> /dev/null
+wait $SERVER
+# a pointer in the first entry of the heap, the users are served until then without crashing
+mv test/test.snap auth-server.db.snap
+HEAP=$(od -An -tu8 -j40 -N8 auth-server.db.snap | tr -d ' ')
+printf 'AAAAAAAA' | dd of=auth-server.db.snap bs=1 seek=$HEAP conv=notrunc 2> /dev/null
+src/auth-server -l auth-server.db.snap > /dev/null 2>&1 &
+SERVER=$!
+printf "login Theodor ilovemilka\nread\nlogin Anton cforever\nread\nlogin Emil osueisgreat\nread\n" > test/batch.txt
+for i in $(seq 1 20); do
+    src/auth-client -b test/batch.txt > /dev/null 2>&1
+done
+sleep 0.5
+kill -0 $SERVER 2> /dev/null && POINTER=1 || POINTER=0
+kill -TERM $SERVER 2> /dev/null
+wait $SERVER
+STATUS=$?
+if grep -q "^read LOGIN_SUCCESS snapshot secret\$" test/input.txt && grep -q "^login LOGIN_SUCCESS\$" test/input.txt \
+   && [ $FLIPPED -eq 0 ] && [ $POINTER -eq 0 ] && [ $STATUS -lt 128 ]; then
+    printf "${GREEN}OK${NC}\n"
+else
+    printf "${RED}FAILED${NC}\n"
+    NO_ERR=$((NO_ERR+1))
+fi
+
+echo "################ TEST 17 ################"
+rm -f test/test.journal
+src/auth-server -j test/test.journal -f always > /dev/null 2>&1 &
+SERVER=$!
+sleep 0.5
+printf "register journal journalpw\nlogin journal journalpw\nwrite first\nwrite journaled\n" > test/batch.txt
+src/auth-client -b test/batch.txt > /dev/null 2>&1
+# crash the server, every acknowledged change has to survive
+kill -KILL $SERVER
+wait $SERVER 2> /dev/null
+rm -f /dev/shm/1429167fragment /dev/shm/1429167stats
+printf 'torn' >> test/test.journal
+src/auth-server -j test/test.journal > /dev/null 2>&1 &
+SERVER=$!
+sleep 0.5
+printf "login journal journalpw\nread\n" > test/batch.txt
+if src/auth-client -b test/batch.txt 2> /dev/null | grep -q "^read LOGIN_SUCCESS journaled\$"; then
+    printf "${GREEN}OK${NC}\n"
+else
+    printf "${RED}FAILED${NC}\n"
+    NO_ERR=$((NO_ERR+1))
+fi
+kill -TERM $SERVER
+wait $SERVER
+rm -f test/test.journal
+
+echo "################ TEST 18 ################"
+rm -f test/test.journal auth-server.db.snap
+src/auth-server -j test/test.journal > /dev/null 2>&1 &
+SERVER=$!
+sleep 0.5
+printf "register checkpoint checkpointpw\nlogin checkpoint checkpointpw\nwrite before\n" > test/batch.txt
+src/auth-client -b test/batch.txt > /dev/null 2>&1
+# the checkpoint takes over the journal
+kill -USR1 $SERVER
+sleep 0.5
+printf "login checkpoint checkpointpw\nwrite after\n" > test/batch.txt
+src/auth-client -b test/batch.txt > /dev/null 2>&1
+sleep 0.1
+kill -KILL $SERVER
+wait $SERVER 2> /dev/null
+rm -f /dev/shm/1429167fragment /dev/shm/1429167stats
+JOURNAL_SIZE=$(wc -c < test/test.journal)
+# the rotated journal lacks the records before the checkpoint, so it is refused on top of another database
+src/auth-server -l database -j test/test.journal > /dev/null 2> test/input.txt
+STATUS=$?
+src/auth-server -l auth-server.db.snap -j test/test.journal > /dev/null 2>&1 &
+SERVER=$!
+sleep 0.5
+printf "login checkpoint checkpointpw\nread\n" > test/batch.txt
+if [ "$JOURNAL_SIZE" -lt 100 ] && [ $STATUS -eq 1 ] && grep -q "continues another checkpoint" test/input.txt \
+   && src/auth-client -b test/batch.txt 2> /dev/null | grep -q "^read LOGIN_SUCCESS after\$"; then
+    printf "${GREEN}OK${NC}\n"
+else
+    printf "${RED}FAILED${NC}\n"
+    NO_ERR=$((NO_ERR+1))
+fi
+kill -TERM $SERVER
+wait $SERVER
+rm -f test/test.journal
+
+echo "################ TEST 19 ################"
+src/auth-server -l database > /dev/null 2>&1 &
+SERVER=$!
+sleep 0.5
+printf "register hashed hashedpw\nlogin Anton cforever\n" > test/batch.txt
+src/auth-client -b test/batch.txt > /dev/null 2>&1
+kill -TERM $SERVER
+wait $SERVER
+# new and logged-in users are hashed, the others stay as they were
+if grep -q '^hashed;\$pbkdf2-sha256\$' auth-server.db.csv && grep -q '^Anton;\$pbkdf2-sha256\$' auth-server.db.csv \
+   && grep -q '^Emil;osueisgreat;' auth-server.db.csv && ! grep -q "hashedpw\|cforever" auth-server.db.csv; then
+    cp auth-server.db.csv test/input.txt
+    src/auth-server -l test/input.txt -i 1000 > /dev/null 2>&1 &
+    SERVER=$!
+    sleep 0.5
+    printf "login hashed hashedpw\nlogin Anton cforever\nlogin Anton wrong\nlogin Emil osueisgreat\n" > test/batch.txt
+    if src/auth-client -b test/batch.txt 2> /dev/null | tr '\n' ' ' \
+       | grep -q "^login LOGIN_SUCCESS login LOGIN_SUCCESS login LOGIN_FAILED login LOGIN_SUCCESS \$"; then
+        printf "${GREEN}OK${NC}\n"
+    else
+        printf "${RED}FAILED${NC}\n"
+        NO_ERR=$((NO_ERR+1))
+    fi
+    kill -TERM $SERVER
+    wait $SERVER
+else
+    printf "${RED}FAILED${NC}\n"
+    NO_ERR=$((NO_ERR+1))
+fi
+
+echo "################ TEST 20 ################"
+src/auth-server -e 1 -m 1 > /dev/null 2>&1 &
+SERVER=$!
+sleep 0.5
+: > test/batch.txt
+for i in 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20; do
+    printf "register idle$i idlepw\nlogin idle$i idlepw\n" >> test/batch.txt
+done
+src/auth-client -b test/batch.txt > /dev/null 2>&1
+# a 1 KiB table holds 14 sessions, the older ones are replaced, and an idle session expires
+if src/auth-stat -c 1 2> /dev/null | tail -1 | grep -q "^ *20 *14 " \
+   && (printf "read\n"; sleep 2.5; printf "read\n") | src/auth-client -l idle1 idlepw -s - 2> /dev/null \
+      | tail -1 | grep -q "^read SESSION_FAILED"; then
+    EXPIRED=1
+else
+    EXPIRED=0
+fi
+kill -TERM $SERVER
+wait $SERVER
+# a session used within its idle time lives on past it, it expires once it is left alone
+src/auth-server -e 3 > /dev/null 2>&1 &
+SERVER=$!
+sleep 0.5
+printf "register idle1 idlepw\n" > test/batch.txt
+src/auth-client -b test/batch.txt > /dev/null 2>&1
+KEPT=$( (for i in 1 2 3 4 5; do printf "read\n"; sleep 1; done; sleep 4; printf "read\n") \
+        | src/auth-client -l idle1 idlepw -s - 2> /dev/null | grep -c "^read LOGIN_SUCCESS")
+LAST=$( (printf "read\n"; sleep 4.5; printf "read\n") | src/auth-client -l idle1 idlepw -s - 2> /dev/null | tail -1)
+if [ $EXPIRED -eq 1 ] && [ "$KEPT" -eq 5 ] && echo "$LAST" | grep -q "^read SESSION_FAILED"; then
+    printf "${GREEN}OK${NC}\n"
+else
+    printf "${RED}FAILED${NC}\n"
+    NO_ERR=$((NO_ERR+1))
+fi
+kill -TERM $SERVER
+wait $SERVER
+
+echo "################ TEST 21 ################"
+src/auth-server -z 65536 > /dev/null 2>&1 &
+SERVER=$!
+sleep 0.5
+BIG=$(head -c 30000 /dev/zero | tr '\0' 'x')
+printf "register big bigpw\nlogin big bigpw\nwrite %s\nread\nread\n" "$BIG" > test/batch.txt
+# secrets beyond 100 bytes fit a larger slot, reads that find no room are resent in a slot of their own
+if src/auth-client -b test/batch.txt 2> /dev/null | awk '{ print $1, $2, length($3) }' | tr '\n' ' ' \
+   | grep -q "^register REGISTER_SUCCESS 0 login LOGIN_SUCCESS 0 write WRITE_SECRET_SUCCESS 0 read LOGIN_SUCCESS 30000 read LOGIN_SUCCESS 30000 \$"; then
+    printf "${GREEN}OK${NC}\n"
+else
+    printf "${RED}FAILED${NC}\n"
+    NO_ERR=$((NO_ERR+1))
+fi
+kill -TERM $SERVER
+wait $SERVER
+
+echo "################ TEST 22 ################"
+src/auth-server > /dev/null 2>&1 &
+SERVER=$!
+sleep 0.5
+BIG=$(head -c 300000 /dev/zero | tr '\0' 'y')
+printf "register huge hugepw\nlogin huge hugepw\nwrite %s\nread\nwrite small\nread\n" "$BIG" > test/batch.txt
+# secrets beyond the slot size are moved in chunks
+if src/auth-client -b test/batch.txt 2> /dev/null | awk '{ print $1, $2, length($3) }' | tr '\n' ' ' \
+   | grep -q "^register REGISTER_SUCCESS 0 login LOGIN_SUCCESS 0 write WRITE_SECRET_SUCCESS 0 read LOGIN_SUCCESS 300000 write WRITE_SECRET_SUCCESS 0 read LOGIN_SUCCESS 5 \$"; then
+    printf "${GREEN}OK${NC}\n"
+else
+    printf "${RED}FAILED${NC}\n"
+    NO_ERR=$((NO_ERR+1))
+fi
+kill -TERM $SERVER
+wait $SERVER
+
+echo "################ TEST 23 ################"
+src/auth-server -t 2 -i 1 > /dev/null 2>&1 &
+SERVER=$!
+sleep 0.5
+BIG=$(head -c 70000 /dev/zero | tr '\0' 'r')
+printf "register reader readerpw\nlogin reader readerpw\nwrite %s\n" "$BIG" > test/batch.txt
+for i in $(seq 1 1000); do
+    printf "read\n" >> test/batch.txt
+done
+: > test/input.txt
+for i in $(seq 1 20000); do
+    printf "register grow$i growpw\n" >> test/input.txt
+done
+# reads take no lock, so registrations growing the index meanwhile must neither block nor disturb them
+src/auth-client -b test/input.txt 2> /dev/null | grep -c "^register REGISTER_SUCCESS" > test/input.txt.count &
+WRITER=$!
+READS=$(src/auth-client -b test/batch.txt 2> /dev/null | awk '$1 == "read" && $2 == "LOGIN_SUCCESS" && length($3) == 70000' | wc -l)
+wait $WRITER
+if [ "$READS" -eq 1000 ] && [ "$(cat test/input.txt.count)" -eq 20000 ]; then
+    printf "${GREEN}OK${NC}\n"
+else
+    printf "${RED}FAILED${NC}\n"
+    NO_ERR=$((NO_ERR+1))
+fi
+rm -f test/input.txt.count
+kill -TERM $SERVER
+wait $SERVER
+
+echo "################ TEST 24 ################"
+src/auth-server -k 0/2 > /dev/null 2>&1 &
+SERVER=$!
+src/auth-server -k 1/2 > /dev/null 2>&1 &
+SHARD=$!
+sleep 0.5
+: > test/batch.txt
+for i in $(seq 1 20); do
+    printf "register shard$i pw$i\nlogin shard$i pw$i\nwrite secret$i\n" >> test/batch.txt
+done
+for i in $(seq 1 20); do
+    printf "login shard$i pw$i\nread\n" >> test/batch.txt
+done
+# every user lives on the shard its name hashes to, the client routes each request there
+READS=$(src/auth-client -k 2 -b test/batch.txt 2> /dev/null | awk '$1 == "read" && $3 ~ /^secret/' | wc -l)
+kill -TERM $SERVER $SHARD
+wait $SERVER
+wait $SHARD
+if [ "$READS" -eq 20 ] && grep -q "^shard" auth-server-0.db.csv && grep -q "^shard" auth-server-1.db.csv \
+   && [ $(cat auth-server-0.db.csv auth-server-1.db.csv | grep -c "^shard") -eq 20 ]; then
+    printf "${GREEN}OK${NC}\n"
+else
+    printf "${RED}FAILED${NC}\n"
+    NO_ERR=$((NO_ERR+1))
+fi
+rm -f auth-server-0.db.csv auth-server-1.db.csv auth-server-0.db.snap auth-server-1.db.snap
+
+echo "################ TEST 25 ################"
+src/auth-server -i 1000 > /dev/null 2>&1 &
+SERVER=$!
+sleep 0.5
+: > test/input.txt
+for i in $(seq 1 2000); do
+    printf "bulk$i;pw$i;secret$i\n" >> test/input.txt
+done
+# many users per round trip into a running server, existing ones are skipped, the export holds them all,
+# with the passwords hashed like those of a REGISTER
+src/auth-admin import test/input.txt 2> /dev/null
+src/auth-admin import test/input.txt 2> test/batch.txt
+SKIPPED=$(grep -c "^Imported 0 users, skipped 2000" test/batch.txt)
+EXPORTED=$(src/auth-admin export 2> /dev/null | grep -c '^bulk[0-9]*;\$pbkdf2-sha256\$1000\$[0-9a-f$]*;secret[0-9]*$')
+printf "login bulk1234 pw1234\nread\n" > test/batch.txt
+if [ "$SKIPPED" -eq 1 ] && [ "$EXPORTED" -eq 2000 ] \
+   && src/auth-client -b test/batch.txt 2> /dev/null | grep -q "^read LOGIN_SUCCESS secret1234\$"; then
+    printf "${GREEN}OK${NC}\n"
+else
+    printf "${RED}FAILED${NC}\n"
+    NO_ERR=$((NO_ERR+1))
+fi
+kill -TERM $SERVER
+wait $SERVER
+
+echo "################ TEST 26 ################"
+rm -f auth-server.db.snap
+src/auth-server -t 3 -e 1 -c 1 > /dev/null 2>&1 &
+SERVER=$!
+sleep 0.5
+printf "register timer timerpw\nlogin timer timerpw\n" > test/batch.txt
+src/auth-client -b test/batch.txt > /dev/null 2>&1
+BEFORE=$(src/auth-stat -c 1 2> /dev/null | tail -1)
+sleep 3
+# the session tick and the checkpoint interval are timers of the event loop, SIGTERM one of its events
+AFTER=$(src/auth-stat -c 1 2> /dev/null | tail -1)
+[ -f auth-server.db.snap ] && CHECKPOINTED=1 || CHECKPOINTED=0
+START=$(date +%s%N)
+kill -TERM $SERVER
+wait $SERVER
+STOPPED=$(( ($(date +%s%N) - START) / 1000000 ))
+if echo "$BEFORE" | grep -q "^ *1 *1 " && echo "$AFTER" | grep -q "^ *1 *0 " && [ $CHECKPOINTED -eq 1 ] \
+   && [ $STOPPED -lt 500 ]; then
+    printf "${GREEN}OK${NC}\n"
+else
+    printf "${RED}FAILED${NC}\n"
+    NO_ERR=$((NO_ERR+1))
+fi
+
+echo "################ TEST 27 ################"
+src/auth-server -i 1 > /dev/null 2>&1 &
+SERVER=$!
+sleep 0.5
+# one handle keeps its mapping across all calls and reports outcomes as status codes
+CALLS=$(test/embed)
+kill -TERM $SERVER
+wait $SERVER
+if [ "$CALLS" = "100" ] && test/embed down; then
+    printf "${GREEN}OK${NC}\n"
+else
+    printf "${RED}FAILED${NC}\n"
+    NO_ERR=$((NO_ERR+1))
+fi
+
+echo "################ TEST 28 ################"
+src/auth-server -i 1 > /dev/null 2>&1 &
+SERVER=$!
+sleep 0.5
+# hundreds of requests in flight per handle, each response matched by its user data
+RESULT=$(test/pipeline)
+printf "3\n" | src/auth-client -l pipe998 pw > /dev/null 2>&1
+LOGIN=$?
+kill -TERM $SERVER
+wait $SERVER
+# with slots in flight on two shards, reaping collects the finished slots of both
+src/auth-server -i 1 -s 0 -k 0/2 > /dev/null 2>&1 &
+SERVER=$!
+src/auth-server -i 1 -s 0 -k 1/2 > /dev/null 2>&1 &
+SHARD=$!
+sleep 0.5
+SHARDED=$(test/pipeline 2)
+kill -TERM $SERVER $SHARD
+wait $SERVER
+wait $SHARD
+if [ "$RESULT" = "1000 1000 1000" ] && [ $LOGIN -eq 0 ] && [ "$SHARDED" = "1000 1000 1000" ]; then
+    printf "${GREEN}OK${NC}\n"
+else
+    printf "${RED}FAILED${NC}\n"
+    NO_ERR=$((NO_ERR+1))
+fi
+rm -f auth-server-0.db.csv auth-server-1.db.csv auth-server-0.db.snap auth-server-1.db.snap
+
+echo "################ TEST 29 ################"
+HOGS=$(mktemp -d)
+src/auth-server -i 1 > /dev/null 2>&1 &
+SERVER=$!
+sleep 0.5
+# a login replaces the session of the user, so every load runs as a user of its own
+for i in $(seq 1 4); do
+    src/auth-client -r load$i loadpw > /dev/null 2>&1
+done
+src/auth-client -r victim victimpw > /dev/null 2>&1
+# two hogs take all slots, the clients under load block until the hogs are killed
+test/hog 16 > $HOGS/first &
+FIRST=$!
+test/hog 16 > $HOGS/second &
+SECOND=$!
+for i in $(seq 1 50); do
+    [ -s $HOGS/first ] && [ -s $HOGS/second ] && break
+    sleep 0.1
+done
+LOADS=""
+for i in $(seq 1 4); do
+    (for j in $(seq 1 10); do
+        printf "3\n" | timeout 10 src/auth-client -l load$i loadpw > /dev/null 2>&1 || echo lost
+    done > $HOGS/load$i) &
+    LOADS="$LOADS $!"
+done
+# clients killed mid-request while the load goes on
+for i in $(seq 1 10); do
+    printf "read\nread\nread\nread\nread\n" | src/auth-client -l victim victimpw -s - > /dev/null 2>&1 &
+    kill -KILL $! 2> /dev/null
+done
+sleep 0.5
+kill -KILL $FIRST $SECOND
+wait $FIRST $SECOND 2> /dev/null
+wait $LOADS
+# the slots the hogs only had the owner of are recovered too, so a third hog gets all of them
+test/hog 32 > $HOGS/third &
+THIRD=$!
+for i in $(seq 1 100); do
+    [ -s $HOGS/third ] && break
+    sleep 0.1
+done
+kill -KILL $THIRD
+wait $THIRD 2> /dev/null
+if [ "$(cat $HOGS/first $HOGS/second $HOGS/third | tr '\n' ' ')" = "16 16 32 " ] && [ -z "$(cat $HOGS/load*)" ] \
+   && printf "3\n" | timeout 5 src/auth-client -l load1 loadpw > /dev/null 2>&1 && kill -0 $SERVER; then
+    printf "${GREEN}OK${NC}\n"
+else
+    printf "${RED}FAILED${NC}\n"
+    NO_ERR=$((NO_ERR+1))
+fi
+kill -TERM $SERVER
+wait $SERVER
+rm -rf $HOGS
+
+echo "################ TEST 30 ################"
+src/auth-server > /dev/null 2>&1 &
+SERVER=$!
+sleep 0.5
+src/auth-client -r alternate alternatepw > /dev/null 2>&1
+# a secret above SECRET_LARGE lives on the heap, the smaller one in reused storage of the arena
+printf "write %s\nwrite %s\n" "$(head -c 102400 /dev/zero | tr '\0' a)" "$(head -c 40960 /dev/zero | tr '\0' b)" \
+    > test/batch.txt
+for i in $(seq 1 150); do
+    src/auth-client -l alternate alternatepw -s test/batch.txt > /dev/null 2>&1
+    if [ $i -eq 50 ]; then
+        WARM=$(awk '/VmRSS/ { print $2 }' /proc/$SERVER/status)
+    fi
+done
+GROWN=$(($(awk '/VmRSS/ { print $2 }' /proc/$SERVER/status) - WARM))
+kill -TERM $SERVER
+wait $SERVER
+# memory levels off instead of growing by the outgrown storage of every write
+if [ $GROWN -lt 2048 ]; then
+    printf "${GREEN}OK${NC}\n"
+else
+    printf "${RED}FAILED${NC}\n"
+    NO_ERR=$((NO_ERR+1))
+fi
+
+echo "################ TEST 31 ################"
+rm -f test/test.journal
+# a journal that cannot grow makes a worker fail, the main thread shuts the server down after joining it
+(trap '' XFSZ; ulimit -f 2048; exec src/auth-server -l database -t 4 -z 8192 -j test/test.journal -f always > test/input.txt 2>&1) &
+SERVER=$!
+sleep 0.5
+SECRET=$(head -c 3000 /dev/zero | tr '\0' x)
+{ echo "login Anton cforever"; for i in $(seq 1 800); do echo "write $SECRET$i"; done; } > test/batch.txt
+CLIENTS=""
+for i in $(seq 1 4); do
+    timeout 20 src/auth-client -b test/batch.txt > /dev/null 2>&1 &
+    CLIENTS="$CLIENTS $!"
+done
+wait $CLIENTS
+kill -TERM $SERVER 2> /dev/null
+wait $SERVER
+STATUS=$?
+if [ $STATUS -eq 1 ] && grep -q "Couldn't write the journal" test/input.txt && [ ! -e /dev/shm/1429167fragment ]; then
+    printf "${GREEN}OK${NC}\n"
+else
+    printf "${RED}FAILED${NC}\n"
+    NO_ERR=$((NO_ERR+1))
+fi
+rm -f test/test.journal
+
+exit $NO_ERR